@@ -1,23 +1,112 @@
 //-----------------------------------------------
 // Copyright 2009 Wellcome Trust Sanger Institute
 // Written by Jared Simpson (js18@sanger.ac.uk)
-// Released under the GPL 
+// Released under the GPL
 //-----------------------------------------------
 //
-// BWT - All functions that use a BWT include this file
-// it simple typedefs the BWT name to the implementation
-// of the BWT that we want, either the uncompressed version
-// (SBWT) or the run-length encoded version (RLBWT). This could 
-// be done using inheritence but the BWT is so used so much that 
-// overhead of calling virtual functions is unwanted
-//          
+// BWT - All functions that use a BWT include this file.
+// A BWT built from a suffix array is either the run-length
+// encoded version (RLBWT), or for small read sets the packed
+// version (PackedBWT), whose occurrence queries are a few
+// popcounts rather than a walk over runs. The BWT is used so
+// much that the overhead of virtual functions is unwanted, so
+// each call branches on which one was built instead
+//
 //
 #ifndef BWT_H
 #define BWT_H
 
 #include "RLBWT.h"
 #include "SBWT.h"
+#include "PackedBWT.h"
+
+// BWTs of fewer symbols than this are packed. The packed block counts
+// are 32 bits, so the bound must stay below 2^32, and for large sets
+// the run-length BWT compresses much better
+#define PACKED_BWT_MAX_SYMBOLS 150000000ULL
+static_assert(PACKED_BWT_MAX_SYMBOLS <= 0xFFFFFFFFULL, "packed BWT counts are 32 bits");
+
+class BWT
+{
+    public:
+
+        static const int DEFAULT_SAMPLE_RATE_LARGE = RLBWT::DEFAULT_SAMPLE_RATE_LARGE;
+        static const int DEFAULT_SAMPLE_RATE_SMALL = RLBWT::DEFAULT_SAMPLE_RATE_SMALL;
+
+        // Read a run-length BWT from a file
+        BWT(const std::string& filename, int sampleRate = RLBWT::DEFAULT_SAMPLE_RATE_SMALL)
+            : m_pRL(new RLBWT(filename, sampleRate)), m_pPacked(NULL) {}
+
+        // Construct the BWT from a suffix array
+        BWT(const SuffixArray* pSA, const ReadTable* pRT) : m_pRL(NULL), m_pPacked(NULL)
+        {
+            if(pSA->getSize() < PACKED_BWT_MAX_SYMBOLS)
+                m_pPacked = new PackedBWT(pSA, pRT);
+            else
+                m_pRL = new RLBWT(pSA, pRT);
+        }
+
+        ~BWT()
+        {
+            delete m_pRL;
+            delete m_pPacked;
+        }
+
+        inline char getChar(size_t idx) const
+        {
+            return m_pPacked ? m_pPacked->getChar(idx) : m_pRL->getChar(idx);
+        }
+
+        inline BaseCount getPC(char b) const
+        {
+            return m_pPacked ? m_pPacked->getPC(b) : m_pRL->getPC(b);
+        }
+
+        inline BaseCount getOcc(char b, size_t idx) const
+        {
+            return m_pPacked ? m_pPacked->getOcc(b, idx) : m_pRL->getOcc(b, idx);
+        }
+
+        inline AlphaCount64 getFullOcc(size_t idx) const
+        {
+            return m_pPacked ? m_pPacked->getFullOcc(idx) : m_pRL->getFullOcc(idx);
+        }
+
+        inline AlphaCount64 getOccDiff(size_t idx0, size_t idx1) const
+        {
+            return m_pPacked ? m_pPacked->getOccDiff(idx0, idx1) : m_pRL->getOccDiff(idx0, idx1);
+        }
+
+        inline size_t getNumStrings() const
+        {
+            return m_pPacked ? m_pPacked->getNumStrings() : m_pRL->getNumStrings();
+        }
+
+        inline size_t getBWLen() const
+        {
+            return m_pPacked ? m_pPacked->getBWLen() : m_pRL->getBWLen();
+        }
+
+        inline char getF(size_t idx) const
+        {
+            return m_pPacked ? m_pPacked->getF(idx) : m_pRL->getF(idx);
+        }
+
+        void printInfo() const
+        {
+            if(m_pPacked)
+                m_pPacked->printInfo();
+            else
+                m_pRL->printInfo();
+        }
+
+    private:
+
+        BWT(const BWT&);
+        BWT& operator=(const BWT&);
 
-typedef RLBWT BWT;
+        RLBWT* m_pRL;
+        PackedBWT* m_pPacked;
+};
 
 #endif
@@ -0,0 +1,85 @@
+//-----------------------------------------------
+// Released under the GPL license
+//-----------------------------------------------
+//
+// PackedBWT - Uncompressed BWT for small read sets
+//
+#include "PackedBWT.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Construct the BWT from a suffix array
+PackedBWT::PackedBWT(const SuffixArray* pSA, const ReadTable* pRT)
+{
+    size_t n = pSA->getSize();
+    m_numStrings = pSA->getNumStrings();
+    m_numSymbols = n;
+
+    // the block counts are 32 bits
+    assert(n <= UINT32_MAX);
+
+    // one block past the last symbol, so the counts at the end can be read
+    m_numBlocks = n / PACKED_BWT_BLOCK + 1;
+    void* p = NULL;
+    if(posix_memalign(&p, 64, m_numBlocks * sizeof(Block)) != 0)
+        throw std::bad_alloc();
+    m_blocks = static_cast<Block*>(p);
+    memset(m_blocks, 0, m_numBlocks * sizeof(Block));
+
+    AlphaCount64 running_ac;
+    for(size_t i = 0; i < n; ++i)
+    {
+        Block& block = m_blocks[i / PACKED_BWT_BLOCK];
+        size_t r = i % PACKED_BWT_BLOCK;
+        if(r == 0)
+        {
+            for(int c = 0; c < 4; ++c)
+                block.counts[c] = running_ac.getByIdx(c + 1);
+        }
+
+        SAElem saElem = pSA->get(i);
+        const SeqItem& si = pRT->getRead(saElem.getID());
+
+        // Get the position of the start of the suffix
+        uint64_t f_pos = saElem.getPos();
+        uint64_t l_pos = (f_pos == 0) ? si.seq.length() : f_pos - 1;
+        char b = (l_pos == si.seq.length()) ? '$' : si.seq.get(l_pos);
+
+        if(b == '$')
+            block.dollars[r / 64] |= 1ULL << (r % 64);
+        else
+            block.bits[r / 32] |= (uint64_t)DNA_ALPHABET::getBaseRank(b) << (2 * (r % 32));
+        running_ac.increment(b);
+    }
+
+    // counts for the block holding the end
+    if(n % PACKED_BWT_BLOCK == 0)
+    {
+        Block& block = m_blocks[m_numBlocks - 1];
+        for(int c = 0; c < 4; ++c)
+            block.counts[c] = running_ac.getByIdx(c + 1);
+    }
+
+    m_predCount.set('$', 0);
+    m_predCount.set('A', running_ac.get('$'));
+    m_predCount.set('C', m_predCount.get('A') + running_ac.get('A'));
+    m_predCount.set('G', m_predCount.get('C') + running_ac.get('C'));
+    m_predCount.set('T', m_predCount.get('G') + running_ac.get('G'));
+}
+
+PackedBWT::~PackedBWT()
+{
+    free(m_blocks);
+}
+
+void PackedBWT::printInfo() const
+{
+    size_t bytes = m_numBlocks * sizeof(Block);
+    printf("PackedBWT info\n");
+    printf("Num symbols: %zu\n", m_numSymbols);
+    printf("Num blocks: %zu\n", m_numBlocks);
+    printf("Total size: %.2lf MB (%.2lf bytes per symbol)\n", (double)bytes / (1024 * 1024), (double)bytes / m_numSymbols);
+}
@@ -0,0 +1,189 @@
+//-----------------------------------------------
+// Released under the GPL license
+//-----------------------------------------------
+//
+// PackedBWT - Uncompressed BWT for small read sets.
+// Symbols are packed 2 bits each in blocks of 128,
+// with the counts before the block interleaved, so
+// an occurrence query is one block read and a few
+// popcounts. The '$' symbols are stored as 'A' and
+// flagged in a bitmask of their own
+//
+#ifndef PACKEDBWT_H
+#define PACKEDBWT_H
+
+#include "STCommon.h"
+#include "SuffixArray.h"
+#include "ReadTable.h"
+
+#define PACKED_BWT_BLOCK 128
+
+class PackedBWT
+{
+    public:
+
+        PackedBWT(const SuffixArray* pSA, const ReadTable* pRT);
+        ~PackedBWT();
+
+        inline char getChar(size_t idx) const
+        {
+            const Block& block = m_blocks[idx / PACKED_BWT_BLOCK];
+            size_t r = idx % PACKED_BWT_BLOCK;
+            if((block.dollars[r / 64] >> (r % 64)) & 1)
+                return '$';
+            return "ACGT"[(block.bits[r / 32] >> (2 * (r % 32))) & 3];
+        }
+
+        inline BaseCount getPC(char b) const { return m_predCount.get(b); }
+
+        // Return the number of times char b appears in bwt[0, idx]
+        inline BaseCount getOcc(char b, size_t idx) const
+        {
+            ++idx;
+            const Block& block = m_blocks[idx / PACKED_BWT_BLOCK];
+            size_t r = idx % PACKED_BWT_BLOCK;
+            size_t dollars = countDollars(block, r);
+            if(b == '$')
+                return dollarsBefore(block, idx - r) + dollars;
+            int c = DNA_ALPHABET::getBaseRank(b);
+            size_t n = block.counts[c] + countSymbol(block, c, r);
+            return c == 0 ? n - dollars : n;
+        }
+
+        // Return the number of times each symbol in the alphabet appears in bwt[0, idx]
+        inline AlphaCount64 getFullOcc(size_t idx) const
+        {
+            ++idx;
+            const Block& block = m_blocks[idx / PACKED_BWT_BLOCK];
+            size_t r = idx % PACKED_BWT_BLOCK;
+            size_t dollars = countDollars(block, r);
+
+            // one pass over the words, counting the fields with the high bit
+            // set, the low bit set and both. A is what's left
+            size_t hi = 0, lo = 0, both = 0;
+            for(size_t w = 0; w < (r + 31) / 32; ++w)
+            {
+                uint64_t x = block.bits[w];
+                if(w == r / 32)
+                    x &= (1ULL << (2 * (r % 32))) - 1;
+                uint64_t h = (x >> 1) & 0x5555555555555555ULL;
+                uint64_t l = x & 0x5555555555555555ULL;
+                hi += countEvenBits(h);
+                lo += countEvenBits(l);
+                both += countEvenBits(h & l);
+            }
+
+            AlphaCount64 ac;
+            ac.setByIdx(0, dollarsBefore(block, idx - r) + dollars);
+            ac.setByIdx(1, block.counts[0] + r - hi - lo + both - dollars);
+            ac.setByIdx(2, block.counts[1] + lo - both);
+            ac.setByIdx(3, block.counts[2] + hi - both);
+            ac.setByIdx(4, block.counts[3] + both);
+            return ac;
+        }
+
+        // Return the number of times each symbol in the alphabet appears ins bwt[idx0, idx1]
+        inline AlphaCount64 getOccDiff(size_t idx0, size_t idx1) const
+        {
+            return getFullOcc(idx1) - getFullOcc(idx0);
+        }
+
+        inline size_t getNumStrings() const { return m_numStrings; }
+        inline size_t getBWLen() const { return m_numSymbols; }
+
+        // Return the first letter of the suffix starting at idx
+        inline char getF(size_t idx) const
+        {
+            size_t ci = 0;
+            while(ci < ALPHABET_SIZE && m_predCount.getByIdx(ci) <= idx)
+                ci++;
+            assert(ci != 0);
+            return RANK_ALPHABET[ci - 1];
+        }
+
+        void printInfo() const;
+
+    private:
+
+        PackedBWT(const PackedBWT&);
+        PackedBWT& operator=(const PackedBWT&);
+
+        // counts holds A, C, G, T (not counting the '$'s stored as A) over
+        // every block before this one. A block fills one cache line
+        struct alignas(64) Block
+        {
+            uint32_t counts[4];
+            uint64_t dollars[PACKED_BWT_BLOCK / 64];
+            uint64_t bits[PACKED_BWT_BLOCK / 32];
+        };
+        static_assert(sizeof(Block) == 64, "a block should fill one cache line");
+
+        // number of '$' before the block, which starts at symbol start
+        inline static size_t dollarsBefore(const Block& block, size_t start)
+        {
+            return start - block.counts[0] - block.counts[1] - block.counts[2] - block.counts[3];
+        }
+
+        // number of '$' in the first r symbols of the block
+        inline static size_t countDollars(const Block& block, size_t r)
+        {
+            size_t n = 0;
+            for(size_t w = 0; w < r / 64; ++w)
+                n += countBits(block.dollars[w]);
+            if(r % 64)
+                n += countBits(block.dollars[r / 64] & ((1ULL << (r % 64)) - 1));
+            return n;
+        }
+
+        // number of symbols of rank c in the first r symbols of the block
+        inline static size_t countSymbol(const Block& block, int c, size_t r)
+        {
+            const uint64_t pattern = 0x5555555555555555ULL * c;
+            size_t n = 0;
+            for(size_t w = 0; w < r / 32; ++w)
+                n += countInWord(block.bits[w] ^ pattern);
+            if(r % 32)
+                n += countInWord((block.bits[r / 32] ^ pattern) | (~0ULL << (2 * (r % 32))));
+            return n;
+        }
+
+        // number of 2-bit fields that are 0
+        inline static size_t countInWord(uint64_t x)
+        {
+            return countEvenBits(~(x | (x >> 1)) & 0x5555555555555555ULL);
+        }
+
+        // Without a popcount instruction the builtin is a table lookup in
+        // libgcc, which is slower than adding up the bits in place
+#ifdef __POPCNT__
+        inline static size_t countBits(uint64_t x) { return __builtin_popcountll(x); }
+        inline static size_t countEvenBits(uint64_t x) { return __builtin_popcountll(x); }
+#else
+        inline static size_t countBits(uint64_t x)
+        {
+            return countEvenBits(x - ((x >> 1) & 0x5555555555555555ULL));
+        }
+
+        // sum of the 2-bit fields of x, which is the number of bits set
+        // when only the low bit of each field can be
+        inline static size_t countEvenBits(uint64_t x)
+        {
+            x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+            x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+            return (x * 0x0101010101010101ULL) >> 56;
+        }
+#endif
+
+        // allocated on a cache line boundary, which std::vector does not
+        // do for over-aligned types before C++17
+        Block* m_blocks;
+        size_t m_numBlocks;
+
+        // The C(a) array
+        AlphaCount64 m_predCount;
+
+        size_t m_numStrings;
+        size_t m_numSymbols;
+};
+
+#endif
@@ -0,0 +1,250 @@
+//-----------------------------------------------
+// Released under the GPL license
+//-----------------------------------------------
+//
+// SACASmallReads - Suffix array construction for
+// small read tables
+//
+#include "SACASmallReads.h"
+#include "Alphabet.h"
+
+#include <algorithm>
+
+// 3 bits a symbol, so 21 symbols to a key
+#define SYMBOLS_PER_KEY 21
+
+// bits sorted on in each radix pass
+#define RADIX_BITS 11
+
+// runs shorter than this are sorted by comparison rather than radix
+#define RADIX_MIN_RUN 256
+
+namespace
+{
+
+// a suffix (by its offset in the coded reads) and the key it is being sorted on
+template<typename K>
+struct KeyedSuffix
+{
+    K key;
+    uint32_t off;
+    bool operator<(const KeyedSuffix& o) const { return key < o.key; }
+};
+
+struct SortGroup
+{
+    size_t begin;
+    size_t end;
+};
+
+// Sort on the keys, which are less than 1 << bits. LSD radix, RADIX_BITS a
+// pass, skipping the digits that are the same for every key. Stable
+template<typename K>
+void radixSort(std::vector<KeyedSuffix<K> >& v, std::vector<KeyedSuffix<K> >& tmp, int bits)
+{
+    if(v.size() < RADIX_MIN_RUN)
+    {
+        std::stable_sort(v.begin(), v.end());
+        return;
+    }
+
+    const size_t radix = 1 << RADIX_BITS;
+    std::vector<size_t> count(radix + 1);
+    tmp.resize(v.size());
+    for(int shift = 0; shift < bits; shift += RADIX_BITS)
+    {
+        std::fill(count.begin(), count.end(), 0);
+        for(size_t i = 0; i < v.size(); ++i)
+            ++count[((v[i].key >> shift) & (radix - 1)) + 1];
+        if(count[((v[0].key >> shift) & (radix - 1)) + 1] == v.size())
+            continue;
+        for(size_t d = 0; d < radix; ++d)
+            count[d + 1] += count[d];
+        for(size_t i = 0; i < v.size(); ++i)
+            tmp[count[(v[i].key >> shift) & (radix - 1)]++] = v[i];
+        v.swap(tmp);
+    }
+}
+
+// bits needed to hold values below n
+int bitsFor(uint64_t n)
+{
+    int bits = 1;
+    while(bits < 64 && (n >> bits))
+        ++bits;
+    return bits;
+}
+
+// Sort the suffixes of the coded reads. starts[i] is the offset of read i,
+// and each read is followed by its terminator. Suffixes are first sorted on
+// their first SYMBOLS_PER_KEY symbols, packed 3 bits each with the first
+// symbol highest and 0s after the terminator, so a key ending in a 0 reached
+// the terminator. Runs that tie are refined
+// by prefix doubling (Larsson-Sadakane) on the rank of the suffix h symbols on.
+// Offsets increase with read index, so ties on the offset give the read order
+void sortSuffixes(SuffixArray* pSA, const uint8_t* codes, const std::vector<uint64_t>& starts, size_t num_reads)
+{
+    size_t n = starts[num_reads];
+    assert(n < std::numeric_limits<uint32_t>::max());
+
+    // roll the keys back from the terminator of each read
+    std::vector<uint64_t> keys(n);
+    for(size_t i = 0; i < num_reads; ++i)
+    {
+        uint64_t key = 0;
+        for(size_t off = starts[i + 1] - 1; off-- > starts[i];)
+        {
+            key = ((uint64_t)codes[off] << (3 * (SYMBOLS_PER_KEY - 1))) | (key >> 3);
+            keys[off] = key;
+        }
+        keys[starts[i + 1] - 1] = 0;
+    }
+
+    // the radix sort is stable, so ties on the key stay in offset order
+    std::vector<KeyedSuffix<uint64_t> > keyed(n), keyed_tmp;
+    for(size_t off = 0; off < n; ++off)
+    {
+        keyed[off].key = keys[off];
+        keyed[off].off = off;
+    }
+    std::vector<uint64_t>().swap(keys);
+    radixSort(keyed, keyed_tmp, 3 * SYMBOLS_PER_KEY);
+    std::vector<KeyedSuffix<uint64_t> >().swap(keyed_tmp);
+
+    // rank of a suffix is the first index of its group. Suffixes that
+    // reached the terminator are identical, already in read order, and
+    // ranked on their own
+    std::vector<uint32_t> sa(n);
+    std::vector<uint32_t> rank(n);
+    std::vector<SortGroup> groups;
+    groups.reserve(n / 16);
+    for(size_t b = 0; b < n;)
+    {
+        size_t e = b + 1;
+        while(e < n && keyed[e].key == keyed[b].key)
+            ++e;
+        bool ended = (keyed[b].key & 0x7) == 0;
+        for(size_t i = b; i < e; ++i)
+        {
+            sa[i] = keyed[i].off;
+            rank[sa[i]] = ended ? i : b;
+        }
+        if(e - b > 1 && !ended)
+        {
+            SortGroup g = { b, e };
+            groups.push_back(g);
+        }
+        b = e;
+    }
+    std::vector<KeyedSuffix<uint64_t> >().swap(keyed);
+
+    // ties don't survive a pass unless the suffixes still tie, so
+    // it doesn't matter that the small runs aren't sorted stably
+    int rank_bits = bitsFor(n);
+    std::vector<KeyedSuffix<uint32_t> > sub, sub_tmp;
+    std::vector<SortGroup> next_groups;
+    next_groups.reserve(groups.size());
+    for(size_t h = SYMBOLS_PER_KEY; !groups.empty(); h *= 2)
+    {
+        next_groups.clear();
+        for(size_t gi = 0; gi < groups.size(); ++gi)
+        {
+            const SortGroup& g = groups[gi];
+            sub.resize(g.end - g.begin);
+            for(size_t i = g.begin; i < g.end; ++i)
+            {
+                sub[i - g.begin].key = rank[sa[i] + h];
+                sub[i - g.begin].off = sa[i];
+            }
+            if(sub.size() < RADIX_MIN_RUN)
+                std::sort(sub.begin(), sub.end());
+            else
+                radixSort(sub, sub_tmp, rank_bits);
+
+            for(size_t b = 0; b < sub.size();)
+            {
+                size_t e = b + 1;
+                while(e < sub.size() && sub[e].key == sub[b].key)
+                    ++e;
+                for(size_t i = b; i < e; ++i)
+                {
+                    sa[g.begin + i] = sub[i].off;
+                    rank[sub[i].off] = g.begin + b;
+                }
+                if(e - b > 1)
+                {
+                    SortGroup ng = { g.begin + b, g.begin + e };
+                    next_groups.push_back(ng);
+                }
+                b = e;
+            }
+        }
+        groups.swap(next_groups);
+    }
+
+    // read index of each offset, for the output
+    pSA->initialize(n, num_reads);
+    size_t r = 0;
+    for(size_t off = 0; off < n; ++off)
+    {
+        while(off >= starts[r + 1])
+            ++r;
+        rank[off] = r;
+    }
+    for(size_t i = 0; i < n; ++i)
+        pSA->set(i, SAElem(rank[sa[i]], sa[i] - starts[rank[sa[i]]]));
+}
+
+// Code the reads (and their reverses, if given a buffer for them) as
+// base ranks with a 0 terminator
+void codeReads(const ReadTable* pRT, std::vector<uint64_t>& starts, uint8_t* codes, uint8_t* rev_codes)
+{
+    size_t num_reads = pRT->getCount();
+    starts.resize(num_reads + 1);
+    uint64_t off = 0;
+    for(size_t i = 0; i < num_reads; ++i)
+    {
+        starts[i] = off;
+        std::string seq = pRT->getRead(i).seq.toString();
+        size_t l = seq.length();
+        for(size_t j = 0; j < l; ++j)
+        {
+            uint8_t rank = BWT_ALPHABET::getRank(seq[j]);
+            codes[off + j] = rank;
+            if(rev_codes)
+                rev_codes[off + l - 1 - j] = rank;
+        }
+        codes[off + l] = 0;
+        if(rev_codes)
+            rev_codes[off + l] = 0;
+        off += l + 1;
+    }
+    starts[num_reads] = off;
+}
+
+// Symbols to allocate for the coded reads
+size_t codedLength(const ReadTable* pRT)
+{
+    return pRT->countSumLengths() + pRT->getCount();
+}
+
+}
+
+void saca_small_reads(SuffixArray* pSA, const ReadTable* pRT)
+{
+    std::vector<uint8_t> codes(codedLength(pRT), 0);
+    std::vector<uint64_t> starts;
+    codeReads(pRT, starts, codes.data(), NULL);
+    sortSuffixes(pSA, codes.data(), starts, pRT->getCount());
+}
+
+void saca_small_reads(SuffixArray* pSA, SuffixArray* pRevSA, const ReadTable* pRT)
+{
+    // one allocation for both strands
+    size_t n = codedLength(pRT);
+    std::vector<uint8_t> codes(2 * n, 0);
+    std::vector<uint64_t> starts;
+    codeReads(pRT, starts, codes.data(), codes.data() + n);
+    sortSuffixes(pSA, codes.data(), starts, pRT->getCount());
+    sortSuffixes(pRevSA, codes.data() + n, starts, pRT->getCount());
+}
@@ -0,0 +1,26 @@
+//-----------------------------------------------
+// Released under the GPL license
+//-----------------------------------------------
+//
+// SACASmallReads - Suffix array construction for
+// the small read tables of a single assembly
+// (thousands of reads of a few hundred bases).
+// The reads are coded once into one buffer and
+// the suffixes radix sorted on packed keys, with
+// the forward and reverse arrays built together.
+// The order is the same as saca_induced_copying:
+// '$' sorts first, and equal suffixes are ordered
+// by read index. Tables are limited to 4G symbols
+//
+#ifndef SACA_SMALL_READS_H
+#define SACA_SMALL_READS_H
+#include "SuffixArray.h"
+#include "ReadTable.h"
+
+// Build the suffix array of the reads
+void saca_small_reads(SuffixArray* pSA, const ReadTable* pRT);
+
+// Build the suffix arrays of the reads and of the reversed reads
+void saca_small_reads(SuffixArray* pSA, SuffixArray* pRevSA, const ReadTable* pRT);
+
+#endif
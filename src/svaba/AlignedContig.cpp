@@ -1,8 +1,8 @@
 #include "AlignedContig.h"
-#include "PlottedRead.h"
 #include "svabaUtils.h"
+#include "svabaMemory.h"
 
-AlignedContig::AlignedContig(const SeqLib::BamRecordVector& bav, const std::set<std::string>& pref) {
+AlignedContig::AlignedContig(const SeqLib::BamRecordVector& bav) {
     
     if (!bav.size())
       return;
@@ -24,8 +24,6 @@ AlignedContig::AlignedContig(const SeqLib::BamRecordVector& bav, const std::set<
     if (bav.begin()->ReverseFlag()) 
       SeqLib::rcomplement(m_seq);
 
-    prefixes = pref;
-
     for (size_t i = 0; i < m_seq.length(); ++i)
       aligned_coverage.push_back(0);
     
@@ -142,203 +140,104 @@ void AlignedContig::blacklist(SeqLib::GRC &grv) {
   }
   
   void AlignedContig::splitCoverage() { 
+
+    // index the read to contig alignments once for all the breakpoints
+    ContigReadIndex index(m_bamreads, getContigName());
     
     for (auto& i : m_local_breaks_secondaries) 
-      i.splitCoverage(m_bamreads);
+      i.splitCoverage(m_bamreads, index);
 
     for (auto& i : m_global_bp_secondaries) 
-      i.splitCoverage(m_bamreads);
+      i.splitCoverage(m_bamreads, index);
 
     for (auto& i : m_frag_v) 
       for (auto& j : i.m_indel_breaks) 
-      j.splitCoverage(m_bamreads);
+      j.splitCoverage(m_bamreads, index);
     
     for (auto& i : m_local_breaks) 
-      i.splitCoverage(m_bamreads);
+      i.splitCoverage(m_bamreads, index);
     
     if (!m_global_bp.isEmpty()) 
-      m_global_bp.splitCoverage(m_bamreads);
+      m_global_bp.splitCoverage(m_bamreads, index);
     
   }
   
   std::ostream& operator<<(std::ostream& out, const AlignedContig &ac) {
-    
+    out << ac.plotRecord();
+    return out;
+  }
+
+  AlignmentPlot AlignedContig::plotRecord() const {
+
+    AlignmentPlot p;
+    p.name = getContigName();
+    p.seq = getSequence();
+    p.disc = printDiscordantClusters();
+
+    std::stringstream out;
+
     // print the global breakpoint
-    if (!ac.m_global_bp.isEmpty())
-      out << "Global BP: " << ac.m_global_bp << 
-	" ins_aginst_contig " << ac.insertion_against_contig_read_count << 
-	" del_against_contig " << ac.deletion_against_contig_read_count << "  " << 
-	ac.getContigName() << std::endl;       
+    if (!m_global_bp.isEmpty())
+      out << "Global BP: " << m_global_bp << 
+	" ins_aginst_contig " << insertion_against_contig_read_count << 
+	" del_against_contig " << deletion_against_contig_read_count << "  " << 
+	p.name << std::endl;       
     
     // print the global breakpoint for secondaries
-    if (ac.m_global_bp_secondaries.size())
-      out << "SECONDARY Global BP: " << ac.m_global_bp << 
-	" ins_aginst_contig " << ac.insertion_against_contig_read_count << 
-	" del_against_contig " << ac.deletion_against_contig_read_count << "  " << 
-	ac.getContigName() << std::endl;       
+    if (m_global_bp_secondaries.size())
+      out << "SECONDARY Global BP: " << m_global_bp << 
+	" ins_aginst_contig " << insertion_against_contig_read_count << 
+	" del_against_contig " << deletion_against_contig_read_count << "  " << 
+	p.name << std::endl;       
     
     // print the multi-map breakpoints
-    for (auto& i : ac.m_local_breaks)
+    for (auto& i : m_local_breaks)
       if (!i.isEmpty())
-	out << "Multi-map BP: " << i << " -- " << ac.getContigName() << std::endl;       
+	out << "Multi-map BP: " << i << " -- " << p.name << std::endl;       
     // print the multi-map breakpoints for secondary
-    for (auto& i : ac.m_local_breaks_secondaries)
+    for (auto& i : m_local_breaks_secondaries)
       if (!i.isEmpty())
-	out << "SECONDARY Multi-map BP: " << i << " -- " << ac.getContigName() << std::endl;       
+	out << "SECONDARY Multi-map BP: " << i << " -- " << p.name << std::endl;       
     
     // print the indel breakpoints
-    for (auto& i : ac.m_frag_v)
+    for (auto& i : m_frag_v)
       for (auto& j : i.getIndelBreaks()) 
 	if (!j.isEmpty())
-	  out << "Indel: " << j << " -- " << ac.getContigName() << " ins_a_contig " << ac.insertion_against_contig_read_count << 
-	    " del_a_contig " << ac.deletion_against_contig_read_count << std::endl;       
-    
-    // print the AlignmentFragments alignments
-    for (auto& i : ac.m_frag_v) 
-      out << i << " Disc: " << ac.printDiscordantClusters() << " -- " << ac.getContigName() << std::endl;
-    bool draw_divider = true;
-    for (auto& i : ac.m_frag_v) {
-      for (auto& j : i.secondaries) {
-	if (draw_divider) {
-	  out << std::string(ac.m_seq.length(), 'S') << std::endl;
-	  draw_divider = false;
-	}
-	out << j << " Disc: " << ac.printDiscordantClusters() << " -- " << ac.getContigName() << std::endl;
-      }
-    }
+	  out << "Indel: " << j << " -- " << p.name << " ins_a_contig " << insertion_against_contig_read_count << 
+	    " del_a_contig " << deletion_against_contig_read_count << std::endl;       
+    p.breaks = out.str();
+
+    // the AlignmentFragments, primary then secondary
+    for (auto& i : m_frag_v) 
+      p.frags.push_back(i.plotRecord(false));
+    for (auto& i : m_frag_v)
+      for (auto& j : i.secondaries)
+	p.frags.push_back(j.plotRecord(true));
 
-    // print the break locations for indel deletions
-    for (auto& i : ac.m_frag_v) {
-      for (auto& j : i.getIndelBreaks()) {
+    // the break locations for indel deletions
+    for (auto& i : m_frag_v)
+      for (auto& j : i.getIndelBreaks())
 	if (j.num_align == 1 && j.insertion == "") // deletion
-	  //std::cerr << j.b1.cpos << " " << j.b2.cpos << " name " << ac.getContigName() << " ins " << j.insertion << std::endl;
-	  out << std::string(j.b1.cpos, ' ') << "|" << std::string(j.b2.cpos-j.b1.cpos-1, ' ') << '|' << "   " << ac.getContigName() << std::endl;	
-      }
+	  p.deletions.push_back({j.b1.cpos, j.b2.cpos});
+
+    // the reads, with their alignments to this contig
+    p.reads.reserve(m_bamreads.size());
+    for (auto& i : m_bamreads) {
+      const r2c& this_r2c = i.GetR2C(p.name);
+      PlotRead r;
+      r.chr = i.ChrID();
+      r.pos = i.Position();
+      r.start_on_contig = this_r2c.start_on_contig;
+      r.start_on_read = this_r2c.start_on_read;
+      r.rc = this_r2c.rc;
+      r.sr = i.SR();
+      r.seq = i.Seq();
+      for (const auto& c : this_r2c.cig)
+	r.cigar.push_back(c.Raw());
+      p.reads.push_back(r);
     }
-    
-    out << ac.getSequence() << "    " << ac.getContigName() << std::endl; 
-    PlottedReadVector plot_vec;
-    
-    // print out the individual reads
-    for (auto& i : ac.m_bamreads) {
-      
-      //std::string seq = i.QualitySequence();
-      std::string seq = i.Seq(); 
-      //std::string sr = SRTAG(i);
-      std::string sr = i.SR();
-      
-      // get the more complex tags (since there can be multiple annotations per tag)
-      /*      std::vector<int> posvec = i.GetSmartIntTag("SL"); // start positions ON CONTIG
-      std::vector<int> alnvec = i.GetSmartIntTag("TS"); // start positions ON READ
-      std::vector<int> rcvec = i.GetSmartIntTag("RC"); // read reverse complmented relative to contig
-      std::vector<std::string> cigvec = i.GetSmartStringTag("SC"); // read against contig CIGAR
-      std::vector<std::string> cnvec = i.GetSmartStringTag("CN");
-      
-      if (posvec.size() != alnvec.size() ||
-	  posvec.size() != rcvec.size() ||
-	  cigvec.size() != posvec.size() ||
-	  cnvec.size() != posvec.size())
-	continue;
-      
-      assert(cnvec.size() == posvec.size());
-      size_t kk = 0;
-      for (; kk < cnvec.size(); kk++) 
-	if (cnvec[kk] == ac.getContigName()) {
-	  pos = posvec[kk];
-	  aln = alnvec[kk];
-	  rc = rcvec[kk];
-	  this_cig = cigvec[kk];
-	  break;
-	}
-
-      // reverse complement if need be
-      if (rc)
-	SeqLib::rcomplement(seq);      
-      */
-
-      // get the read to contig alignment information
-      r2c this_r2c = i.GetR2C(ac.getContigName());
-      
-      int pos = this_r2c.start_on_contig;
-      int aln = this_r2c.start_on_read;
 
-      if (this_r2c.rc)
-	SeqLib::rcomplement(seq);
-  
-      // edit the string to reflect gapped alignments
-      size_t p = 0; // move along on sequence, starting at first non-clipped base
-      std::string gapped_seq;
-      for (SeqLib::Cigar::const_iterator c = this_r2c.cig.begin(); c != this_r2c.cig.end(); ++c) {
-	if (c->Type() == 'M') { // 
-	  assert(p + c->Length() <= seq.length());
-	  gapped_seq += seq.substr(p, c->Length());
-	} else if (c->Type() == 'D') {
-	  gapped_seq += std::string(c->Length(), '-');
-	}
-	
-	if (c->Type() == 'I' || c->Type() == 'M')
-	  p += c->Length();
-      }
-      seq = gapped_seq;
-      
-      
-      if (aln > 0)
-	try {
-	  seq = seq.substr(aln, seq.length() - aln);
-	} catch (...) {
-	  std::cerr << "AlignedContig::operator<< error: substring out of bounds. seqlen " << 
-	    seq.length() << " start " << aln << " length " << (seq.length() - aln) << std::endl;
-	}
-      
-      if ( (pos + seq.length() ) > ac.getSequence().length()) 
-	try { 
-	  seq = seq.substr(0, ac.getSequence().length() - pos);
-	} catch (...) {
-	  std::cerr << "AlignedContig::operator<< (2) error: substring out of bounds. seqlen " << 
-	    seq.length() << " start " << 0 << " pos " << pos << " ac.getSequence().length() " << 
-	    ac.getSequence().length() << std::endl;
-
-	}
-      
-      //assert(kk != cnvec.size()); // assure that we found something
-      pos = abs(pos);
-      int padlen = ac.getSequence().size() - pos - seq.size() + 5;
-      padlen = std::max(5, padlen);
-      
-      std::stringstream rstream;
-      assert(pos < MAX_CONTIG_SIZE && padlen < MAX_CONTIG_SIZE); // bug, need to check
-      rstream << sr << "--" << (i.ChrID()+1) << ":" << i.Position() << " r2c CIGAR: " << this_r2c.cig;
-      
-      plot_vec.push_back({pos, seq, rstream.str()});
-    }
-    
-    std::sort(plot_vec.begin(), plot_vec.end());
-    
-    PlottedReadLineVector line_vec;
-    
-    // plot the reads from the ReadPlot vector
-    for (auto& i : plot_vec) {
-      bool found = false;
-      for (auto& j : line_vec) {
-	if (j.readFits(i)) { // it fits here
-	  j.addRead(&i);
-	  found = true;
-	  break;
-	}
-      }
-      if (!found) { // didn't fit anywhere, so make a new line
-	PlottedReadLine prl;
-	prl.contig_len = ac.getSequence().length();
-	prl.addRead(&i);
-	line_vec.push_back(prl);
-      }
-    }
-    
-    // plot the lines. Add contig identifier to each
-    for (auto& i : line_vec) 
-      out << i << " " << ac.getContigName() << std::endl;
-    
-    return out;
+    return p;
   }
   
   void AlignedContig::setMultiMapBreakPairs() {
@@ -350,8 +249,8 @@ void AlignedContig::blacklist(SeqLib::GRC &grv) {
     // if single mapped contig, nothing to do here  
     // initialize the breakpoint, fill with basic info
     BreakPoint bp;
-    for (auto& i : prefixes) 
-      bp.allele[i].indel = false;
+    for (auto& i : bp.allele) 
+      i.indel = false;
 
     bp.seq = getSequence();
     bp.aligned_covered = aligned_covered;
@@ -489,7 +388,7 @@ bool AlignedContig::checkLocal(const SeqLib::GenomicRegion& window)
   }
   
   
-void AlignedContig::checkAgainstCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap) {
+void AlignedContig::checkAgainstCigarMatches(const std::vector<PackedCigarMap>& cmap) {
 
     for (auto& i : m_frag_v)
       i.indelCigarMatches(cmap);
@@ -593,7 +492,7 @@ void AlignedContig::checkAgainstCigarMatches(const std::unordered_map<std::strin
 
     for (size_t i = 0; i < scounts.size() ; ++i) {
       for (auto& j : m_local_breaks[i].allele)
-	scounts[i] += j.second.split;
+	scounts[i] += j.split;
     }
 
     bool bad = false;
@@ -658,3 +557,30 @@ std::string AlignedContig::getSequence() const {
 void AlignedContig::AddAlignedRead(const svabaRead& br) {
   m_bamreads.push_back(br);
 }
+
+size_t AlignedContig::NumBytes() const {
+
+  size_t n = sizeof(AlignedContig) + m_seq.capacity() + aligned_coverage.capacity() * sizeof(int);
+  n += svabaMemory::bytes(m_bamreads);
+
+  for (const auto& f : m_frag_v) {
+    n += sizeof(AlignmentFragment) + svabaMemory::bytes(f.m_align);
+    for (const auto& b : f.m_indel_breaks)
+      n += svabaMemory::bytes(b);
+    for (const auto& s : f.secondaries)
+      n += sizeof(AlignmentFragment) + svabaMemory::bytes(s.m_align);
+  }
+  
+  for (const auto& b : m_local_breaks)
+    n += svabaMemory::bytes(b);
+  for (const auto& b : m_local_breaks_secondaries)
+    n += svabaMemory::bytes(b);
+  for (const auto& b : m_global_bp_secondaries)
+    n += svabaMemory::bytes(b);
+  n += svabaMemory::bytes(m_global_bp);
+  
+  for (const auto& d : m_dc)
+    n += svabaMemory::bytes(d);
+
+  return n;
+}
@@ -10,6 +10,7 @@
 #include "BreakPoint.h"
 #include "DiscordantCluster.h"
 #include "AlignmentFragment.h"
+#include "AlignmentPlot.h"
 #include "svabaRead.h"
 
 /*! Contains the mapping of an aligned contig to the reference genome,
@@ -26,13 +27,14 @@ class AlignedContig {
   AlignedContig() {}
   
   // make an AlignedContig from a set of contig alignments
-  AlignedContig(const SeqLib::BamRecordVector& bav, const std::set<std::string>& pref);
+  AlignedContig(const SeqLib::BamRecordVector& bav);
   
   // Return as a genomic region vector
   SeqLib::GenomicRegionVector getAsGenomicRegionVector() const;
 
   // Loop through all the alignment framgents and their indel breaks and check against cigar database
-  void checkAgainstCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap); 
+  // (cmap is by sample number)
+  void checkAgainstCigarMatches(const std::vector<PackedCigarMap>& cmap); 
 
   // apply repeat filter to each indel break
   void assessRepeats();
@@ -73,6 +75,9 @@ class AlignedContig {
   
   //! print this contig
   friend std::ostream& operator<<(std::ostream &out, const AlignedContig &ac);
+
+  //! pack what the alignment plot of this contig draws
+  AlignmentPlot plotRecord() const;
   
   // Return if this contig contains a potential variant (indel or multi-map)
   bool hasVariant() const;
@@ -109,6 +114,9 @@ class AlignedContig {
   // return number of bam reads
   size_t NumBamReads() const { return m_bamreads.size(); }
 
+  /** Estimate of the heap bytes held by this contig, its alignments, breaks and reads */
+  size_t NumBytes() const;
+
  private:
 
   int insertion_against_contig_read_count = 0;
@@ -122,8 +130,6 @@ class AlignedContig {
 
   int aligned_covered = 0; // number of bases that are covered by an alignment
 
-  std::set<std::string> prefixes; // store the sample ids. Needed to create accurate BreakPoint genotypes
-
   AlignmentFragmentVector m_frag_v; // store all of the individual alignment fragments 
 
   std::vector<BreakPoint> m_local_breaks; // store all of the multi-map BreakPoints for this contigs 
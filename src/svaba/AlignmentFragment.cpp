@@ -97,60 +97,62 @@ void AlignmentFragment::SetIndels(const AlignedContig * c) {
     while (parseIndelBreak(bp) && fail_safe_count++ < MAX_INDELS && !m_align.SecondaryFlag()) {
       bp.aligned_covered = c->aligned_covered;
       assert(bp.aligned_covered);
-      for (auto& i : c->prefixes)
-	bp.allele[i].indel = true;
+      for (auto& i : bp.allele)
+	i.indel = true;
       m_indel_breaks.push_back(bp);
       assert(bp.num_align == 1);
     }
 }
 
   std::ostream& operator<<(std::ostream &out, const AlignmentFragment &c) {
-    
-    // sets the direction to print
-    char jsign = '>'; 
-    if (c.m_align.ReverseFlag())
-      jsign = '<';
-    
-    // print the cigar value per base
-    for (auto& j : /*c.m_align.GetCigar()*/ c.m_cigar) { //c.align.CigarData) { // print releative to forward strand
-      if (j.Type() == 'M')
-	out << std::string(j.Length(), jsign);
-      else if (j.Type() == 'I') 
-	out << std::string(j.Length(), 'I');
-      else if (j.Type() == 'S' || j.Type() == 'H')
-	out << std::string(j.Length(), '.');
-    }
-    
-    // print contig and genome breaks
-    out << "\tC[" << c.break1 << "," << c.break2 << "] G[" << c.gbreak1 << "," << c.gbreak2 << "]";
-    
-    // add local info
-    std::string chr_name;
-    c.m_align.GetZTag("MC", chr_name);
-    if (!chr_name.length())
-      chr_name = std::to_string(c.m_align.ChrID()+1);
-    out << "\tLocal: " << c.local << "\tAligned to: " << chr_name << ":" << c.m_align.Position() << "(" << (c.m_align.ReverseFlag() ? "-" : "+") << ") CIG: " << c.m_align.CigarString() << " MAPQ: " << c.m_align.MapQuality() << " SUBN " << c.sub_n;
-  
+    out << c.plotRecord(false);
     return out;
   }
 
+  PlotFragment AlignmentFragment::plotRecord(bool secondary) const {
+
+    PlotFragment f;
+    f.chr = m_align.ChrID();
+    f.pos = m_align.Position();
+    f.mapq = m_align.MapQuality();
+    f.sub_n = sub_n;
+    f.break1 = break1;
+    f.break2 = break2;
+    f.gbreak1 = gbreak1;
+    f.gbreak2 = gbreak2;
+    f.rev = m_align.ReverseFlag();
+    f.local = local;
+    f.secondary = secondary;
+    m_align.GetZTag("MC", f.chr_name);
+
+    // the cigar relative to the contig (forward strand) draws the fragment
+    f.cigar.reserve(m_cigar.size());
+    for (const auto& j : m_cigar)
+      f.cigar.push_back(j.Raw());
+    for (const auto& j : m_align.GetCigar())
+      f.aln_cigar.push_back(j.Raw());
+
+    return f;
+  }
+
 
-void AlignmentFragment::indelCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap) {
+void AlignmentFragment::indelCigarMatches(const std::vector<PackedCigarMap>& cmap) {
 
     // loop through the indel breakpoints
     for (auto& i : m_indel_breaks) {
       
       assert(i.getSpan() > 0);
 
-      // get the hash string in same formate as cigar map (eg. pos_3D)
-      std::string st = i.getHashString();
+      // get the key in the same packing as the cigar map
+      uint64_t key = i.getIndelKey();
+      if (!key)
+	continue;
 
-      for (auto& c : cmap) {
-	SeqLib::CigarMap::const_iterator ff = c.second.find(st);
+      for (size_t c = 0; c < cmap.size() && c < i.allele.size(); ++c) {
+	int n = cmap[c].Count(key);
 	// if it is, add it
-	if (ff != c.second.end()) {
-	  i.allele[c.first].cigar = ff->second;	  
-	}
+	if (n)
+	  i.allele[c].cigar = n;
       }
     }      
     
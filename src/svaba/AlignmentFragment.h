@@ -8,6 +8,8 @@
 #include <string>
 #include <set>
 #include "BreakPoint.h"
+#include "PackedCigarMap.h"
+#include "AlignmentPlot.h"
 #include "svaba_params.h"
 
 #define MAX_CONTIG_SIZE 5000000
@@ -34,11 +36,15 @@ class AlignedContig;
     // sort AlignmentFragment objects by start position
     bool operator < (const AlignmentFragment& str) const { return (start < str.start); }
 
-    void indelCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap);
+    // (cmap is by sample number)
+    void indelCigarMatches(const std::vector<PackedCigarMap>& cmap);
     
     // print the AlignmentFragment
     friend std::ostream& operator<<(std::ostream &out, const AlignmentFragment& c); 
 
+    // pack what the alignment plot draws of this fragment
+    PlotFragment plotRecord(bool secondary) const;
+
     BreakEnd makeBreakEnd(bool left);
     
     /*! @function
@@ -0,0 +1,533 @@
+#include "AlignmentPlot.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <sstream>
+
+#include "htslib/hts.h"
+#include "htslib/sam.h"
+
+#include "SeqLib/SeqLibUtils.h"
+
+#include "BgzfOutput.h"
+#include "PlottedRead.h"
+#include "svaba_params.h"
+
+// records are written in the byte order of the machine, like the other
+// binary svaba files (BWA image, DBSnp and PON indices)
+template <typename T>
+static void put(std::string& s, T v) {
+  s.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+static void put_string(std::string& s, const std::string& v) {
+  put<uint32_t>(s, v.length());
+  s += v;
+}
+
+static void put_cigar(std::string& s, const std::vector<uint32_t>& c) {
+  put<uint32_t>(s, c.size());
+  s.append(reinterpret_cast<const char*>(c.data()), c.size() * sizeof(uint32_t));
+}
+
+// sequences are packed two bases to a byte, as in BAM
+static void put_seq(std::string& s, const std::string& seq) {
+  put<uint32_t>(s, seq.length());
+  for (size_t i = 0; i < seq.length(); i += 2) {
+    uint8_t b = seq_nt16_table[(uint8_t)seq[i]] << 4;
+    if (i + 1 < seq.length())
+      b |= seq_nt16_table[(uint8_t)seq[i+1]];
+    s.push_back((char)b);
+  }
+}
+
+// reads the fields of a record back, failing (once) if it runs out
+class RecordCursor {
+
+ public:
+
+  RecordCursor(const std::string& s) : m_p(s.data()), m_end(s.data() + s.length()) {}
+
+  bool ok() const { return m_ok; }
+
+  template <typename T>
+  T get() {
+    T v = T();
+    if (!take(sizeof(T)))
+      return v;
+    memcpy(&v, m_p - sizeof(T), sizeof(T));
+    return v;
+  }
+
+  std::string get_string() {
+    uint32_t n = get<uint32_t>();
+    if (!take(n))
+      return std::string();
+    return std::string(m_p - n, n);
+  }
+
+  std::vector<uint32_t> get_cigar() {
+    uint32_t n = get<uint32_t>();
+    std::vector<uint32_t> c;
+    if (!take((size_t)n * sizeof(uint32_t)))
+      return c;
+    c.resize(n);
+    memcpy(c.data(), m_p - n * sizeof(uint32_t), n * sizeof(uint32_t));
+    return c;
+  }
+
+  std::string get_seq() {
+    uint32_t n = get<uint32_t>();
+    size_t bytes = ((size_t)n + 1) / 2;
+    if (!take(bytes))
+      return std::string();
+    const uint8_t * b = reinterpret_cast<const uint8_t*>(m_p - bytes);
+    std::string seq(n, 'N');
+    for (size_t i = 0; i < n; ++i)
+      seq[i] = seq_nt16_str[(i % 2) ? (b[i/2] & 0xf) : (b[i/2] >> 4)];
+    return seq;
+  }
+
+ private:
+
+  const char * m_p;
+  const char * m_end;
+  bool m_ok = true;
+
+  bool take(size_t n) {
+    if (!m_ok || (size_t)(m_end - m_p) < n) {
+      m_ok = false;
+      return false;
+    }
+    m_p += n;
+    return true;
+  }
+
+};
+
+static std::string cigar_string(const std::vector<uint32_t>& c) {
+  std::string s;
+  for (auto i : c)
+    s += std::to_string(bam_cigar_oplen(i)) + bam_cigar_opchr(i);
+  return s;
+}
+
+std::ostream& operator<<(std::ostream& out, const PlotFragment& f) {
+
+  // sets the direction to print
+  char jsign = f.rev ? '<' : '>';
+
+  // print the cigar value per base, relative to the contig
+  for (auto j : f.cigar) {
+    int op = bam_cigar_op(j);
+    if (op == BAM_CMATCH)
+      out << std::string(bam_cigar_oplen(j), jsign);
+    else if (op == BAM_CINS)
+      out << std::string(bam_cigar_oplen(j), 'I');
+    else if (op == BAM_CSOFT_CLIP || op == BAM_CHARD_CLIP)
+      out << std::string(bam_cigar_oplen(j), '.');
+  }
+
+  // print contig and genome breaks
+  out << "\tC[" << f.break1 << "," << f.break2 << "] G[" << f.gbreak1 << "," << f.gbreak2 << "]";
+
+  // add local info
+  std::string chr_name = f.chr_name;
+  if (!chr_name.length())
+    chr_name = std::to_string(f.chr+1);
+  out << "\tLocal: " << f.local << "\tAligned to: " << chr_name << ":" << f.pos << "(" << (f.rev ? "-" : "+")
+      << ") CIG: " << cigar_string(f.aln_cigar) << " MAPQ: " << f.mapq << " SUBN " << f.sub_n;
+
+  return out;
+}
+
+void AlignmentPlot::Serialize(std::string& out) const {
+
+  put_string(out, name);
+  put_seq(out, seq);
+  put_string(out, breaks);
+  put_string(out, disc);
+
+  put<uint32_t>(out, deletions.size());
+  for (const auto& d : deletions) {
+    put<int32_t>(out, d.first);
+    put<int32_t>(out, d.second);
+  }
+
+  put<uint32_t>(out, frags.size());
+  for (const auto& f : frags) {
+    put<int32_t>(out, f.chr);
+    put<int32_t>(out, f.pos);
+    put<int32_t>(out, f.mapq);
+    put<int32_t>(out, f.sub_n);
+    put<int32_t>(out, f.break1);
+    put<int32_t>(out, f.break2);
+    put<int32_t>(out, f.gbreak1);
+    put<int32_t>(out, f.gbreak2);
+    put<uint8_t>(out, f.rev | (f.local << 1) | (f.secondary << 2));
+    put_string(out, f.chr_name);
+    put_cigar(out, f.cigar);
+    put_cigar(out, f.aln_cigar);
+  }
+
+  put<uint32_t>(out, reads.size());
+  for (const auto& r : reads) {
+    put<int32_t>(out, r.chr);
+    put<int32_t>(out, r.pos);
+    put<int32_t>(out, r.start_on_contig);
+    put<int32_t>(out, r.start_on_read);
+    put<uint8_t>(out, r.rc);
+    put_string(out, r.sr);
+    put_seq(out, r.seq);
+    put_cigar(out, r.cigar);
+  }
+}
+
+bool AlignmentPlot::Deserialize(const std::string& in) {
+
+  RecordCursor c(in);
+
+  name = c.get_string();
+  seq = c.get_seq();
+  breaks = c.get_string();
+  disc = c.get_string();
+
+  deletions.clear();
+  uint32_t n = c.get<uint32_t>();
+  for (uint32_t i = 0; i < n && c.ok(); ++i) {
+    int32_t d1 = c.get<int32_t>();
+    int32_t d2 = c.get<int32_t>();
+    deletions.push_back({d1, d2});
+  }
+
+  frags.clear();
+  n = c.get<uint32_t>();
+  for (uint32_t i = 0; i < n && c.ok(); ++i) {
+    PlotFragment f;
+    f.chr = c.get<int32_t>();
+    f.pos = c.get<int32_t>();
+    f.mapq = c.get<int32_t>();
+    f.sub_n = c.get<int32_t>();
+    f.break1 = c.get<int32_t>();
+    f.break2 = c.get<int32_t>();
+    f.gbreak1 = c.get<int32_t>();
+    f.gbreak2 = c.get<int32_t>();
+    uint8_t flags = c.get<uint8_t>();
+    f.rev = flags & 1;
+    f.local = flags & 2;
+    f.secondary = flags & 4;
+    f.chr_name = c.get_string();
+    f.cigar = c.get_cigar();
+    f.aln_cigar = c.get_cigar();
+    frags.push_back(f);
+  }
+
+  reads.clear();
+  n = c.get<uint32_t>();
+  for (uint32_t i = 0; i < n && c.ok(); ++i) {
+    PlotRead r;
+    r.chr = c.get<int32_t>();
+    r.pos = c.get<int32_t>();
+    r.start_on_contig = c.get<int32_t>();
+    r.start_on_read = c.get<int32_t>();
+    r.rc = c.get<uint8_t>();
+    r.sr = c.get_string();
+    r.seq = c.get_seq();
+    r.cigar = c.get_cigar();
+    reads.push_back(r);
+  }
+
+  return c.ok();
+}
+
+std::ostream& operator<<(std::ostream& out, const AlignmentPlot& ap) {
+
+  // print the breakpoints
+  out << ap.breaks;
+
+  // print the fragment alignments, primary then secondary
+  bool draw_divider = true;
+  for (const auto& f : ap.frags) {
+    if (f.secondary && draw_divider) {
+      out << std::string(ap.seq.length(), 'S') << std::endl;
+      draw_divider = false;
+    }
+    out << f << " Disc: " << ap.disc << " -- " << ap.name << std::endl;
+  }
+
+  // print the break locations for indel deletions
+  for (const auto& d : ap.deletions)
+    out << std::string(d.first, ' ') << "|" << std::string(d.second-d.first-1, ' ') << '|' << "   " << ap.name << std::endl;
+
+  out << ap.seq << "    " << ap.name << std::endl;
+  PlottedReadVector plot_vec;
+
+  // print out the individual reads
+  for (const auto& i : ap.reads) {
+
+    std::string seq = i.seq;
+
+    int pos = i.start_on_contig;
+    int aln = i.start_on_read;
+
+    if (i.rc)
+      SeqLib::rcomplement(seq);
+
+    // edit the string to reflect gapped alignments
+    size_t p = 0; // move along on sequence, starting at first non-clipped base
+    std::string gapped_seq;
+    for (auto c : i.cigar) {
+      int op = bam_cigar_op(c);
+      size_t len = bam_cigar_oplen(c);
+      if (op == BAM_CMATCH) {
+	assert(p + len <= seq.length());
+	gapped_seq += seq.substr(p, len);
+      } else if (op == BAM_CDEL) {
+	gapped_seq += std::string(len, '-');
+      }
+
+      if (op == BAM_CINS || op == BAM_CMATCH)
+	p += len;
+    }
+    seq = gapped_seq;
+
+    if (aln > 0)
+      try {
+	seq = seq.substr(aln, seq.length() - aln);
+      } catch (...) {
+	std::cerr << "AlignmentPlot::operator<< error: substring out of bounds. seqlen " <<
+	  seq.length() << " start " << aln << " length " << (seq.length() - aln) << std::endl;
+      }
+
+    if ( (pos + seq.length() ) > ap.seq.length())
+      try {
+	seq = seq.substr(0, ap.seq.length() - pos);
+      } catch (...) {
+	std::cerr << "AlignmentPlot::operator<< (2) error: substring out of bounds. seqlen " <<
+	  seq.length() << " start " << 0 << " pos " << pos << " contig length " <<
+	  ap.seq.length() << std::endl;
+      }
+
+    pos = abs(pos);
+    int padlen = ap.seq.size() - pos - seq.size() + 5;
+    padlen = std::max(5, padlen);
+
+    std::stringstream rstream;
+    assert(pos < MAX_CONTIG_SIZE && padlen < MAX_CONTIG_SIZE); // bug, need to check
+    rstream << i.sr << "--" << (i.chr+1) << ":" << i.pos << " r2c CIGAR: " << cigar_string(i.cigar);
+
+    plot_vec.push_back({pos, seq, rstream.str()});
+  }
+
+  std::sort(plot_vec.begin(), plot_vec.end());
+
+  PlottedReadLineVector line_vec;
+
+  // plot the reads from the ReadPlot vector
+  for (auto& i : plot_vec) {
+    bool found = false;
+    for (auto& j : line_vec) {
+      if (j.readFits(i)) { // it fits here
+	j.addRead(&i);
+	found = true;
+	break;
+      }
+    }
+    if (!found) { // didn't fit anywhere, so make a new line
+      PlottedReadLine prl;
+      prl.contig_len = ap.seq.length();
+      prl.addRead(&i);
+      line_vec.push_back(prl);
+    }
+  }
+
+  // plot the lines. Add contig identifier to each
+  for (auto& i : line_vec)
+    out << i << " " << ap.name << std::endl;
+
+  return out;
+}
+
+bool AlignmentPlotWriter::Open(const std::string& fn, OutputPool * pool) {
+
+  m_fn = fn;
+  m_fp = bgzf_open(fn.c_str(), "w");
+  if (!m_fp) {
+    std::cerr << "ERROR: Cannot open " << fn << " for writing" << std::endl;
+    return false;
+  }
+  if (bgzf_index_build_init(m_fp) < 0)
+    std::cerr << "WARNING: Cannot index " << fn << ". Plots can only be viewed in file order" << std::endl;
+  if (pool)
+    pool->Attach(m_fp);
+  return true;
+}
+
+void AlignmentPlotWriter::Write(const AlignmentPlot& p) {
+  std::string rec;
+  p.Serialize(rec);
+  WriteRaw(p.name, rec);
+}
+
+void AlignmentPlotWriter::WriteRaw(const std::string& name, const std::string& rec) {
+
+  if (!m_fp)
+    return;
+
+  uint32_t len = rec.length();
+  if (bgzf_write(m_fp, &len, sizeof(len)) < 0 || bgzf_write(m_fp, rec.data(), len) < 0) {
+    std::cerr << "ERROR: Could not write to " << m_fn << std::endl;
+    return;
+  }
+  m_index += name + "\t" + std::to_string(m_offset) + "\n";
+  m_offset += sizeof(len) + len;
+}
+
+void AlignmentPlotWriter::Close() {
+
+  if (!m_fp)
+    return;
+
+  if (bgzf_index_dump(m_fp, m_fn.c_str(), ".gzi") < 0)
+    std::cerr << "WARNING: Could not write the index " << m_fn << ".gzi" << std::endl;
+  bgzf_close(m_fp);
+  m_fp = nullptr;
+
+  std::ofstream idx(m_fn + ".idx");
+  idx << m_index;
+  if (!idx)
+    std::cerr << "WARNING: Could not write the index " << m_fn << ".idx" << std::endl;
+  std::string().swap(m_index);
+}
+
+AlignmentPlotReader::~AlignmentPlotReader() {
+  if (m_fp)
+    bgzf_close(m_fp);
+}
+
+bool AlignmentPlotReader::Open(const std::string& fn) {
+
+  m_fn = fn;
+  m_fp = bgzf_open(fn.c_str(), "r");
+  if (!m_fp) {
+    std::cerr << "ERROR: Cannot open " << fn << std::endl;
+    return false;
+  }
+
+  std::ifstream idx(fn + ".idx");
+  if (!idx || bgzf_index_load(m_fp, fn.c_str(), ".gzi") < 0)
+    return true;
+
+  std::string line;
+  while (std::getline(idx, line, '\n')) {
+    size_t t = line.find('\t');
+    if (t != std::string::npos)
+      m_index[line.substr(0, t)] = std::stoull(line.substr(t + 1));
+  }
+  m_indexed = true;
+  return true;
+}
+
+bool AlignmentPlotReader::Find(const std::string& name, AlignmentPlot& p) {
+
+  if (!m_indexed)
+    return false;
+
+  auto ff = m_index.find(name);
+  if (ff == m_index.end())
+    return false;
+
+  if (bgzf_useek(m_fp, ff->second, SEEK_SET) < 0) {
+    std::cerr << "ERROR: Cannot seek in " << m_fn << std::endl;
+    return false;
+  }
+
+  std::string n, rec;
+  if (!NextRaw(n, rec) || n != name)
+    return false;
+  return p.Deserialize(rec);
+}
+
+bool AlignmentPlotReader::NextRaw(std::string& name, std::string& rec) {
+
+  uint32_t len;
+  if (bgzf_read(m_fp, &len, sizeof(len)) != (ssize_t)sizeof(len))
+    return false;
+  rec.resize(len);
+  if (bgzf_read(m_fp, &rec[0], len) != (ssize_t)len) {
+    std::cerr << "ERROR: Truncated record in " << m_fn << std::endl;
+    return false;
+  }
+
+  // the record starts with the contig name
+  RecordCursor c(rec);
+  name = c.get_string();
+  return c.ok();
+}
+
+static const char* shortopts = "ha:f:";
+static const struct option longopts[] = {
+  { "help",                    no_argument, NULL, 'h' },
+  { "id-string",               required_argument, NULL, 'a'},
+  { "file",                    required_argument, NULL, 'f'},
+  { NULL, 0, NULL, 0 }
+};
+
+static const char *VIEW_USAGE_MESSAGE =
+  "Usage: svaba view-alignments [-a <id>] <contig-name> [<contig-name> ...]\n\n"
+  "  Description: Draw the ASCII plots of contigs and their reads, from the <id>.alignments.bin of svaba run.\n"
+  "               Contig names are in the SCTG field of the VCF. With no names, draws every plot in the file.\n"
+  "\n"
+  "  -h, --help                           Display this help and exit\n"
+  "  -a, --id-string                      Analysis ID given to svaba run. [no_id]\n"
+  "  -f, --file                           Plot file to read, instead of <id>.alignments.bin\n"
+  "\n";
+
+void runViewAlignments(int argc, char** argv) {
+
+  std::string id = "no_id", fn;
+  bool die = false;
+
+  for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    switch (c) {
+    case 'a': arg >> id; break;
+    case 'f': arg >> fn; break;
+    default: die = true;
+    }
+  }
+
+  if (die) {
+    std::cerr << "\n" << VIEW_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+
+  if (fn.empty())
+    fn = id + ".alignments.bin";
+
+  AlignmentPlotReader reader;
+  if (!reader.Open(fn))
+    exit(EXIT_FAILURE);
+
+  AlignmentPlot p;
+
+  // no names, so draw the whole file
+  if (optind >= argc) {
+    std::string name, rec;
+    while (reader.NextRaw(name, rec))
+      if (p.Deserialize(rec))
+	std::cout << p;
+    return;
+  }
+
+  for (int i = optind; i < argc; ++i) {
+    if (reader.Find(argv[i], p))
+      std::cout << p;
+    else
+      std::cerr << "WARNING: No alignment plot for contig " << argv[i] << " in " << fn << std::endl;
+  }
+}
@@ -0,0 +1,154 @@
+#ifndef SVABA_ALIGNMENT_PLOT_H__
+#define SVABA_ALIGNMENT_PLOT_H__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "htslib/bgzf.h"
+
+class OutputPool;
+
+/** One alignment of a contig to the reference, as drawn in its plot */
+struct PlotFragment {
+
+  int32_t chr = -1;
+  int32_t pos = 0;
+  int32_t mapq = 0;
+  int32_t sub_n = 0;
+
+  int32_t break1 = -1; // breaks on the contig
+  int32_t break2 = -1;
+  int32_t gbreak1 = -1; // breaks on the reference
+  int32_t gbreak2 = -1;
+
+  bool rev = false;
+  bool local = false;
+  bool secondary = false;
+
+  std::string chr_name; // from the MC tag, if set
+
+  std::vector<uint32_t> cigar; // BAM packed, oriented to the contig
+  std::vector<uint32_t> aln_cigar; // BAM packed, as aligned
+
+  // print the fragment line of the plot
+  friend std::ostream& operator<<(std::ostream& out, const PlotFragment& f);
+
+};
+
+/** One read aligned to a contig */
+struct PlotRead {
+
+  int32_t chr = -1;
+  int32_t pos = 0;
+  int32_t start_on_contig = 0;
+  int32_t start_on_read = 0;
+  bool rc = false;
+
+  std::string sr; // the read's SR tag
+  std::string seq;
+
+  std::vector<uint32_t> cigar; // BAM packed, read to contig
+
+};
+
+/** Everything the ASCII alignment plot of a contig draws, without drawing it.
+ *
+ * Plots are rendered on demand (svaba view-alignments), so a run only pays
+ * to pack the contig, its fragments and its reads into a binary record.
+ * The breakpoint lines are few, so they are kept as text.
+ */
+struct AlignmentPlot {
+
+  std::string name;
+  std::string seq;
+  std::string breaks; // breakpoint lines
+  std::string disc; // discordant clusters of the contig
+
+  std::vector<std::pair<int32_t, int32_t> > deletions; // contig positions of deletions
+  std::vector<PlotFragment> frags; // primary alignments, then secondaries
+  std::vector<PlotRead> reads;
+
+  /** Append the binary record to a string */
+  void Serialize(std::string& out) const;
+
+  /** Read a binary record. False if it is truncated */
+  bool Deserialize(const std::string& in);
+
+  // draw the plot
+  friend std::ostream& operator<<(std::ostream& out, const AlignmentPlot& p);
+
+};
+
+/** Writes alignment plot records to a BGZF file.
+ *
+ * Each record is a 32-bit length and the serialized AlignmentPlot. On
+ * Close, a .gzi (for seeking to uncompressed offsets) and a .idx (contig
+ * name to offset of its record, as text) are written next to the file.
+ */
+class AlignmentPlotWriter {
+
+ public:
+
+  AlignmentPlotWriter() {}
+
+  ~AlignmentPlotWriter() { Close(); }
+
+  /** Open the file for writing, compressing on the pool (if not null) */
+  bool Open(const std::string& fn, OutputPool * pool);
+
+  bool IsOpen() const { return m_fp != nullptr; }
+
+  void Write(const AlignmentPlot& p);
+
+  /** Write a record already serialized, such as one read from a shard */
+  void WriteRaw(const std::string& name, const std::string& rec);
+
+  /** Close the file and write its indices */
+  void Close();
+
+ private:
+
+  std::string m_fn;
+  BGZF * m_fp = nullptr;
+
+  uint64_t m_offset = 0; // uncompressed
+  std::string m_index;
+
+};
+
+/** Reads alignment plot records, by contig name or in file order */
+class AlignmentPlotReader {
+
+ public:
+
+  AlignmentPlotReader() {}
+
+  ~AlignmentPlotReader();
+
+  /** Open the file and load its indices, if present */
+  bool Open(const std::string& fn);
+
+  /** Get the plot of a contig. False if it is not in the file, or the file is not indexed */
+  bool Find(const std::string& name, AlignmentPlot& p);
+
+  /** Get the next record, serialized, and its contig name */
+  bool NextRaw(std::string& name, std::string& rec);
+
+ private:
+
+  std::string m_fn;
+  BGZF * m_fp = nullptr;
+
+  bool m_indexed = false;
+  std::unordered_map<std::string, uint64_t> m_index;
+
+};
+
+/** svaba view-alignments: draw the plots of contigs from a run's .alignments.bin */
+void runViewAlignments(int argc, char** argv);
+
+#endif
@@ -0,0 +1,71 @@
+#include "BadRegionSet.h"
+
+#include <algorithm>
+
+BadRegionSet::BadRegionSet() {
+  pthread_rwlock_init(&m_lock, NULL);
+}
+
+BadRegionSet::~BadRegionSet() {
+  pthread_rwlock_destroy(&m_lock);
+}
+
+void BadRegionSet::Add(const SeqLib::GRC& bad) {
+
+  if (!bad.size())
+    return;
+
+  pthread_rwlock_wrlock(&m_lock);
+  for (const auto& g : bad)
+    add(g.chr, g.pos1, g.pos2);
+  pthread_rwlock_unlock(&m_lock);
+
+}
+
+void BadRegionSet::add(int32_t chr, int32_t pos1, int32_t pos2) {
+
+  if (chr < 0)
+    return;
+  if ((int)m_ivals.size() <= chr)
+    m_ivals.resize(chr + 1);
+  std::vector<Interval>& iv = m_ivals[chr];
+
+  // first interval that ends at or after pos1, and first that starts past pos2.
+  // Everything in between overlaps the new one, and is coalesced into it
+  auto lo = std::lower_bound(iv.begin(), iv.end(), pos1, [](const Interval& i, int32_t p) { return i.pos2 < p; });
+  auto hi = std::upper_bound(lo, iv.end(), pos2, [](int32_t p, const Interval& i) { return p < i.pos1; });
+
+  if (lo == hi) {
+    iv.insert(lo, {pos1, pos2});
+    ++m_size;
+    return;
+  }
+
+  lo->pos1 = std::min(lo->pos1, pos1);
+  lo->pos2 = std::max((hi - 1)->pos2, pos2);
+  m_size -= (hi - lo) - 1;
+  iv.erase(lo + 1, hi);
+}
+
+bool BadRegionSet::Overlaps(const SeqLib::GenomicRegion& g) const {
+
+  pthread_rwlock_rdlock(&m_lock);
+
+  bool ov = false;
+  if (g.chr >= 0 && g.chr < (int)m_ivals.size()) {
+    const std::vector<Interval>& iv = m_ivals[g.chr];
+    auto it = std::lower_bound(iv.begin(), iv.end(), g.pos1, [](const Interval& i, int32_t p) { return i.pos2 < p; });
+    ov = it != iv.end() && it->pos1 <= g.pos2;
+  }
+
+  pthread_rwlock_unlock(&m_lock);
+
+  return ov;
+}
+
+size_t BadRegionSet::size() const {
+  pthread_rwlock_rdlock(&m_lock);
+  size_t s = m_size;
+  pthread_rwlock_unlock(&m_lock);
+  return s;
+}
@@ -0,0 +1,50 @@
+#ifndef SVABA_BAD_REGION_SET_H__
+#define SVABA_BAD_REGION_SET_H__
+
+#include <pthread.h>
+#include <vector>
+
+#include "SeqLib/GenomicRegionCollection.h"
+
+/** Thread-shared set of bad mate regions (ones that hit the read limit).
+ *
+ * Regions are held per chromosome as a sorted vector of disjoint
+ * intervals. Adding a region coalesces it with the intervals it touches,
+ * and overlap checks are a binary search, so neither one rebuilds
+ * anything as the set grows over a run. Checks take a shared lock, so a
+ * region flagged on one thread is skipped by all of them from then on.
+ */
+class BadRegionSet {
+
+ public:
+
+  BadRegionSet();
+
+  ~BadRegionSet();
+
+  /** Add regions to the set */
+  void Add(const SeqLib::GRC& bad);
+
+  /** Does the region overlap a bad region? */
+  bool Overlaps(const SeqLib::GenomicRegion& g) const;
+
+  /** Number of disjoint intervals held */
+  size_t size() const;
+
+ private:
+
+  struct Interval {
+    int32_t pos1;
+    int32_t pos2;
+  };
+
+  std::vector<std::vector<Interval> > m_ivals; // by chr, sorted and disjoint
+  size_t m_size = 0;
+
+  mutable pthread_rwlock_t m_lock;
+
+  void add(int32_t chr, int32_t pos1, int32_t pos2);
+
+};
+
+#endif
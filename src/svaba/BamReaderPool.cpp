@@ -0,0 +1,103 @@
+#include "BamReaderPool.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "SeqLib/SeqLibUtils.h"
+
+BamReaderPool::BamReaderPool() {
+  pthread_mutex_init(&m_mutex, NULL);
+}
+
+BamReaderPool::~BamReaderPool() {
+  pthread_mutex_destroy(&m_mutex);
+}
+
+void BamReaderPool::Add(const std::string& prefix, const std::string& path) {
+  if (path != "-")
+    m_paths[prefix] = path;
+}
+
+bool BamReaderPool::Acquire(svabaBamWalker& w) {
+
+  auto ff = m_paths.find(w.prefix);
+  if (ff == m_paths.end())
+    return false;
+
+  pthread_mutex_lock(&m_mutex);
+  std::list<Reader>& idle = m_idle[w.prefix];
+  if (!idle.empty()) {
+    w.SetReader(idle.front().r);
+    w.is_cram = idle.front().is_cram;
+    idle.pop_front();
+    --m_num_idle;
+    ++m_reuses;
+    pthread_mutex_unlock(&m_mutex);
+    return true;
+  }
+  pthread_mutex_unlock(&m_mutex);
+
+  // open outside of the lock, since it reads the header and index
+  if (m_cram && m_cram->Enabled())
+    w.SetCramReference(m_cram->Fasta());
+  if (!w.Open(ff->second)) {
+    std::cerr << "ERROR: Cannot open " << ff->second << std::endl;
+    return false;
+  }
+  w.UseCramReference(m_cram);
+
+  pthread_mutex_lock(&m_mutex);
+  ++m_opens;
+  m_peak_open = std::max(m_peak_open, ++m_num_open);
+  pthread_mutex_unlock(&m_mutex);
+
+  return true;
+}
+
+void BamReaderPool::Release(svabaBamWalker& w) {
+
+  if (!m_paths.count(w.prefix) || !w.IsOpen())
+    return;
+
+  // idle readers point at the regions of their last walker, until
+  // SetReader points them at the next one's
+  Reader rd;
+  rd.is_cram = w.is_cram;
+  rd.r = w.TakeReader();
+
+  // readers to close, once out of the lock
+  std::vector<Reader> closing;
+
+  pthread_mutex_lock(&m_mutex);
+  rd.last_used = ++m_tick;
+  m_idle[w.prefix].push_front(rd);
+  ++m_num_idle;
+
+  // over the cap, close the least recently used idle reader of any BAM
+  while (m_max_idle && m_num_idle > m_max_idle) {
+    std::list<Reader> * oldest = nullptr;
+    for (auto& i : m_idle)
+      if (!i.second.empty() && (!oldest || i.second.back().last_used < oldest->back().last_used))
+	oldest = &i.second;
+    closing.push_back(oldest->back());
+    oldest->pop_back();
+    --m_num_idle;
+    --m_num_open;
+  }
+  pthread_mutex_unlock(&m_mutex);
+
+}
+
+std::string BamReaderPool::Stats() const {
+
+  pthread_mutex_lock(&m_mutex);
+
+  std::stringstream ss;
+  ss << "...BAM readers for " << m_paths.size() << " inputs: " << SeqLib::AddCommas(m_opens) << " opened, "
+     << SeqLib::AddCommas(m_reuses) << " reused, peak of " << SeqLib::AddCommas(m_peak_open) << " open at once";
+
+  pthread_mutex_unlock(&m_mutex);
+
+  return ss.str();
+}
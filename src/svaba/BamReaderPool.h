@@ -0,0 +1,74 @@
+#ifndef SVABA_BAM_READER_POOL_H__
+#define SVABA_BAM_READER_POOL_H__
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "svabaBamWalker.h"
+#include "CramReference.h"
+
+/** Open readers of the input BAMs, shared by all threads.
+ *
+ * A walker for every BAM on every thread, each holding its file open,
+ * means threads x samples open files, indexes and decompression buffers,
+ * which stops scaling in joint runs of many samples. Walkers instead
+ * borrow an open reader of their BAM for as long as they read from it,
+ * and hand it back after. Idle readers are kept for the next walker,
+ * up to a cap over all of the BAMs (least recently used closed first).
+ */
+class BamReaderPool {
+
+ public:
+
+  BamReaderPool();
+
+  ~BamReaderPool();
+
+  /** Add an input. stdin is read by the stream, so it is skipped */
+  void Add(const std::string& prefix, const std::string& path);
+
+  /** Decode CRAMs with the shared reference and threads */
+  void SetCramReference(CramReference * c) { m_cram = c; }
+
+  /** Max readers kept open while idle, over all BAMs. 0 for no limit */
+  void SetMaxIdle(size_t n) { m_max_idle = n; }
+
+  /** Lend the walker an open reader of its BAM (by its prefix), opening
+   * one if none is idle. False if there is no such BAM (e.g. stdin, which
+   * only the stream reads) or it can't be opened */
+  bool Acquire(svabaBamWalker& w);
+
+  /** Take back the reader lent to a walker */
+  void Release(svabaBamWalker& w);
+
+  /** Opens, reuses and peak open readers for the log */
+  std::string Stats() const;
+
+ private:
+
+  struct Reader {
+    SeqLib::BamReader r;
+    bool is_cram = false;
+    size_t last_used = 0;
+  };
+
+  std::unordered_map<std::string, std::string> m_paths; // prefix to file
+  std::unordered_map<std::string, std::list<Reader> > m_idle; // most recently used at the front
+
+  CramReference * m_cram = nullptr;
+
+  size_t m_max_idle = 0;
+  size_t m_num_idle = 0;
+  size_t m_num_open = 0;
+  size_t m_peak_open = 0;
+  size_t m_opens = 0;
+  size_t m_reuses = 0;
+  size_t m_tick = 0;
+
+  mutable pthread_mutex_t m_mutex;
+
+};
+
+#endif
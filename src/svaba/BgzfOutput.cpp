@@ -0,0 +1,371 @@
+#include "BgzfOutput.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+
+#include "htslib/kstring.h"
+#include "htslib/thread_pool.h"
+
+#include "svaba_params.h"
+
+OutputPool::OutputPool() {
+  m_tp.pool = nullptr;
+  m_tp.qsize = 0;
+}
+
+OutputPool::~OutputPool() {
+  if (m_pool)
+    hts_tpool_destroy(m_pool);
+}
+
+void OutputPool::Init(int threads) {
+  if (threads > 0 && !m_pool) {
+    m_pool = hts_tpool_init(threads);
+    m_tp.pool = m_pool;
+  }
+}
+
+void OutputPool::Attach(BGZF * fp) {
+  if (m_pool && fp)
+    bgzf_thread_pool(fp, m_pool, 0);
+}
+
+void OutputPool::Attach(htsFile * fp) {
+  if (m_pool && fp)
+    hts_set_opt(fp, HTS_OPT_THREAD_POOL, &m_tp);
+}
+
+// name of the i'th temporary run of an output
+static std::string run_file(const std::string& fn, size_t i) {
+  return fn + ".run" + std::to_string(i) + ".tmp";
+}
+
+// merge order: by chromosome (none last), then position, then run
+struct RunHead {
+  uint32_t chr;
+  int32_t pos;
+  size_t run;
+  bool operator>(const RunHead& o) const {
+    if (chr != o.chr)
+      return chr > o.chr;
+    if (pos != o.pos)
+      return pos > o.pos;
+    return run > o.run;
+  }
+};
+
+typedef std::priority_queue<RunHead, std::vector<RunHead>, std::greater<RunHead> > RunQueue;
+
+bool BgzfTextWriter::Open(const std::string& fn, OutputPool * pool) {
+
+  m_fn = fn;
+  m_pool = pool;
+  m_fp = bgzf_open(fn.c_str(), "w");
+  if (!m_fp) {
+    std::cerr << "ERROR: Cannot open " << fn << " for writing" << std::endl;
+    return false;
+  }
+  if (m_pool)
+    m_pool->Attach(m_fp);
+  return true;
+}
+
+void BgzfTextWriter::SetSorted(const tbx_conf_t& conf) {
+  m_sorted = true;
+  m_conf = conf;
+}
+
+void BgzfTextWriter::Write(const std::string& line) {
+
+  if (!m_fp)
+    return;
+
+  if (bgzf_write(m_fp, line.c_str(), line.length()) < 0 || bgzf_write(m_fp, "\n", 1) < 0)
+    std::cerr << "ERROR: Could not write to " << m_fn << std::endl;
+}
+
+// the value of a 1-based tab-separated column, as a position
+static long column_position(const std::string& line, int col) {
+  size_t start = 0;
+  for (int c = 1; c < col && start != std::string::npos; ++c) {
+    start = line.find('\t', start);
+    if (start != std::string::npos)
+      ++start;
+  }
+  return start == std::string::npos ? -1 : std::strtol(line.c_str() + start, nullptr, 10);
+}
+
+void BgzfTextWriter::Write(int32_t chr, int32_t pos, const std::string& line) {
+
+  if (!m_fp)
+    return;
+
+  if (!m_sorted) {
+    Write(line);
+    return;
+  }
+
+  // the index reads the position from the line, so it has to be the one
+  // sorted on or tabix would see the file out of order
+  assert(column_position(line, m_conf.bc) == pos);
+
+  m_lines.push_back({chr, pos, line});
+  m_bytes += sizeof(Line) + line.capacity();
+  if (m_bytes >= (size_t)OUTPUT_RUN_MB * 1024 * 1024)
+    spill();
+}
+
+// stable, so lines at the same position keep the order written
+static bool line_less(int32_t c1, int32_t p1, int32_t c2, int32_t p2) {
+  if (c1 != c2)
+    return (uint32_t)c1 < (uint32_t)c2;
+  return p1 < p2;
+}
+
+void BgzfTextWriter::spill() {
+
+  std::stable_sort(m_lines.begin(), m_lines.end(), [](const Line& a, const Line& b) {
+      return line_less(a.chr, a.pos, b.chr, b.pos);
+    });
+
+  // runs are re-read once, so compress them lightly
+  std::string rf = run_file(m_fn, m_runs.size());
+  BGZF * run = bgzf_open(rf.c_str(), "w1");
+  if (!run) {
+    std::cerr << "ERROR: Cannot open temporary file " << rf << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (m_pool)
+    m_pool->Attach(run);
+  for (const auto& l : m_lines) {
+    std::string s = std::to_string(l.chr) + "\t" + std::to_string(l.pos) + "\t" + l.s + "\n";
+    if (bgzf_write(run, s.c_str(), s.length()) < 0) {
+      std::cerr << "ERROR: Could not write temporary file " << rf << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  bgzf_close(run);
+  m_runs.push_back(rf);
+
+  std::vector<Line>().swap(m_lines);
+  m_bytes = 0;
+}
+
+void BgzfTextWriter::merge() {
+
+  std::vector<BGZF*> runs(m_runs.size());
+  std::vector<kstring_t> heads(m_runs.size());
+  RunQueue q;
+
+  // read the next line of a run onto the queue
+  auto next = [&](size_t i) {
+    if (bgzf_getline(runs[i], '\n', &heads[i]) < 0)
+      return;
+    char * p = heads[i].s;
+    RunHead h;
+    h.chr = (uint32_t)strtol(p, &p, 10);
+    h.pos = strtol(p + 1, &p, 10);
+    h.run = i;
+    q.push(h);
+  };
+
+  for (size_t i = 0; i < m_runs.size(); ++i) {
+    runs[i] = bgzf_open(m_runs[i].c_str(), "r");
+    if (!runs[i]) {
+      std::cerr << "ERROR: Cannot read temporary file " << m_runs[i] << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    heads[i].l = heads[i].m = 0;
+    heads[i].s = nullptr;
+    next(i);
+  }
+
+  while (!q.empty()) {
+    size_t i = q.top().run;
+    q.pop();
+
+    // skip the chromosome and position the run added
+    char * s = heads[i].s;
+    s = strchr(s, '\t') + 1;
+    s = strchr(s, '\t') + 1;
+    Write(std::string(s, heads[i].s + heads[i].l - s));
+    next(i);
+  }
+
+  for (size_t i = 0; i < m_runs.size(); ++i) {
+    bgzf_close(runs[i]);
+    free(heads[i].s);
+    std::remove(m_runs[i].c_str());
+  }
+  m_runs.clear();
+}
+
+void BgzfTextWriter::Close() {
+
+  if (!m_fp)
+    return;
+
+  if (m_sorted) {
+    if (m_runs.empty()) {
+      std::stable_sort(m_lines.begin(), m_lines.end(), [](const Line& a, const Line& b) {
+	  return line_less(a.chr, a.pos, b.chr, b.pos);
+	});
+      for (const auto& l : m_lines)
+	Write(l.s);
+      std::vector<Line>().swap(m_lines);
+    } else {
+      if (m_lines.size())
+	spill();
+      merge();
+    }
+  }
+
+  bgzf_close(m_fp);
+  m_fp = nullptr;
+
+  if (m_sorted && tbx_index_build(m_fn.c_str(), 0, &m_conf))
+    std::cerr << "WARNING: Could not index " << m_fn << std::endl;
+}
+
+bool SortedBamWriter::Open(const std::string& fn, const SeqLib::BamHeader& h, OutputPool * pool) {
+
+  m_fn = fn;
+  m_hdr = h;
+  m_pool = pool;
+  m_fp = hts_open(fn.c_str(), "wb");
+  if (!m_fp) {
+    std::cerr << "ERROR: Cannot open " << fn << " for writing" << std::endl;
+    return false;
+  }
+  if (m_pool)
+    m_pool->Attach(m_fp);
+  if (sam_hdr_write(m_fp, m_hdr.get_()) < 0) {
+    std::cerr << "ERROR: Cannot write the header of " << fn << std::endl;
+    hts_close(m_fp);
+    m_fp = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void SortedBamWriter::WriteRecord(const SeqLib::BamRecord& r) {
+
+  if (!m_fp || r.isEmpty())
+    return;
+
+  bam1_t * b = bam_dup1(r.raw());
+  m_recs.push_back(b);
+  m_bytes += sizeof(bam1_t) + b->l_data;
+  if (m_bytes >= (size_t)OUTPUT_RUN_MB * 1024 * 1024)
+    spill();
+}
+
+void SortedBamWriter::sort_records() {
+  std::stable_sort(m_recs.begin(), m_recs.end(), [](const bam1_t * a, const bam1_t * b) {
+      if (a->core.tid != b->core.tid)
+	return (uint32_t)a->core.tid < (uint32_t)b->core.tid;
+      return a->core.pos < b->core.pos;
+    });
+}
+
+void SortedBamWriter::spill() {
+
+  sort_records();
+
+  std::string rf = run_file(m_fn, m_runs.size());
+  htsFile * run = hts_open(rf.c_str(), "wb1");
+  if (!run || sam_hdr_write(run, m_hdr.get_()) < 0) {
+    std::cerr << "ERROR: Cannot open temporary file " << rf << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (m_pool)
+    m_pool->Attach(run);
+  for (auto b : m_recs) {
+    if (sam_write1(run, m_hdr.get_(), b) < 0) {
+      std::cerr << "ERROR: Could not write temporary file " << rf << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    bam_destroy1(b);
+  }
+  hts_close(run);
+  m_runs.push_back(rf);
+
+  std::vector<bam1_t*>().swap(m_recs);
+  m_bytes = 0;
+}
+
+void SortedBamWriter::merge() {
+
+  std::vector<htsFile*> runs(m_runs.size());
+  std::vector<bam_hdr_t*> hdrs(m_runs.size());
+  std::vector<bam1_t*> heads(m_runs.size());
+  RunQueue q;
+
+  // read the next record of a run onto the queue
+  auto next = [&](size_t i) {
+    if (sam_read1(runs[i], hdrs[i], heads[i]) < 0)
+      return;
+    RunHead h;
+    h.chr = (uint32_t)heads[i]->core.tid;
+    h.pos = heads[i]->core.pos;
+    h.run = i;
+    q.push(h);
+  };
+
+  for (size_t i = 0; i < m_runs.size(); ++i) {
+    runs[i] = hts_open(m_runs[i].c_str(), "r");
+    hdrs[i] = runs[i] ? sam_hdr_read(runs[i]) : nullptr;
+    if (!hdrs[i]) {
+      std::cerr << "ERROR: Cannot read temporary file " << m_runs[i] << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    heads[i] = bam_init1();
+    next(i);
+  }
+
+  while (!q.empty()) {
+    size_t i = q.top().run;
+    q.pop();
+    if (sam_write1(m_fp, m_hdr.get_(), heads[i]) < 0)
+      std::cerr << "ERROR: Could not write to " << m_fn << std::endl;
+    next(i);
+  }
+
+  for (size_t i = 0; i < m_runs.size(); ++i) {
+    bam_destroy1(heads[i]);
+    bam_hdr_destroy(hdrs[i]);
+    hts_close(runs[i]);
+    std::remove(m_runs[i].c_str());
+  }
+  m_runs.clear();
+}
+
+void SortedBamWriter::Close() {
+
+  if (!m_fp)
+    return;
+
+  if (m_runs.empty()) {
+    sort_records();
+    for (auto b : m_recs) {
+      if (sam_write1(m_fp, m_hdr.get_(), b) < 0)
+	std::cerr << "ERROR: Could not write to " << m_fn << std::endl;
+      bam_destroy1(b);
+    }
+    std::vector<bam1_t*>().swap(m_recs);
+  } else {
+    if (m_recs.size())
+      spill();
+    merge();
+  }
+
+  hts_close(m_fp);
+  m_fp = nullptr;
+
+  if (sam_index_build(m_fn.c_str(), 0) < 0)
+    std::cerr << "WARNING: Could not index " << m_fn << std::endl;
+}
@@ -0,0 +1,149 @@
+#ifndef SVABA_BGZF_OUTPUT_H__
+#define SVABA_BGZF_OUTPUT_H__
+
+#include <string>
+#include <vector>
+
+#include "htslib/hts.h"
+#include "htslib/bgzf.h"
+#include "htslib/sam.h"
+#include "htslib/tbx.h"
+
+#include "SeqLib/BamHeader.h"
+#include "SeqLib/BamRecord.h"
+
+/** Threads shared by every output file for BGZF compression.
+ *
+ * Outputs are written under one lock by whichever thread flushes, so
+ * compressing them inline makes the end of a fast run serial. Blocks
+ * handed to the pool are compressed in the background instead.
+ */
+class OutputPool {
+
+ public:
+
+  OutputPool();
+
+  ~OutputPool();
+
+  /** Start the threads. 0 compresses inline */
+  void Init(int threads);
+
+  void Attach(BGZF * fp);
+
+  void Attach(htsFile * fp);
+
+ private:
+
+  hts_tpool * m_pool = nullptr;
+  htsThreadPool m_tp;
+
+};
+
+/** Text output written as BGZF.
+ *
+ * Lines written with a position are coordinate sorted (by chromosome ID,
+ * then position, then the order written): they are held in memory and
+ * spilled to temporary sorted runs, which are merged into the file on
+ * Close. The file is then tabix indexed. Lines without a position, such as
+ * headers, go straight to the file, so they have to come first.
+ */
+class BgzfTextWriter {
+
+ public:
+
+  BgzfTextWriter() {}
+
+  ~BgzfTextWriter() { Close(); }
+
+  /** Open the file for writing, compressing on the pool (if not null) */
+  bool Open(const std::string& fn, OutputPool * pool);
+
+  /** Sort the lines written with a position, and index the file on Close */
+  void SetSorted(const tbx_conf_t& conf);
+
+  bool IsOpen() const { return m_fp != nullptr; }
+
+  /** Write a line (newline added) straight to the file */
+  void Write(const std::string& line);
+
+  /** Write a line (newline added) at a position of a sorted file */
+  void Write(int32_t chr, int32_t pos, const std::string& line);
+
+  /** Merge any sorted runs into the file, close and index it */
+  void Close();
+
+ private:
+
+  struct Line {
+    int32_t chr;
+    int32_t pos;
+    std::string s;
+  };
+
+  std::string m_fn;
+  BGZF * m_fp = nullptr;
+  OutputPool * m_pool = nullptr;
+
+  bool m_sorted = false;
+  tbx_conf_t m_conf;
+
+  std::vector<Line> m_lines;
+  size_t m_bytes = 0;
+  std::vector<std::string> m_runs;
+
+  // sort the held lines into a run file
+  void spill();
+
+  // merge the runs into the file
+  void merge();
+
+};
+
+/** BAM output, coordinate sorted and indexed.
+ *
+ * Records are held in memory and spilled to temporary sorted BAMs, which
+ * are merged into the file on Close. Records with no chromosome go last.
+ */
+class SortedBamWriter {
+
+ public:
+
+  SortedBamWriter() {}
+
+  ~SortedBamWriter() { Close(); }
+
+  /** Open the file and write the header, compressing on the pool (if not null) */
+  bool Open(const std::string& fn, const SeqLib::BamHeader& h, OutputPool * pool);
+
+  bool IsOpen() const { return m_fp != nullptr; }
+
+  /** Add a record (copied) */
+  void WriteRecord(const SeqLib::BamRecord& r);
+
+  /** Merge any sorted runs into the file, close and index it */
+  void Close();
+
+ private:
+
+  std::string m_fn;
+  htsFile * m_fp = nullptr;
+  SeqLib::BamHeader m_hdr;
+  OutputPool * m_pool = nullptr;
+
+  std::vector<bam1_t*> m_recs;
+  size_t m_bytes = 0;
+  std::vector<std::string> m_runs;
+
+  // sort the held records, into the file itself if there are no runs
+  void sort_records();
+
+  // sort the held records into a run file
+  void spill();
+
+  // merge the runs into the file
+  void merge();
+
+};
+
+#endif
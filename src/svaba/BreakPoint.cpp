@@ -8,6 +8,7 @@
 #include "svabaUtils.h"
 
 #include "svaba_params.h"
+#include "PackedCigarMap.h"
 
 // define repeats
 static std::vector<std::string> repr = {"AAAAAAAAAAAAAAAA", "TTTTTTTTTTTTTTTT", 
@@ -42,6 +43,9 @@ using namespace SeqLib;
 
   double __myround(double x) { return std:: floor(x * 10) / 10; }
 
+  // signed to unsigned, keeping the order
+  static inline uint64_t __ordered(int32_t v) { return (uint32_t)v ^ 0x80000000u; }
+
   // make the file string
   std::string BreakPoint::toFileString(bool noreads) {
     
@@ -61,7 +65,7 @@ using namespace SeqLib;
 
     double max_lod = 0;
     for (auto& s : allele) 
-      max_lod = std::max(max_lod, s.second.LO);
+      max_lod = std::max(max_lod, s.LO);
 
     ss << b1.chr_name << sep << b1.gr.pos1 << sep << b1.gr.strand << sep 
        << b2.chr_name << sep << b2.gr.pos1 << sep << b2.gr.strand << sep 
@@ -86,7 +90,7 @@ using namespace SeqLib;
        << (!bxtable.empty() ? bxtable : "x");
 
     for (auto& a : allele)
-      ss << sep << a.second.toFileString();
+      ss << sep << a.toFileString();
 
     return ss.str();
 
@@ -139,26 +143,28 @@ BreakPoint::BreakPoint(DiscordantCluster& tdc, const BWAWrapper * bwa, Discordan
     b2.gr.strand = dc.m_reg2.strand;
 
     // set the alt counts, counting only unique qnames
-    std::unordered_map<std::string, std::unordered_set<std::string>> alt_counts;
+    std::vector<std::unordered_set<std::string> > alt_counts(allele.size());
 
     // add the supporting read info to allels
     for (auto& rr : dc.reads) {
       //std::string sr = SRTAG(rr.second);
       std::string sr = rr.second.SR();
-      allele[rr.second.Prefix()].supporting_reads.insert(sr);
-      alt_counts[rr.second.Prefix()].insert(rr.second.Qname());
+      int s = SampleIndex::Get(rr.second.Prefix());
+      allele[s].supporting_reads.insert(sr);
+      alt_counts[s].insert(rr.second.Qname());
     }
     for (auto& rr : dc.mates) {
       std::string sr = rr.second.SR();
-      allele[rr.second.Prefix()].supporting_reads.insert(rr.second.Qname());
-      alt_counts[rr.second.Prefix()].insert(rr.second.Qname());
+      int s = SampleIndex::Get(rr.second.Prefix());
+      allele[s].supporting_reads.insert(rr.second.Qname());
+      alt_counts[s].insert(rr.second.Qname());
     }
     
     // add the alt counts
-    for (auto& i : allele) {
-      i.second.indel = false;
-      i.second.disc = alt_counts[i.first].size(); //allele[i.first].supporting_reads.size();
-      i.second.adjust_alt_counts();
+    for (size_t i = 0; i < allele.size(); ++i) {
+      allele[i].indel = false;
+      allele[i].disc = alt_counts[i].size(); //allele[i.first].supporting_reads.size();
+      allele[i].adjust_alt_counts();
       //i.second.alt = i.second.disc;
     }
       
@@ -205,6 +211,41 @@ BreakPoint::BreakPoint(DiscordantCluster& tdc, const BWAWrapper * bwa, Discordan
   bool BreakPoint::operator==(const BreakPoint &bp) const {
     return (b1.gr == bp.b1.gr && b2.gr == bp.b2.gr && bp.insertion == insertion); 
   }
+
+  void BreakPoint::sortUnique(std::vector<BreakPoint>& bps) {
+
+    // both break end regions (chr, pos1, pos2), packed into three words
+    struct PosKey {
+      uint64_t a, b, c;
+      uint32_t i;
+    };
+    std::vector<PosKey> keys(bps.size());
+    for (size_t i = 0; i < bps.size(); ++i) {
+      const BreakPoint& bp = bps[i];
+      keys[i] = { bp.b1.key(),
+		  (__ordered(bp.b1.gr.pos2) << 32) | __ordered(bp.b2.gr.chr),
+		  (__ordered(bp.b2.gr.pos1) << 32) | __ordered(bp.b2.gr.pos2),
+		  (uint32_t)i };
+    }
+
+    std::sort(keys.begin(), keys.end(), [&bps](const PosKey& x, const PosKey& y) {
+	if (x.a != y.a)
+	  return x.a < y.a;
+	if (x.b != y.b)
+	  return x.b < y.b;
+	if (x.c != y.c)
+	  return x.c < y.c;
+	return bps[x.i] < bps[y.i]; // same position, so on to the split counts etc
+      });
+
+    // keep the first of each run of equal breakpoints
+    std::vector<BreakPoint> out;
+    out.reserve(keys.size());
+    for (const auto& k : keys)
+      if (out.empty() || !(out.back() == bps[k.i]))
+	out.push_back(std::move(bps[k.i]));
+    bps.swap(out);
+  }
     
   void BreakPoint::repeatFilter() {
 
@@ -233,8 +274,10 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
     std::string val;
     size_t count = 0;
 
-    std::string chr1, pos1, chr2, pos2, chr_name1, chr_name2, id; 
-    id = "";//dummmy
+    // samples are added in column order, which is SampleIndex order
+    allele.clear();
+
+    std::string chr1, pos1, chr2, pos2, chr_name1, chr_name2; 
     char strand1 = '*', strand2 = '*';
     while (std::getline(iss, val, '\t')) {
       SampleInfo aaa;
@@ -281,8 +324,7 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
         default: 
 	  aaa.indel = evidence == "INDEL";
 	  aaa.fromString(val);
-	  id += "A";
-	  allele[id] = aaa; //id is dummy. just keep in order as came in;
+	  allele.push_back(aaa);
 	  // fill in the discordant info
 	  //if (id == "A") // tumor
 	  //  dc.tcount = aaa.disc;
@@ -300,7 +342,7 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
   }
   
 //void BreakPoint::splitCoverage(SeqLib::BamRecordVector &bav) {
-  void BreakPoint::splitCoverage(svabaReadVector &bav) {
+  void BreakPoint::splitCoverage(svabaReadVector &bav, const ContigReadIndex& index) {
     
     // track if first and second mate covers same split. fishy and remove them both
     std::unordered_map<std::string, bool> qname_and_num;
@@ -311,51 +353,39 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
     // keep track of reads to reject
     std::set<std::string> reject_qnames;
 
-    // keep track of which SR tags are valid splits
-    std::unordered_set<std::string> valid_reads;
+    // keep track of which reads are valid splits
+    std::vector<size_t> valid_reads;
 
     // get the homology length. useful bc if read alignment ends in homologous region, it is not split
     int homlen = b1.cpos - b2.cpos;
     if (homlen < 0)
       homlen = 0;
    
-    // loop all of the read to contig alignments for this contig
-    for (auto& j : bav) {
+    // only reads spanning a break end (with the smaller of the tumor and
+    // normal buffers) can be valid splits, so visit just those
+    int min_buff = std::min(T_SPLIT_BUFF, N_SPLIT_BUFF) + repeat_seq.length();
+    std::vector<size_t> spanning;
+    index.Spanning(std::max(b1.cpos, b2.cpos) - min_buff, std::min(b1.cpos, b2.cpos) + min_buff, spanning);
+
+    // loop the read to contig alignments of those reads
+    for (auto k : spanning) {
 
-      r2c& this_r2c = j.GetR2C(cname);
+      svabaRead& j = bav[k];
+      r2c& this_r2c = index.R2C(k);
 
       bool read_should_be_skipped = false;
       if (num_align == 1) {
 
-	std::vector<int> del_breaks;
-	std::vector<int> ins_breaks;
-	int pos = 0;
-	
 	// if this is a nasty repeat, don't trust non-perfect alignmentx on r2c alignment
-	if (__check_homopolymer(j.Sequence())) 
+	if (index.Homopolymer(k)) 
 	  read_should_be_skipped = true;
 	
-	// loop through r2c cigar and see positions
-	for(auto& i : this_r2c.cig) {
-	  
-	  if (i.Type() == 'D') 
-	    del_breaks.push_back(pos);
-	  else if (i.Type() == 'I')
-	    ins_breaks.push_back(pos);
-	  
-	  // update position on contig
-	  if (i.ConsumesReference())
-	    pos += i.Length(); // update position on contig
-	  
-	}
-	
-	size_t buff = std::max((size_t)3, repeat_seq.length() + 3);
-	for (auto& i : del_breaks)
-	  if (i > b1.cpos - buff || i < b1.cpos + buff) // if start of insertion is at start of a del of r2c
-	    read_should_be_skipped = true;
-	for (auto& i : ins_breaks)
-	  if (i > b1.cpos - buff || i < b1.cpos + buff) // if start of insertion is at start of a del of r2c
-	    read_should_be_skipped = true;
+	// skip if the r2c alignment has an insertion or deletion near the
+	// break. The window (3bp, longer with a repeat) is tested as
+	// i > b1.cpos - buff || i < b1.cpos + buff, which holds anywhere on
+	// the contig, so that is any insertion or deletion
+	if (index.HasIndel(k))
+	  read_should_be_skipped = true;
       } 
 
       if (read_should_be_skipped)  // default is r2c does not support var, so don't amend this_r2c
@@ -363,7 +393,6 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
       
       // get read ID
       std::string sample_id = j.Prefix(); //substr(0,4); // maybe just make this prefix
-      std::string sr = j.SR(); 
 
       // need read to cover past variant by some buffer. If there is a repeat,
       // then this needs to be even longer to avoid ambiguity
@@ -398,17 +427,6 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
       // segment, it should be non-split on all, for overlapping alignments like above. Not true of 
       // insertions at junctions, where one can split at one and not the other because of the intervening sequence buffer
 
-      // check that deletion (in read to contig coords) doesn't cover break point
-      size_t p = pos; // move along on contig, starting at first non-clipped base
-      for (SeqLib::Cigar::const_iterator c = this_r2c.cig.begin(); c != this_r2c.cig.end(); ++c) {
-	if (c->Type() == 'D') { 
-	  if ( (p >= leftbreak1 && p <= rightbreak1) || (p >= leftbreak2 && p <= rightbreak2) )
-	    read_should_be_skipped = true;
-	}
-	if (c->ConsumesReference()) // if it moves it along the contig
-	  p += c->Length();
-      }
-
       //debug
       /*if (sr == "t000_163_H01PEALXX140819:2:2202:14804:18907")
 	std::cerr << " te " << te << " pos " << pos << " CIG " << j.GetZTag("SC") << " SL " << j.GetZTag("SL") << " SE " << j.GetZTag("SE") << 
@@ -441,7 +459,7 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
 	  
 	  // this is a valid read
 	  this_r2c.supports_var = true;
-	  valid_reads.insert(sr);
+	  valid_reads.push_back(k);
 
 	  // how much of the contig do these span
 	  // for a given read QNAME, get the coverage that 
@@ -462,47 +480,43 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
     } // end read loop
 
     // process valid reads
-    for (auto& i : bav) {
+    for (auto k : valid_reads) {
       
-      r2c& this_r2c = i.GetR2C(cname);
-      if (valid_reads.count(i.SR())) {
-
-	std::string qn = i.Qname();
-	if (qnames.count(qn))
-	  continue; // don't count support if already added and not a short event
-	// check that it's not a bad 1, 2 split
-	if (reject_qnames.count(qn)) {
-	  this_r2c.supports_var = false;
-	  i.AddR2C(cname, this_r2c); // update that this actually does not support
-	  continue; 
-	}
+      svabaRead& i = bav[k];
+
+      std::string qn = i.Qname();
+      if (qnames.count(qn))
+	continue; // don't count support if already added and not a short event
+      // check that it's not a bad 1, 2 split
+      if (reject_qnames.count(qn)) {
+	index.R2C(k).supports_var = false; // update that this actually does not support
+	continue; 
+      }
 
-	reads.push_back(i);
+      reads.push_back(i);
 
-	// keep track of qnames of split reads
-	qnames.insert(qn);
-	allele[i.Prefix()].supporting_reads.insert(i.SR());
+      // keep track of qnames of split reads
+      qnames.insert(qn);
+      SampleInfo& si = sample(i.Prefix());
+      si.supporting_reads.insert(i.SR());
 	
-      	++allele[i.Prefix()].split;
-      }
+      ++si.split;
     }
 
       // adjust the alt count
     for (auto& i : allele) {
-      i.second.indel = num_align == 1;
-      i.second.adjust_alt_counts();
+      i.indel = num_align == 1;
+      i.adjust_alt_counts();
     }
 
   }
   
-  std::string BreakPoint::getHashString() const {
+  uint64_t BreakPoint::getIndelKey() const {
     
     bool isdel = insertion.length() == 0;
     //if (isdel) // del breaks are stored as last non-deleted base. CigarMap stores as THE deleted base
     //  pos1++;
-    std::string st = std::to_string(b1.gr.chr) + "_" + std::to_string(b1.gr.pos1) + "_" + std::to_string(this->getSpan()) + (isdel ? "D" : "I");
-    //std::string st = std::to_string(b1.gr.chr) + "_" + std::to_string(b1.gr.pos1); // + "_" + std::to_string(this->getSpan()) + (isdel ? "D" : "I");
-    return st;
+    return PackedCigarMap::Key(b1.gr.chr, b1.gr.pos1, this->getSpan(), isdel);
   }
   
 /*  int BreakPoint::checkPon(const PONFilter * p) {
@@ -539,14 +553,14 @@ std::ostream& operator<<(std::ostream& out, const BreakPoint& b) {
 	out << ">" << (b.insertion.size() ? "INS: " : "DEL: ") << b.getSpan() << " " << b.b1.gr << " " << b.cname << " " << b.evidence;
 	  //<< " T/N split: " << b.t.split << "/" << b.n.split << " T/N cigar: " 
           //  << b.t.cigar << "/" << b.n.cigar << " T/N Cov " << b.t.cov << "/" << b.n.cov << " DBSNP: " << rs_t;
-	for (auto& i : b.allele)
-	  out << " " << i.first << ":" << i.second.split;  
+	for (size_t i = 0; i < b.allele.size(); ++i)
+	  out << " " << SampleIndex::Name(i) << ":" << b.allele[i].split;  
       } else {
 	out << ": " << b.b1.gr.PointString() << " to " << b.b2.gr.PointString() << " SPAN " << b.getSpan() << " " << b.cname << " " << b.evidence;
 	  //<< " T/N split: " << b.t.split << "/" << b.n.split << " T/N disc: " 
 	  //  << b.dc.tcount << "/" << b.dc.ncount << " " << b.evidence;
-	for (auto& i : b.allele)
-	  out << " " << i.first << ":" << i.second.split;  
+	for (size_t i = 0; i < b.allele.size(); ++i)
+	  out << " " << SampleIndex::Name(i) << ":" << b.allele[i].split;  
       }
       
       return out;
@@ -634,22 +648,22 @@ BreakEnd::BreakEnd(const SeqLib::BamRecord& b) {
 
 	      // add the read counts
 	      for (auto& c : d.second.counts) {
-		allele[c.first].disc = c.second;
-		allele[c.first].indel = num_align == 1;
+		sample(c.first).disc = c.second;
+		sample(c.first).indel = num_align == 1;
 	      }
 
 	      // add the discordant reads names to supporting reads for each sampleinfo
 	      for (auto& rr : d.second.reads) {
-		allele[rr.second.Prefix()].supporting_reads.insert(rr.second.SR());
+		sample(rr.second.Prefix()).supporting_reads.insert(rr.second.SR());
 
 	      }
 	      for (auto& rr : d.second.mates) {
-		allele[rr.second.Prefix()].supporting_reads.insert(rr.second.SR());
+		sample(rr.second.Prefix()).supporting_reads.insert(rr.second.SR());
 	      }
 
 	      // adjust the alt counts
 	      for (auto& aa : allele)
-		aa.second.adjust_alt_counts();
+		aa.adjust_alt_counts();
 	      //aa.second.alt = aa.second.supporting_reads.size();
 	  } 
 	
@@ -809,11 +823,11 @@ BreakEnd::BreakEnd(const SeqLib::BamRecord& b) {
     // these alt counts should already be one qname per alt (ie no dupes)
     int t_reads = 0;
     int n_reads = 0;
-    for (auto& a : allele) {
-      if (a.first.at(0) == 't')
-	t_reads += a.second.alt;
+    for (size_t i = 0; i < allele.size(); ++i) {
+      if (SampleIndex::IsCase(i))
+	t_reads += allele[i].alt;
       else
-	n_reads += a.second.alt;
+	n_reads += allele[i].alt;
     }
 
     int total_count = t_reads + n_reads; //n.split + t.split + dc.ncount + dc.tcount;
@@ -884,13 +898,13 @@ void BreakPoint::score_indel(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP) {
     
     double max_lod = 0;
     for (auto& s : allele) 
-      max_lod = std::max(max_lod, s.second.LO);
+      max_lod = std::max(max_lod, s.LO);
 
     // check if homozygous reference is most likely GT
     bool homozygous_ref = true;
     for (auto& s : allele) {
-      if (s.second.genotype_likelihoods[0] > s.second.genotype_likelihoods[1] ||
-	  s.second.genotype_likelihoods[0] > s.second.genotype_likelihoods[2])
+      if (s.genotype_likelihoods[0] > s.genotype_likelihoods[1] ||
+	  s.genotype_likelihoods[0] > s.genotype_likelihoods[2])
 	homozygous_ref = false;
     }
     
@@ -935,8 +949,8 @@ void BreakPoint::scoreBreakpoint(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, dou
     // 
     error_rate = repeat_seq.length() > 10 ? MAX_ERROR : ERROR_RATES[repeat_seq.length()];
     for (auto& i : allele) {
-      i.second.readlen = readlen;
-      i.second.modelSelection(error_rate);
+      i.readlen = readlen;
+      i.modelSelection(error_rate);
     }
 
     // kludge. make sure we have included the DC counts (should have done this arleady...)
@@ -958,7 +972,7 @@ void BreakPoint::scoreBreakpoint(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, dou
     // sanity check
     int split =0;
     for (auto& i : allele) 
-      split += i.second.split;
+      split += i.split;
     assert( (split == 0 && t.split == 0 && n.split==0) || (split > 0 && (t.split + n.split > 0)));
 
     // do the scoring
@@ -992,7 +1006,7 @@ void BreakPoint::scoreBreakpoint(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, dou
     // quality score is odds that read is non-homozygous reference (max 99)
     quality = 0;
     for (auto& a : allele)
-      quality = std::max(a.second.NH_GQ, (double)quality); 
+      quality = std::max(a.NH_GQ, (double)quality); 
     
   }
 
@@ -1414,18 +1428,15 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
 
   }
 
-  void BreakPoint::addCovs(const std::unordered_map<std::string, STCoverage*>& covs) {
+  void BreakPoint::addCovs(const std::vector<STCoverage*>& covs) {
 
-    for (auto& i : covs)  {
+    for (size_t i = 0; i < covs.size() && i < allele.size(); ++i)  {
       int c = 0;
       for (int j = -COVERAGE_AVG_BUFF; j <= COVERAGE_AVG_BUFF; ++j) {
-	c +=  i.second->getCoverageAtPosition(b1.gr.chr, b1.gr.pos1 + j);
-	c +=  i.second->getCoverageAtPosition(b2.gr.chr, b2.gr.pos1 + j);
+	c +=  covs[i]->getCoverageAtPosition(b1.gr.chr, b1.gr.pos1 + j);
+	c +=  covs[i]->getCoverageAtPosition(b2.gr.chr, b2.gr.pos1 + j);
       }
-      allele[i.first].cov = c / 2 / (COVERAGE_AVG_BUFF*2 + 1); // std::max(i.second->getCoverageAtPosition(b1.gr.chr, b1.gr.pos1), i.second->getCoverageAtPosition(b2.gr.chr, b2.gr.pos1));
-
-      if (cname=="c_22_16905001_16930001_191C") //debug
-	std::cerr << i.first << " COV " << allele[i.first].cov << std::endl;
+      allele[i].cov = c / 2 / (COVERAGE_AVG_BUFF*2 + 1); // std::max(i.second->getCoverageAtPosition(b1.gr.chr, b1.gr.pos1), i.second->getCoverageAtPosition(b2.gr.chr, b2.gr.pos1));
     }
     
   }
@@ -1467,11 +1478,11 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
 
   void BreakPoint::__combine_alleles() {
 
-    for (auto& s : allele) {
-      if (s.first.at(0) == 't') {
-	t = t + s.second;
+    for (size_t i = 0; i < allele.size(); ++i) {
+      if (SampleIndex::IsCase(i)) {
+	t = t + allele[i];
       } else {
-	n = n + s.second;
+	n = n + allele[i];
       }
     }
 
@@ -1595,9 +1606,9 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
       rseq = sss.substr(cpos, std::min(end - cpos, (int)seq.length() - cpos));
   }
 
-  std::string BreakEnd::hash(int offset) const {
+  uint64_t BreakEnd::key(int offset) const {
     
-    return (std::to_string(gr.chr) + ":" + std::to_string(gr.pos1 + offset));
+    return (__ordered(gr.chr) << 32) | __ordered(gr.pos1 + offset);
     
   }
 
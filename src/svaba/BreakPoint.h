@@ -13,6 +13,8 @@
 #include "SeqLib/RefGenome.h"
 #include "DiscordantCluster.h"
 #include "svabaRead.h"
+#include "ContigReadIndex.h"
+#include "SampleIndex.h"
 
   // forward declares
   struct BreakPoint;
@@ -41,7 +43,8 @@ struct ReducedBreakEnd {
    
    void checkLocal(const SeqLib::GenomicRegion& window);
 
-   std::string hash(int offset = 0) const;
+   // integer key of (chr, pos1 + offset), ordered as the GenomicRegion
+   uint64_t key(int offset = 0) const;
 
    std::string id;
    std::string chr_name;
@@ -229,8 +232,15 @@ struct ReducedBreakEnd {
    
    int quality = 0;
 
-   // total coverage at that position
-   std::map<std::string, SampleInfo> allele; // ordered to keep in alphabetical order by prefix (e.g. n001)
+   // evidence for each sample, by its SampleIndex number (so in prefix order, e.g. n001 before t000)
+   std::vector<SampleInfo> allele = std::vector<SampleInfo>(SampleIndex::size());
+
+   /** Evidence for a sample, by its prefix (e.g. t000) */
+   SampleInfo& sample(const std::string& prefix) {
+     int i = SampleIndex::Get(prefix);
+     assert(i >= 0);
+     return allele[i];
+   }
 
    bool secondary = false;
 
@@ -267,7 +277,9 @@ struct ReducedBreakEnd {
 
    void score_somatic(double NODBCUTOFF, double DBCUTOFF);
 
-   void addCovs(const std::unordered_map<std::string, STCoverage*>& covs);
+   /** Add the coverage of each sample at the breakends
+    * @param covs Coverage trackers, by sample number */
+   void addCovs(const std::vector<STCoverage*>& covs);
 
    /** Retrieve the reference sequence at a breakpoint and determine if 
     * it lands on a repeat */
@@ -284,7 +296,7 @@ struct ReducedBreakEnd {
     * The AL tag is filled in by AlignedContig::alignReadsToContigs.
     */
    //void splitCoverage(SeqLib::BamRecordVector &bav);
-   void splitCoverage(svabaReadVector &bav);
+   void splitCoverage(svabaReadVector &bav, const ContigReadIndex& index);
    
    /*! Determines if the BreakPoint overlays a blacklisted region. If 
     * and overlap is found, sets the blacklist bool to true.
@@ -318,11 +330,10 @@ struct ReducedBreakEnd {
    */
    int getSpan() const;
 
-   /*! @function get a unique string representation of this breakpoint.
-    * Format for indel is chr_breakpos_type (eg. 0_134134_I)
-    * @return string with breakpoint info
+   /*! @function get the key of this indel in a PackedCigarMap
+    * @return packed chr, breakpos, span and type (0 if it can't be packed)
     */
-   std::string getHashString() const;
+   uint64_t getIndelKey() const;
 
    bool hasMinimal() const;
    
@@ -337,6 +348,11 @@ struct ReducedBreakEnd {
    bool hasDiscordant() const;
    
    bool operator==(const BreakPoint& bp) const;
+
+   /*! @function sort and de-duplicate breakpoints, as std::sort then
+    * std::unique would, but by sorting small keys of their positions
+    */
+   static void sortUnique(std::vector<BreakPoint>& bps);
    
    // define how to sort these 
    bool operator < (const BreakPoint& bp) const { 
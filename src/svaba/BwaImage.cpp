@@ -0,0 +1,235 @@
+#include "BwaImage.h"
+
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <set>
+
+#include "svabaMemory.h"
+
+#define BWA_IMAGE_MAGIC "SVBAIMG1"
+
+// layout of an image: this header, then the bwa_idx2mem block
+struct BwaImageHeader {
+  char magic[8];
+  int64_t l_mem;     // bytes in the index block
+  int64_t bwt_size;  // size and mtime of <prefix>.bwt when written, to catch stale images
+  int64_t bwt_mtime;
+  char pad[32];      // keep the index block 64-byte aligned
+};
+
+static_assert(sizeof(BwaImageHeader) == 64, "BWA image header must be 64 bytes");
+
+// SeqLib::BWAWrapper can only load an index by reading its files
+// (LoadIndex), and keeps the loaded index in its private idx, which the
+// aligner, header and destructor all go through. A mapped index is handed
+// over by setting idx. An explicit instantiation may name a private member,
+// so this gets a pointer to it without changing SeqLib
+namespace {
+
+  struct BwaIndexMember {
+    typedef bwaidx_t * SeqLib::BWAWrapper::* type;
+    friend type index_member(BwaIndexMember);
+  };
+
+  template <typename Tag, typename Tag::type M>
+  struct BwaIndexAccess {
+    friend typename Tag::type index_member(Tag) { return M; }
+  };
+
+  template struct BwaIndexAccess<BwaIndexMember, &SeqLib::BWAWrapper::idx>;
+
+  // the index of an aligner, as LoadIndex would set it
+  bwaidx_t *& bwa_index(SeqLib::BWAWrapper * b) {
+    return b->*index_member(BwaIndexMember());
+  }
+
+}
+
+namespace BwaImage {
+
+  static std::map<std::string, std::string> image_paths; // prefix to image, if not the default
+  static std::set<std::string> attached;
+
+  // stat the .bwt of an index. False if there isn't one (e.g. 64-bit index naming)
+  static bool bwt_stat(const std::string& prefix, int64_t& size, int64_t& mtime) {
+    struct stat st;
+    if (stat((prefix + ".bwt").c_str(), &st) != 0)
+      return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+  }
+
+  std::string DefaultPath(const std::string& prefix) {
+    return prefix + ".img";
+  }
+
+  void SetPath(const std::string& prefix, const std::string& image) {
+    image_paths[prefix] = image;
+  }
+
+  bool Write(const std::string& prefix, const std::string& image) {
+
+    bwaidx_t * idx = bwa_idx_load(prefix.c_str(), BWA_IDX_ALL);
+    if (!idx)
+      return false;
+
+    // pack the bwt, bns and pac into one block
+    bwa_idx2mem(idx);
+
+    BwaImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BWA_IMAGE_MAGIC, 8);
+    h.l_mem = idx->l_mem;
+    bwt_stat(prefix, h.bwt_size, h.bwt_mtime);
+
+    // write to a temp file and move it in, so a reader never maps a partial image
+    std::string tmp = image + ".tmp";
+    FILE * fp = fopen(tmp.c_str(), "wb");
+    bool ok = fp &&
+      fwrite(&h, sizeof(h), 1, fp) == 1 &&
+      fwrite(idx->mem, 1, idx->l_mem, fp) == (size_t)idx->l_mem;
+    if (fp)
+      ok = (fclose(fp) == 0) && ok;
+    ok = ok && rename(tmp.c_str(), image.c_str()) == 0;
+    if (!ok)
+      unlink(tmp.c_str());
+
+    bwa_idx_destroy(idx);
+    return ok;
+  }
+
+  bwaidx_t * Attach(const std::string& prefix) {
+
+    std::map<std::string, std::string>::const_iterator ff = image_paths.find(prefix);
+    std::string path = ff == image_paths.end() ? DefaultPath(prefix) : ff->second;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BwaImageHeader)) {
+      close(fd);
+      return nullptr;
+    }
+
+    void * base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping holds its own reference
+    if (base == MAP_FAILED)
+      return nullptr;
+
+    const BwaImageHeader * h = (const BwaImageHeader*)base;
+    bool ok = memcmp(h->magic, BWA_IMAGE_MAGIC, 8) == 0 &&
+      h->l_mem + (int64_t)sizeof(BwaImageHeader) == (int64_t)st.st_size;
+
+    // the index files changed since the image was made
+    int64_t bsize, bmtime;
+    if (ok && bwt_stat(prefix, bsize, bmtime) && (bsize != h->bwt_size || bmtime != h->bwt_mtime)) {
+      std::cerr << "WARNING: BWA image " << path << " is older than the index for " << prefix
+		<< ". Loading the index files instead. Rerun svaba index-image" << std::endl;
+      ok = false;
+    }
+
+    if (!ok) {
+      munmap(base, st.st_size);
+      return nullptr;
+    }
+
+    // pointers into the mapping. is_shm keeps bwa_idx_destroy from freeing it
+    bwaidx_t * idx = (bwaidx_t*)calloc(1, sizeof(bwaidx_t));
+    bwa_mem2idx(h->l_mem, (uint8_t*)base + sizeof(BwaImageHeader), idx);
+    idx->is_shm = 1;
+
+    attached.insert(prefix);
+    return idx;
+  }
+
+  bool Load(const std::string& prefix, SeqLib::BWAWrapper * b) {
+
+    // the wrapper takes over the mapped index, and frees it like any other
+    // (bwa_idx_destroy leaves the mapping itself alone, since it is_shm)
+    bwaidx_t * idx = Attach(prefix);
+    if (idx) {
+      bwaidx_t *& cur = bwa_index(b);
+      if (cur)
+	bwa_idx_destroy(cur);
+      cur = idx;
+      return true;
+    }
+    return b->LoadIndex(prefix);
+  }
+
+  bool Attached(const std::string& prefix) {
+    return attached.count(prefix);
+  }
+
+  static const char* shortopts = "hG:o:";
+  static const struct option longopts[] = {
+    { "help",                    no_argument, NULL, 'h' },
+    { "reference-genome",        required_argument, NULL, 'G'},
+    { "output",                  required_argument, NULL, 'o'},
+    { NULL, 0, NULL, 0 }
+  };
+
+  static const char *IMAGE_USAGE_MESSAGE =
+    "Usage: svaba index-image -G ref.fa [-o ref.fa.img]\n\n"
+    "  Description: Write a BWA index as one block that svaba run maps into memory,\n"
+    "               instead of reading the index files. Processes on a node share one copy.\n"
+    "\n"
+    "  -h, --help                           Display this help and exit\n"
+    "  -G, --reference-genome               Path to the BWA-indexed reference genome\n"
+    "  -o, --output                         Image to write. Default is <reference>.img, which svaba run\n"
+    "                                       picks up automatically. Elsewhere (e.g. /dev/shm) needs --bwa-image\n"
+    "\n";
+
+  void runIndexImage(int argc, char** argv) {
+
+    std::string ref, out;
+    bool die = argc <= 2;
+
+    for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+      std::istringstream arg(optarg != NULL ? optarg : "");
+      switch (c) {
+      case 'G': arg >> ref; break;
+      case 'o': arg >> out; break;
+      default: die = true;
+      }
+    }
+
+    if (ref.empty())
+      die = true;
+
+    if (die) {
+      std::cerr << "\n" << IMAGE_USAGE_MESSAGE;
+      exit(EXIT_FAILURE);
+    }
+
+    if (out.empty())
+      out = DefaultPath(ref);
+
+    std::cerr << "...writing BWA image of " << ref << " to " << out << std::endl;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    if (!Write(ref, out)) {
+      std::cerr << "ERROR: Could not load BWA index " << ref << " or write image " << out << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    stat(out.c_str(), &st);
+    std::cerr << "...wrote " << svabaMemory::toString(st.st_size) << " image in "
+	      << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - t0).count()
+	      << " seconds" << std::endl;
+  }
+
+}
@@ -0,0 +1,53 @@
+#ifndef SVABA_BWA_IMAGE_H__
+#define SVABA_BWA_IMAGE_H__
+
+#include <string>
+
+#include "bwa/bwa.h"
+#include "SeqLib/BWAWrapper.h"
+
+/** Flat, prebuilt images of BWA indices that are mapped read-only into memory.
+ *
+ * bwa_idx_load reads the .bwt, .sa, .pac, .ann and .amb files onto the heap,
+ * which for a human reference is minutes of I/O and ~5 GB per process. An image
+ * is the same index laid out as one block (bwa_idx2mem), written once with
+ * svaba index-image. Loading it is an mmap, so startup is near instant and all
+ * of the processes on a node share one physical copy through the page cache.
+ * Put the image on /dev/shm to keep it in memory between runs.
+ *
+ * Load (used for the main and microbe indices) tries the image for a prefix
+ * first, and falls back to reading the index files if there is no image or
+ * it is out of date.
+ */
+namespace BwaImage {
+
+  /** Default image location for an index prefix (<prefix>.img) */
+  std::string DefaultPath(const std::string& prefix);
+
+  /** Use this image for an index prefix, instead of the default location */
+  void SetPath(const std::string& prefix, const std::string& image);
+
+  /** Load an index from its files and write it out as an image
+   * @return False if the index could not be loaded or the image not written
+   */
+  bool Write(const std::string& prefix, const std::string& image);
+
+  /** Load an index into an aligner, mapped from its image if there is one.
+   * @return False if neither the image nor the index files could be loaded
+   */
+  bool Load(const std::string& prefix, SeqLib::BWAWrapper * b);
+
+  /** Map the image for an index prefix.
+   * @return The index, or nullptr if there is no usable image
+   */
+  bwaidx_t * Attach(const std::string& prefix);
+
+  /** Was the index for this prefix mapped from an image? */
+  bool Attached(const std::string& prefix);
+
+  /** Entry point for svaba index-image */
+  void runIndexImage(int argc, char** argv);
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include "ContigAlignmentCache.h"
+
+#include <sstream>
+#include <iomanip>
+#include <functional>
+
+#include "SeqLib/SeqLibUtils.h"
+
+ContigAlignmentCache::ContigAlignmentCache() {
+  pthread_mutex_init(&m_mutex, NULL);
+}
+
+ContigAlignmentCache::~ContigAlignmentCache() {
+  pthread_mutex_destroy(&m_mutex);
+}
+
+// deep copies of the records, optionally renamed
+static void copy_records(const SeqLib::BamRecordVector& from, SeqLib::BamRecordVector& to, const std::string& name) {
+  to.reserve(to.size() + from.size());
+  for (const auto& r : from) {
+    SeqLib::BamRecord c;
+    c.assign(bam_dup1(r.raw()));
+    if (!name.empty())
+      c.SetQname(name);
+    to.push_back(c);
+  }
+}
+
+bool ContigAlignmentCache::Get(const std::string& seq, const std::string& name,
+			       SeqLib::BamRecordVector& genome, SeqLib::BamRecordVector& microbe) {
+
+  size_t key = std::hash<std::string>()(seq);
+
+  pthread_mutex_lock(&m_mutex);
+
+  auto ff = m_map.find(key);
+  if (ff == m_map.end() || ff->second.seq != seq) {
+    ++m_misses;
+    pthread_mutex_unlock(&m_mutex);
+    return false;
+  }
+
+  ++m_hits;
+  m_lru.splice(m_lru.begin(), m_lru, ff->second.lru);
+
+  // copy out while locked, so an eviction can't pull the records out from under us
+  copy_records(ff->second.genome, genome, name);
+  copy_records(ff->second.microbe, microbe, name);
+
+  pthread_mutex_unlock(&m_mutex);
+  return true;
+}
+
+void ContigAlignmentCache::Put(const std::string& seq, const SeqLib::BamRecordVector& genome,
+			       const SeqLib::BamRecordVector& microbe) {
+
+  // make the copies outside of the lock
+  Entry e;
+  e.seq = seq;
+  copy_records(genome, e.genome, std::string());
+  copy_records(microbe, e.microbe, std::string());
+  size_t b = svabaMemory::bytes(e.genome) + svabaMemory::bytes(e.microbe) + seq.capacity();
+  e.bytes = b;
+
+  if (b > m_max_bytes / 4)
+    return;
+
+  size_t key = std::hash<std::string>()(seq);
+
+  pthread_mutex_lock(&m_mutex);
+
+  // another thread may have aligned the same contig in the meantime. On
+  // the rare hash collision the first sequence keeps the slot
+  if (m_map.count(key)) {
+    pthread_mutex_unlock(&m_mutex);
+    return;
+  }
+
+  // evict least recently used contigs until there is room
+  size_t freed = 0;
+  while (m_bytes + b > m_max_bytes && !m_lru.empty()) {
+    auto ff = m_map.find(m_lru.back());
+    m_bytes -= ff->second.bytes;
+    freed += ff->second.bytes;
+    m_map.erase(ff);
+    m_lru.pop_back();
+    ++m_evictions;
+  }
+
+  m_lru.push_front(key);
+  e.lru = m_lru.begin();
+  m_map[key] = std::move(e);
+  m_bytes += b;
+
+  pthread_mutex_unlock(&m_mutex);
+
+  if (m_gov) {
+    m_gov->Add(b);
+    m_gov->Release(freed);
+  }
+
+}
+
+std::string ContigAlignmentCache::Stats() const {
+
+  pthread_mutex_lock(&m_mutex);
+
+  std::stringstream ss;
+  size_t lookups = m_hits + m_misses;
+  ss << "...contig alignment cache: " << SeqLib::AddCommas(m_hits) << " hits, "
+     << SeqLib::AddCommas(m_misses) << " misses";
+  if (lookups)
+    ss << " (" << std::fixed << std::setprecision(1) << (100.0 * m_hits / lookups) << "% hit rate)";
+  ss << ", " << SeqLib::AddCommas(m_evictions) << " evictions. Holding "
+     << svabaMemory::toString(m_bytes) << " in " << SeqLib::AddCommas(m_map.size()) << " contigs";
+
+  pthread_mutex_unlock(&m_mutex);
+
+  return ss.str();
+}
@@ -0,0 +1,81 @@
+#ifndef SVABA_CONTIG_ALIGNMENT_CACHE_H__
+#define SVABA_CONTIG_ALIGNMENT_CACHE_H__
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "SeqLib/BamRecord.h"
+#include "svabaMemory.h"
+
+/** Thread-shared LRU cache of the genome and microbe alignments of contigs.
+ *
+ * Adjacent windows overlap by WINDOW_PAD, and mate lookups pull the same
+ * reads into several windows, so the same contig is often assembled more
+ * than once. Entries are keyed by a hash of the contig sequence (checked
+ * against the sequence itself on a hit). The alignments handed out are
+ * deep copies renamed to the contig asking, since tags are added to them
+ * downstream. Alignments to the local region are not cached, as they
+ * depend on the window.
+ */
+class ContigAlignmentCache {
+
+ public:
+
+  ContigAlignmentCache();
+
+  ~ContigAlignmentCache();
+
+  /** Set the max size of the cached alignments, in bytes. 0 turns off the cache */
+  void SetMaxBytes(size_t b) { m_max_bytes = b; }
+
+  /** Charge cached alignments against a memory governor */
+  void SetGovernor(svabaMemoryGovernor * g) { m_gov = g; }
+
+  bool Enabled() const { return m_max_bytes > 0; }
+
+  /** Get the alignments of a contig sequence, if cached
+   * @param seq Contig sequence
+   * @param name Name of the contig, given to the alignments
+   * @param genome Alignments to the genome
+   * @param microbe Alignments to the microbial genome
+   * @return False if the sequence is not cached
+   */
+  bool Get(const std::string& seq, const std::string& name,
+	   SeqLib::BamRecordVector& genome, SeqLib::BamRecordVector& microbe);
+
+  /** Cache the alignments of a contig sequence */
+  void Put(const std::string& seq, const SeqLib::BamRecordVector& genome,
+	   const SeqLib::BamRecordVector& microbe);
+
+  /** Hit rate etc. for the log */
+  std::string Stats() const;
+
+ private:
+
+  struct Entry {
+    std::string seq;
+    SeqLib::BamRecordVector genome;
+    SeqLib::BamRecordVector microbe;
+    size_t bytes = 0;
+    std::list<size_t>::iterator lru; // position in the LRU list
+  };
+
+  std::unordered_map<size_t, Entry> m_map;
+  std::list<size_t> m_lru; // most recently used at the front
+
+  size_t m_max_bytes = 0;
+  size_t m_bytes = 0;
+
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+  size_t m_evictions = 0;
+
+  svabaMemoryGovernor * m_gov = nullptr;
+
+  mutable pthread_mutex_t m_mutex;
+
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "ContigReadIndex.h"
+
+#include <algorithm>
+#include <numeric>
+
+// in BreakPoint.cpp
+bool __check_homopolymer(const std::string& s);
+
+ContigReadIndex::ContigReadIndex(svabaReadVector& reads, const std::string& cname) {
+
+  size_t n = reads.size();
+  m_r2c.reserve(n);
+  m_indel.reserve(n);
+  m_homopolymer.reserve(n);
+
+  for (auto& j : reads) {
+    r2c& c = j.GetR2C(cname);
+    m_r2c.push_back(&c);
+
+    bool indel = false;
+    for (auto& i : c.cig)
+      if (i.Type() == 'D' || i.Type() == 'I') {
+	indel = true;
+	break;
+      }
+    m_indel.push_back(indel);
+    m_homopolymer.push_back(__check_homopolymer(j.Sequence()));
+  }
+
+  std::vector<uint32_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return m_r2c[a]->start_on_contig < m_r2c[b]->start_on_contig;
+    });
+
+  m_start.reserve(n);
+  m_end.reserve(n);
+  m_read = order;
+  for (auto i : order) {
+    m_start.push_back(m_r2c[i]->start_on_contig);
+    m_end.push_back(m_r2c[i]->end_on_contig);
+    m_max_span = std::max(m_max_span, m_end.back() - m_start.back());
+  }
+}
+
+void ContigReadIndex::Spanning(int left, int right, std::vector<size_t>& out) const {
+
+  out.clear();
+
+  // a read spanning right starts no earlier than right - m_max_span,
+  // and to span left, it starts no later than left
+  size_t lo = std::lower_bound(m_start.begin(), m_start.end(), right - m_max_span) - m_start.begin();
+  size_t hi = std::upper_bound(m_start.begin(), m_start.end(), left) - m_start.begin();
+
+  // then a flat pass over the ends of that run
+  for (size_t k = lo; k < hi; ++k)
+    if (m_end[k] >= right)
+      out.push_back(m_read[k]);
+
+  // back to the order of the reads, which the split counting depends on
+  std::sort(out.begin(), out.end());
+}
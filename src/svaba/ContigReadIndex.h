@@ -0,0 +1,52 @@
+#ifndef SVABA_CONTIG_READ_INDEX_H__
+#define SVABA_CONTIG_READ_INDEX_H__
+
+#include <string>
+#include <vector>
+
+#include "svabaRead.h"
+
+/** The read-to-contig alignments of the reads of one contig, for counting
+ * split reads at its breakpoints.
+ *
+ * Built once per contig, so each breakpoint doesn't look up every read's
+ * r2c by contig name, and re-walk its CIGAR. Spans are kept sorted by
+ * start on the contig, so a breakpoint visits only the reads that span it.
+ */
+class ContigReadIndex {
+
+ public:
+
+  /** Index the reads aligned to a contig (every read must have an r2c for it) */
+  ContigReadIndex(svabaReadVector& reads, const std::string& cname);
+
+  /** Indices of the reads that start at or before left and end at or after
+   * right on the contig, in read order */
+  void Spanning(int left, int right, std::vector<size_t>& out) const;
+
+  /** r2c alignment of the i'th read */
+  r2c& R2C(size_t i) const { return *m_r2c[i]; }
+
+  /** Does the r2c alignment of the i'th read have an insertion or deletion */
+  bool HasIndel(size_t i) const { return m_indel[i]; }
+
+  /** Is the i'th read a nasty repeat */
+  bool Homopolymer(size_t i) const { return m_homopolymer[i]; }
+
+ private:
+
+  // per read, in read order
+  std::vector<r2c*> m_r2c;
+  std::vector<char> m_indel;
+  std::vector<char> m_homopolymer;
+
+  // spans sorted by start, with the read each came from
+  std::vector<int32_t> m_start;
+  std::vector<int32_t> m_end;
+  std::vector<uint32_t> m_read;
+
+  int32_t m_max_span = 0;
+
+};
+
+#endif
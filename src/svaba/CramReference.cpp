@@ -0,0 +1,79 @@
+#include "CramReference.h"
+
+CramReference::CramReference() {
+  m_tp.pool = nullptr;
+  m_tp.qsize = 0;
+  pthread_mutex_init(&m_mutex, NULL);
+}
+
+CramReference::~CramReference() {
+  if (m_fp && m_own_fp)
+    hts_close(m_fp);
+  if (m_pool)
+    hts_tpool_destroy(m_pool);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+bool CramReference::IsCram(const std::string& file) {
+
+  htsFile * fp = hts_open(file.c_str(), "r");
+  if (!fp)
+    return false;
+  bool is_cram = IsCram(fp);
+  hts_close(fp);
+  return is_cram;
+}
+
+bool CramReference::IsCram(htsFile * fp) {
+  return fp && hts_get_format(fp)->format == cram;
+}
+
+bool CramReference::Init(const std::string& fasta, const std::string& cram, int threads) {
+
+  htsFile * fp = hts_open(cram.c_str(), "r");
+  if (!fp)
+    return false;
+  if (!Init(fasta, fp, threads)) {
+    hts_close(fp);
+    return false;
+  }
+  m_own_fp = true;
+  return true;
+}
+
+bool CramReference::Init(const std::string& fasta, htsFile * cram, int threads) {
+
+  m_fasta = fasta;
+
+  if (!IsCram(cram) || hts_set_fai_filename(cram, m_fasta.c_str()) != 0)
+    return false;
+
+  // sequences are loaded into this lazily, as readers ask for them
+  m_refs = cram_get_refs(cram);
+  if (!m_refs)
+    return false;
+  m_fp = cram;
+
+  if (threads > 0) {
+    m_pool = hts_tpool_init(threads);
+    m_tp.pool = m_pool;
+  }
+
+  return true;
+}
+
+bool CramReference::Attach(htsFile * fp) {
+
+  if (!IsCram(fp))
+    return false;
+
+  // setting the shared ref bumps a non-atomic count on the refs_t
+  pthread_mutex_lock(&m_mutex);
+  if (m_refs)
+    hts_set_opt(fp, CRAM_OPT_SHARED_REF, m_refs);
+  if (m_pool)
+    hts_set_opt(fp, HTS_OPT_THREAD_POOL, &m_tp);
+  pthread_mutex_unlock(&m_mutex);
+
+  return true;
+}
@@ -0,0 +1,72 @@
+#ifndef SVABA_CRAM_REFERENCE_H__
+#define SVABA_CRAM_REFERENCE_H__
+
+#include <pthread.h>
+#include <string>
+
+#include "htslib/hts.h"
+#include "htslib/cram.h"
+
+/** Reference sequence shared by all of the CRAM readers in the process.
+ *
+ * Every htsFile opened on a CRAM normally loads and decodes its own copy
+ * of each reference slice it touches, so with one walker per BAM per
+ * thread the same chromosome would be held many times over. Here one
+ * reference (the fasta the BWA index was built from) is loaded once and
+ * every reader borrows it, along with a shared pool of threads for
+ * decoding slices.
+ */
+class CramReference {
+
+ public:
+
+  CramReference();
+
+  ~CramReference();
+
+  /** Load the reference for decoding
+   * @param fasta Reference fasta (with a .fai)
+   * @param cram Any one of the input CRAMs (not stdin), opened to hold the reference
+   * @param threads Number of threads for decoding slices. 0 for none
+   * @return False if the CRAM could not be opened with this reference
+   */
+  bool Init(const std::string& fasta, const std::string& cram, int threads);
+
+  /** Load the reference for decoding into an input CRAM that is already
+   * open (e.g. stdin), which then holds it. The file has to stay open until
+   * the other readers are done with the reference
+   * @return False if the reference could not be set on the CRAM
+   */
+  bool Init(const std::string& fasta, htsFile * cram, int threads);
+
+  bool Enabled() const { return m_refs != nullptr; }
+
+  const std::string& Fasta() const { return m_fasta; }
+
+  /** Point an open CRAM at the shared reference and decoding pool.
+   * @return True if the file is a CRAM (and so was attached)
+   */
+  bool Attach(htsFile * fp);
+
+  /** Is this file a CRAM? Opens it, so not for stdin */
+  static bool IsCram(const std::string& file);
+
+  /** Is this open file a CRAM? */
+  static bool IsCram(htsFile * fp);
+
+ private:
+
+  std::string m_fasta;
+
+  htsFile * m_fp = nullptr; // owns the shared refs_t
+  bool m_own_fp = false; // opened here, rather than an input's reader
+  refs_t * m_refs = nullptr;
+
+  hts_tpool * m_pool = nullptr;
+  htsThreadPool m_tp;
+
+  pthread_mutex_t m_mutex;
+
+};
+
+#endif
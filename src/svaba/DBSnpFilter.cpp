@@ -1,126 +1,333 @@
 #include "DBSnpFilter.h"
 #include "gzstream.h"
 
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <algorithm>
+
 using namespace SeqLib;
 
-DBSnpSite::DBSnpSite(const std::string& tchr, const std::string& pos, const std::string& rs, const std::string& ref, const std::string& alt, const BamHeader& h) {
-    
-    // make the genomic region
-    try { 
-      GenomicRegion gr(tchr, pos, pos, h);
-      chr = gr.chr; 
-      pos1 = std::stoi(pos);
-    } catch (...) {
-      //std::cerr << "DBSnpSite: Error trying to convert " << tchr << ":" << pos << " to number" << std::endl;
+#define DBSNP_INDEX_MAGIC "SVBADBS1"
+
+// layout of an index: this header, a table entry per chromosome, the
+// chromosome names (NUL terminated, padded to 8 bytes), then the sites
+// of every chromosome, each sorted by start
+struct DBSnpIndexHeader {
+  char magic[8];
+  uint32_t n_chr;
+  uint32_t names_bytes; // including padding
+  uint64_t n_sites;
+};
+
+struct DBSnpIndexChr {
+  uint64_t offset; // first site of the chromosome
+  uint64_t count;
+  int32_t max_span;
+  int32_t pad;
+};
+
+typedef std::map<std::string, std::vector<DBSnpSite> > DBSnpSiteMap; // key is chr name
+
+// read the indel sites of a DBSnp VCF, by chromosome name
+static bool parse_dbsnp(const std::string& db, DBSnpSiteMap& sites) {
+
+  igzstream in(db.c_str());
+  if (!read_access_test(db) || !in) {
+    std::cerr << std::endl << "**** Cannot read DBSnp database " << db << "   Expecting a VCF file" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+
+    if (line.length() == 0 || line[0] == '#')
+      continue;
+
+    // only need chr, pos, rs, ref and alt
+    size_t f[5], start = 0;
+    int nf = 0;
+    for (; nf < 5; ++nf) {
+      size_t t = line.find('\t', start);
+      f[nf] = start;
+      if (t == std::string::npos) {
+	++nf;
+	break;
+      }
+      start = t + 1;
     }
+    if (nf < 5)
+      continue;
 
-    //m_rs = rs;
-    //m_ref = ref;
-    //m_alt = alt;
+    size_t ref_len = f[4] - f[3] - 1;
+    size_t alt_end = line.find('\t', f[4]);
+    size_t alt_len = (alt_end == std::string::npos ? line.length() : alt_end) - f[4];
 
-    if (ref.length() == 0 || alt.length() == 0) // || m_rs.length() == 0)
-      std::cerr << "DBSnpSite: Is the VCF formated correctly for this entry? Ref " << ref << " ALT " << alt << " rs " << rs << std::endl;
+    if (ref_len == 0 || alt_len == 0)
+      std::cerr << "DBSnpSite: Is the VCF formated correctly for this entry? " << line.substr(0, 100) << std::endl;
+
+    // for now reject SNP sites
+    if (ref_len + alt_len <= 2)
+      continue;
+
+    DBSnpSite s;
+    try {
+      s.pos1 = std::stoi(line.substr(f[1], f[2] - f[1] - 1));
+    } catch (...) {
+      continue;
+    }
 
     // insertion
-    if (ref.length() == 1)
-      pos2 = pos1 + 1;
+    if (ref_len == 1)
+      s.pos2 = s.pos1 + 1;
     // deletion
     else
-      pos2 = pos1 + ref.length() + 1;
-    
+      s.pos2 = s.pos1 + ref_len + 1;
+
+    sites[line.substr(0, f[1] - 1)].push_back(s);
   }
 
+  return true;
+}
+
 DBSnpFilter::DBSnpFilter(const std::string& db, const BamHeader& h) {
-    
-    // read in the file
-    if (!read_access_test(db)) {
-      std::cerr << std::endl << "**** Cannot read DBSnp database " << db << "   Expecting a VCF file" << std::endl;
-      return;
-    }
 
-    // read it in
-    igzstream in(db.c_str());
-    if (!in) {
-      std::cerr << std::endl << "**** Cannot read DBSnp database " << db << "   Expecting a VCF file" << std::endl;
-      return;
-    }
+  m_chr.resize(h.NumSequences());
 
-    std::string line;
-    while (std::getline(in, line)) {
-
-      if (line.find("#") != std::string::npos || line.length() == 0)
-	continue;
-
-      std::istringstream thisline(line);
-      std::string val;
-      int this_count = -1;
-      std::string chr, pos, rs, ref, alt;
-      while (std::getline(thisline, val, '\t')) {
-	++this_count;
-	switch (this_count) { 
-	case 0: chr = val; break;
-	case 1: pos = val; break;
-	case 2: rs = val; break;
-	case 3: ref = val; break;
-	case 4: alt = val; break;
-	}
-      }
+  // use the index, if given one or one is sitting next to the VCF
+  std::string index = IndexPath(db);
+  struct stat vst, ist;
+  bool has_index = stat(index.c_str(), &ist) == 0 && stat(db.c_str(), &vst) == 0 && ist.st_mtime >= vst.st_mtime;
+  if (mapIndex(db, h) || (has_index && mapIndex(index, h)))
+    return;
 
-      DBSnpSite db(chr, pos, rs, ref, alt, h);
-
-      // for now reject SNP sites
-      if (ref.length() + alt.length() > 2) {
-	m_sites.add(db);
-
-	// make the hash
-	cig.str(std::string());
-	//cig << db.chr << "_" << db.pos1 << "_" << (db.pos2-db.pos1) << (db.m_ref.length() == 1 ? "I" : "D");
-	cig << db.chr << "_" << db.pos1;
-	//m_hash.insert(cig.str());
-	
-	m_int_hash.insert(hasher(cig.str()));
-	//std::cerr << line << " hash " << cig.str() << std::endl;
-	
-      }
-    }
-    
-    // build the tree
-    m_sites.CreateTreeMap();
+  loadVCF(db, h);
+}
+
+DBSnpFilter::~DBSnpFilter() {
+  if (m_map)
+    munmap(m_map, m_map_size);
+}
+
+std::string DBSnpFilter::IndexPath(const std::string& vcf) {
+  return vcf + ".svdb";
+}
 
+void DBSnpFilter::loadVCF(const std::string& db, const BamHeader& h) {
+
+  DBSnpSiteMap sites;
+  if (!parse_dbsnp(db, sites))
+    return;
+
+  // pack the chromosomes in the BAM into one block
+  size_t n = 0;
+  for (auto& c : sites)
+    if (h.Name2ID(c.first) >= 0)
+      n += c.second.size();
+  m_loaded.reserve(n);
+
+  std::vector<std::pair<int, size_t> > starts;
+  for (auto& c : sites) {
+    int id = h.Name2ID(c.first);
+    if (id < 0 || id >= (int)m_chr.size())
+      continue;
+    std::sort(c.second.begin(), c.second.end());
+    starts.push_back(std::pair<int, size_t>(id, m_loaded.size()));
+    for (const auto& s : c.second)
+      m_chr[id].max_span = std::max(m_chr[id].max_span, s.pos2 - s.pos1);
+    m_chr[id].count = c.second.size();
+    m_loaded.insert(m_loaded.end(), c.second.begin(), c.second.end());
+    std::vector<DBSnpSite>().swap(c.second);
   }
 
-  std::ostream& operator<<(std::ostream& out, const DBSnpFilter& d) {
-    out << "DBSnpFilter with a total of " << AddCommas<size_t>(d.m_sites.size());
-    return out;
+  // point into the block once it is done moving
+  for (const auto& s : starts)
+    m_chr[s.first].sites = m_loaded.data() + s.second;
+  m_num_sites = m_loaded.size();
+}
+
+bool DBSnpFilter::mapIndex(const std::string& index, const BamHeader& h) {
+
+  int fd = open(index.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DBSnpIndexHeader)) {
+    close(fd);
+    return false;
   }
 
-  std::ostream& operator<<(std::ostream& out, const DBSnpSite& d) {
-    //out << d.chr << ":" << d.pos1 << "-" << d.pos2 << "\t" << d.m_rs << " REF " << d.m_ref << " ALT " << d.m_alt;
-    out << d.chr << ":" << d.pos1 << "-" << d.pos2;;
-    return out;
+  void * base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  // check it is an index, and all there
+  const DBSnpIndexHeader * hdr = (const DBSnpIndexHeader*)base;
+  bool ok = memcmp(hdr->magic, DBSNP_INDEX_MAGIC, 8) == 0 &&
+    sizeof(DBSnpIndexHeader) + hdr->n_chr * sizeof(DBSnpIndexChr) + hdr->names_bytes +
+    hdr->n_sites * sizeof(DBSnpSite) == (uint64_t)st.st_size;
+  if (!ok) {
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  m_map = base;
+  m_map_size = st.st_size;
+
+  const DBSnpIndexChr * table = (const DBSnpIndexChr*)((const char*)base + sizeof(DBSnpIndexHeader));
+  const char * name = (const char*)(table + hdr->n_chr);
+  const DBSnpSite * sites = (const DBSnpSite*)(name + hdr->names_bytes);
+
+  for (uint32_t i = 0; i < hdr->n_chr; ++i) {
+    int id = h.Name2ID(name);
+    name += strlen(name) + 1;
+    if (id < 0 || id >= (int)m_chr.size())
+      continue;
+    m_chr[id].sites = sites + table[i].offset;
+    m_chr[id].count = table[i].count;
+    m_chr[id].max_span = table[i].max_span;
+    m_num_sites += table[i].count;
   }
 
-  bool DBSnpFilter::queryHash(const std::string& h) const {
-    //return m_hash.count(h);
-    return m_int_hash.count(hasher(h));
+  return true;
+}
+
+int64_t DBSnpFilter::WriteIndex(const std::string& vcf, const std::string& index) {
+
+  DBSnpSiteMap sites;
+  if (!parse_dbsnp(vcf, sites))
+    return -1;
+
+  DBSnpIndexHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, DBSNP_INDEX_MAGIC, 8);
+  hdr.n_chr = sites.size();
+
+  std::vector<DBSnpIndexChr> table;
+  std::string names;
+  for (auto& c : sites) {
+    std::sort(c.second.begin(), c.second.end());
+    DBSnpIndexChr t;
+    memset(&t, 0, sizeof(t));
+    t.offset = hdr.n_sites;
+    t.count = c.second.size();
+    for (const auto& s : c.second)
+      t.max_span = std::max(t.max_span, s.pos2 - s.pos1);
+    table.push_back(t);
+    hdr.n_sites += c.second.size();
+    names += c.first;
+    names.push_back('\0');
+  }
+  while (names.size() % 8)
+    names.push_back('\0');
+  hdr.names_bytes = names.size();
+
+  // write to a temp file and move it in, so a reader never maps a partial index
+  std::string tmp = index + ".tmp";
+  FILE * fp = fopen(tmp.c_str(), "wb");
+  bool ok = fp && fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+    fwrite(table.data(), sizeof(DBSnpIndexChr), table.size(), fp) == table.size() &&
+    fwrite(names.data(), 1, names.size(), fp) == names.size();
+  for (auto& c : sites)
+    ok = ok && fwrite(c.second.data(), sizeof(DBSnpSite), c.second.size(), fp) == c.second.size();
+  if (fp)
+    ok = (fclose(fp) == 0) && ok;
+  ok = ok && rename(tmp.c_str(), index.c_str()) == 0;
+  if (!ok) {
+    unlink(tmp.c_str());
+    return -1;
+  }
+
+  return hdr.n_sites;
+}
+
+  std::ostream& operator<<(std::ostream& out, const DBSnpFilter& d) {
+    out << "DBSnpFilter with a total of " << AddCommas<size_t>(d.m_num_sites)
+	<< (d.m_map ? " (mapped index)" : "");
+    return out;
   }
 
   bool DBSnpFilter::queryBreakpoint(BreakPoint& bp) {
-    
-    std::vector<int32_t> sub, que;
+
     GenomicRegion gr = bp.b1.gr;
     gr.Pad(2);
-    GRC subject(gr);
-    GRC out = subject.FindOverlaps(m_sites, sub, que, true); // true = ignore_strand
-    
-    if (que.size()) {
-      //bp.rs = m_sites[sub[0]].m_rs;
-      bp.rs = "D"; 
-      //for (auto& j : que) {
-      //bp.rs += m_sites[j].m_rs + "_";
-      //}
-      //bp.rs.pop_back(); // just drop the last comma
-      return true;
+    if (gr.chr < 0 || gr.chr >= (int)m_chr.size())
+      return false;
+    const ChrSites& c = m_chr[gr.chr];
+
+    // walk back from the first site starting after the query, over
+    // the sites that start close enough to still reach it
+    const DBSnpSite * s = std::upper_bound(c.sites, c.sites + c.count, gr.pos2,
+					   [](int32_t p, const DBSnpSite& d) { return p < d.pos1; });
+    while (s != c.sites) {
+      --s;
+      if (s->pos1 < gr.pos1 - c.max_span)
+	break;
+      if (s->pos2 >= gr.pos1) {
+	bp.rs = "D";
+	return true;
+      }
     }
     return false;
   }
+
+static const char* shortopts = "hD:o:";
+static const struct option longopts[] = {
+  { "help",                    no_argument, NULL, 'h' },
+  { "dbsnp-vcf",               required_argument, NULL, 'D'},
+  { "output",                  required_argument, NULL, 'o'},
+  { NULL, 0, NULL, 0 }
+};
+
+static const char *DBSNP_USAGE_MESSAGE =
+  "Usage: svaba index-dbsnp -D dbsnp.vcf [-o dbsnp.vcf.svdb]\n\n"
+  "  Description: Write the indel sites of a DBSnp VCF as a binary index that svaba maps into\n"
+  "               memory, instead of parsing the VCF on every run.\n"
+  "\n"
+  "  -h, --help                           Display this help and exit\n"
+  "  -D, --dbsnp-vcf                      DBSnp database (VCF) to index\n"
+  "  -o, --output                         Index to write. Default is <vcf>.svdb, which svaba run picks up\n"
+  "                                       automatically with -D <vcf>. An index elsewhere can be given to -D directly\n"
+  "\n";
+
+void runIndexDBSnp(int argc, char** argv) {
+
+  std::string vcf, out;
+  bool die = argc <= 2;
+
+  for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    switch (c) {
+    case 'D': arg >> vcf; break;
+    case 'o': arg >> out; break;
+    default: die = true;
+    }
+  }
+
+  if (vcf.empty())
+    die = true;
+
+  if (die) {
+    std::cerr << "\n" << DBSNP_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+
+  if (out.empty())
+    out = DBSnpFilter::IndexPath(vcf);
+
+  std::cerr << "...indexing DBSnp indels of " << vcf << " to " << out << std::endl;
+  int64_t n = DBSnpFilter::WriteIndex(vcf, out);
+  if (n < 0) {
+    std::cerr << "ERROR: Could not read " << vcf << " or write " << out << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cerr << "...wrote " << AddCommas<int64_t>(n) << " indel sites" << std::endl;
+}
@@ -4,61 +4,85 @@
 #include <vector>
 #include <cstring>
 #include <iostream>
-#include <unordered_set>
-#include <functional> //for std::hash
+#include <cstdint>
 
-#include "SeqLib/GenomicRegionCollection.h"
 #include "SeqLib/BamHeader.h"
 
 #include "BreakPoint.h"
 
-class DBSnpSite: public SeqLib::GenomicRegion {
+/** An indel site from DBSnp, as the span it covers on its chromosome.
+ * This is also the record layout of the binary index */
+struct DBSnpSite {
 
-  public:
-
-  DBSnpSite(const std::string& tchr, const std::string& pos, const std::string& rs, const std::string& ref, const std::string& alt, const SeqLib::BamHeader& h);
+  int32_t pos1;
+  int32_t pos2;
 
-    //std::string m_rs;
-    //std::string m_ref;
-    //std::string m_alt;
-
-    friend std::ostream& operator<<(std::ostream& out, const DBSnpSite& d);
-    
-  };
+  bool operator<(const DBSnpSite& s) const { return pos1 < s.pos1 || (pos1 == s.pos1 && pos2 < s.pos2); }
 
-typedef SeqLib::GenomicRegionCollection<DBSnpSite> DBC;
+};
 
+  /** DBSnp indel sites, as per-chromosome arrays sorted by start.
+   *
+   * The sites come from either the DBSnp VCF, which is parsed into memory, or
+   * from a binary index written by svaba index-dbsnp, which is mapped read-only
+   * so that it loads instantly and is shared between processes through the
+   * page cache. A VCF with an up-to-date index next to it (<vcf>.svdb) uses the index.
+   */
   class DBSnpFilter {
-    
+
   public:
 
     DBSnpFilter() {}
 
-    DBSnpFilter(const std::string& db, const SeqLib::BamHeader& h); 
+    DBSnpFilter(const std::string& db, const SeqLib::BamHeader& h);
+
+    ~DBSnpFilter();
 
-    /** Test whether the variant overlaps a DBSnp site 
+    DBSnpFilter(const DBSnpFilter&) = delete;
+    DBSnpFilter& operator=(const DBSnpFilter&) = delete;
+
+    /** Test whether the variant overlaps a DBSnp site
      * If it does, fill the BreakPoint rs field
      */
     bool queryBreakpoint(BreakPoint& bp);
 
-    bool queryRead(const SeqLib::BamRecord& r) const;
+    /** Default location of the index for a DBSnp VCF (<vcf>.svdb) */
+    static std::string IndexPath(const std::string& vcf);
+
+    /** Parse a DBSnp VCF and write its indel sites as a binary index
+     * @return Number of sites written, or -1 if the VCF or output could not be opened
+     */
+    static int64_t WriteIndex(const std::string& vcf, const std::string& index);
 
-    bool queryHash(const std::string& r) const;
-    
     friend std::ostream& operator<<(std::ostream& out, const DBSnpFilter& d);
 
   private:
 
-    std::hash<std::string> hasher;
-    
-    // initialize here once
-    std::stringstream cig;
+    // the sites of one chromosome
+    struct ChrSites {
+      const DBSnpSite * sites = nullptr;
+      size_t count = 0;
+      int32_t max_span = 0; // longest site, bounds how far back a query looks
+    };
+
+    std::vector<ChrSites> m_chr; // indexed by BAM header chr id
+
+    size_t m_num_sites = 0;
+
+    // backing store when parsed from the VCF
+    std::vector<DBSnpSite> m_loaded;
 
-    DBC m_sites;
-    std::unordered_set<std::string> m_hash;
+    // backing store when mapped from an index
+    void * m_map = nullptr;
+    size_t m_map_size = 0;
+
+    bool mapIndex(const std::string& index, const SeqLib::BamHeader& h);
+
+    void loadVCF(const std::string& db, const SeqLib::BamHeader& h);
 
-    std::unordered_set<size_t> m_int_hash;
-    
   };
 
+/** Entry point for svaba index-dbsnp */
+void runIndexDBSnp(int argc, char** argv);
+
 #endif
@@ -445,7 +445,7 @@ using namespace SeqLib;
 
   
   // define how to print to file
-  std::string DiscordantCluster::toFileString(bool with_read_names /* false */) const 
+  std::string DiscordantCluster::toFileString(const SeqLib::BamHeader& h, bool with_read_names /* false */) const 
   { 
     
     std::string sep = "\t";
@@ -480,12 +480,13 @@ using namespace SeqLib;
 	  reads_string.pop_back(); // delete last comma
       }
     
-    int pos1 = m_reg1.strand == '+' ? m_reg1.pos2 : m_reg1.pos1; // get the edge of the cluster
-    int pos2 = m_reg2.strand == '+' ? m_reg2.pos2 : m_reg2.pos1;
+    int pos1 = EdgePos1(); // get the edge of the cluster
+    int pos2 = EdgePos2();
 
+    // contig names, so the tabix index can be queried by them
     std::stringstream out;
-    out << m_reg1.chr+1 << sep << pos1 << sep << m_reg1.strand << sep 
-	<< m_reg2.chr+1 << sep << pos2 << sep << m_reg2.strand << sep 
+    out << m_reg1.ChrName(h) << sep << pos1 << sep << m_reg1.strand << sep 
+	<< m_reg2.ChrName(h) << sep << pos2 << sep << m_reg2.strand << sep 
 	<< tcount << sep << ncount << sep << tcount_hq << sep << ncount_hq
 	<< sep << mapq1 << sep 
 	<< mapq2 << sep << (m_contig.length() ? m_contig : "x") << sep << toRegionString()
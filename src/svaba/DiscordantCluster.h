@@ -57,7 +57,11 @@ typedef std::vector<svabaReadVector> svabaReadClusterVector;
     friend std::ostream& operator<<(std::ostream& out, const DiscordantCluster& dc);
     
     /** Return as a string for writing to a file */
-    std::string toFileString(bool with_read_names = false) const;
+    std::string toFileString(const SeqLib::BamHeader& h, bool with_read_names = false) const;
+
+    /** Position of the inner edge of each side, as written to file */
+    int EdgePos1() const { return m_reg1.strand == '+' ? m_reg1.pos2 : m_reg1.pos1; }
+    int EdgePos2() const { return m_reg2.strand == '+' ? m_reg2.pos2 : m_reg2.pos1; }
     
     /** Sort by coordinate */
     bool operator < (const DiscordantCluster& b) const;
@@ -0,0 +1,35 @@
+#ifndef SVABA_INDEL_KEY_H__
+#define SVABA_INDEL_KEY_H__
+
+#include <cstdint>
+
+/** 64-bit sort keys of indel sites, shared by the read CIGAR counts
+ * (PackedCigarMap) and the panel of normals (PONFilter).
+ *
+ * Chromosome (19 bits), position on the reference (31), length (13) and
+ * a bit set for deletions, in that order, so keys sort by site. A length
+ * of 0 is a site with no type or length, which stands for any indel
+ * starting there.
+ */
+namespace IndelKey {
+
+  const uint32_t MAX_CHR = (1U << 19) - 1;
+  const uint32_t MAX_LEN = (1U << 13) - 1;
+
+  /** Does the site fit in a key? */
+  inline bool Fits(int32_t chr, int32_t pos, uint32_t len) {
+    return chr >= 0 && pos >= 0 && (uint32_t)chr <= MAX_CHR && len <= MAX_LEN;
+  }
+
+  /** Key of a site that Fits */
+  inline uint64_t Pack(int32_t chr, int32_t pos, uint32_t len, bool del) {
+    return ((uint64_t)chr << 45) | ((uint64_t)pos << 14) | ((uint64_t)len << 1) | (del ? 1 : 0);
+  }
+
+  inline uint32_t Length(uint64_t key) { return (key >> 1) & MAX_LEN; }
+
+  inline bool IsDeletion(uint64_t key) { return key & 1; }
+
+}
+
+#endif
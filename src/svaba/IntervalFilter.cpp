@@ -0,0 +1,164 @@
+#include "IntervalFilter.h"
+
+#include <algorithm>
+
+IntervalFilter::IntervalFilter(const SeqLib::GRC& grc) {
+  for (const auto& g : grc)
+    add(g.chr, g.pos1, g.pos2);
+  finalize();
+}
+
+IntervalFilter::IntervalFilter(const IntervalFilter& parent, const SeqLib::GRC& scope, int pad) : m_scoped(true), m_parent(&parent) {
+
+  // make the padded scope, merged per chromosome
+  for (const auto& g : scope) {
+    if (g.chr < 0)
+      continue;
+    if ((int)m_scope.size() <= g.chr)
+      m_scope.resize(g.chr + 1);
+    m_scope[g.chr].push_back({std::max(0, g.pos1 - pad), g.pos2 + pad});
+  }
+  for (auto& s : m_scope) {
+    if (s.empty())
+      continue;
+    std::sort(s.begin(), s.end());
+    size_t j = 0;
+    for (size_t i = 1; i < s.size(); ++i) {
+      if (s[i].pos1 <= s[j].pos2 + 1)
+	s[j].pos2 = std::max(s[j].pos2, s[i].pos2);
+      else
+	s[++j] = s[i];
+    }
+    s.resize(j + 1);
+  }
+
+  // pull in the parent intervals that touch the scope
+  for (size_t c = 0; c < m_scope.size(); ++c) {
+    if (c >= parent.m_ivals.size())
+      break;
+    const IntervalVector& piv = parent.m_ivals[c];
+    for (const auto& s : m_scope[c]) 
+      for (size_t k = parent.lowerBound(c, s.pos1); k < piv.size() && piv[k].pos1 <= s.pos2; ++k)
+	if (piv[k].pos2 >= s.pos1)
+	  add(c, piv[k].pos1, piv[k].pos2);
+  }
+
+  finalize();
+}
+
+void IntervalFilter::add(int32_t chr, int32_t pos1, int32_t pos2) {
+  if (chr < 0)
+    return;
+  if ((int)m_ivals.size() <= chr)
+    m_ivals.resize(chr + 1);
+  m_ivals[chr].push_back({pos1, pos2});
+}
+
+void IntervalFilter::finalize() {
+
+  m_size = 0;
+  m_maxend.resize(m_ivals.size());
+  for (size_t c = 0; c < m_ivals.size(); ++c) {
+
+    // sort and drop any repeats (an interval can touch two scope regions)
+    IntervalVector& iv = m_ivals[c];
+    std::sort(iv.begin(), iv.end());
+    iv.erase(std::unique(iv.begin(), iv.end(), [](const Interval& a, const Interval& b) { 
+	  return a.pos1 == b.pos1 && a.pos2 == b.pos2; }), iv.end());
+    m_size += iv.size();
+
+    std::vector<int32_t>& me = m_maxend[c];
+    me.resize(iv.size());
+    int32_t m = INT32_MIN;
+    for (size_t i = 0; i < iv.size(); ++i) {
+      m = std::max(m, iv[i].pos2);
+      me[i] = m;
+    }
+  }
+}
+
+bool IntervalFilter::inScope(int32_t chr, int32_t pos1, int32_t pos2) const {
+
+  if (!m_scoped) // whole genome
+    return true;
+  if (chr < 0 || chr >= (int)m_scope.size() || m_scope[chr].empty())
+    return false;
+
+  // last scope region starting at or before pos1
+  const IntervalVector& s = m_scope[chr];
+  IntervalVector::const_iterator it = std::upper_bound(s.begin(), s.end(), pos1, 
+						       [](int32_t p, const Interval& i) { return p < i.pos1; });
+  if (it == s.begin())
+    return false;
+  --it;
+  return it->pos1 <= pos1 && it->pos2 >= pos2;
+}
+
+size_t IntervalFilter::lowerBound(int32_t chr, int32_t pos1) const {
+  const std::vector<int32_t>& me = m_maxend[chr];
+  return std::lower_bound(me.begin(), me.end(), pos1) - me.begin();
+}
+
+int32_t IntervalFilter::scan(int32_t chr, int32_t pos1, int32_t pos2, size_t start, bool any) const {
+
+  int32_t best = 0;
+  const IntervalVector& iv = m_ivals[chr];
+  for (size_t k = start; k < iv.size() && iv[k].pos1 <= pos2; ++k) {
+    if (iv[k].pos2 < pos1)
+      continue;
+    int32_t w = std::min(iv[k].pos2, pos2) - std::max(iv[k].pos1, pos1) + 1;
+    if (any)
+      return w;
+    best = std::max(best, w);
+  }
+  return best;
+}
+
+int32_t IntervalFilter::query(int32_t chr, int32_t pos1, int32_t pos2, bool any) const {
+
+  if (!inScope(chr, pos1, pos2))
+    return m_parent ? m_parent->query(chr, pos1, pos2, any) : 0;
+  if (chr < 0 || chr >= (int)m_ivals.size())
+    return 0;
+  return scan(chr, pos1, pos2, lowerBound(chr, pos1), any);
+}
+
+void IntervalFilter::Cursor::seek(int32_t chr, int32_t pos1) {
+
+  // moving forward on same chr, just walk up
+  if (chr == m_chr && pos1 >= m_last) {
+    const std::vector<int32_t>& me = m_f->m_maxend[chr];
+    while (m_idx < me.size() && me[m_idx] < pos1)
+      ++m_idx;
+  } else {
+    m_idx = m_f->lowerBound(chr, pos1);
+  }
+  m_chr = chr;
+  m_last = pos1;
+}
+
+int32_t IntervalFilter::Cursor::MaxOverlap(int32_t chr, int32_t pos1, int32_t pos2) {
+
+  if (!m_f)
+    return 0;
+  if (!m_f->inScope(chr, pos1, pos2))
+    return m_f->m_parent ? m_f->m_parent->query(chr, pos1, pos2, false) : 0;
+  if (chr < 0 || chr >= (int)m_f->m_ivals.size())
+    return 0;
+
+  seek(chr, pos1);
+  return m_f->scan(chr, pos1, pos2, m_idx, false);
+}
+
+bool IntervalFilter::Cursor::Overlaps(int32_t chr, int32_t pos1, int32_t pos2) {
+
+  if (!m_f)
+    return false;
+  if (!m_f->inScope(chr, pos1, pos2))
+    return m_f->m_parent ? m_f->m_parent->query(chr, pos1, pos2, true) > 0 : false;
+  if (chr < 0 || chr >= (int)m_f->m_ivals.size())
+    return false;
+
+  seek(chr, pos1);
+  return m_f->scan(chr, pos1, pos2, m_idx, true) > 0;
+}
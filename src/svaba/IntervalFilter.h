@@ -0,0 +1,107 @@
+#ifndef SVABA_INTERVAL_FILTER_H__
+#define SVABA_INTERVAL_FILTER_H__
+
+#include <vector>
+
+#include "SeqLib/GenomicRegionCollection.h"
+
+/** Flat, sorted copy of a set of intervals (e.g. a blacklist BED) for
+ * answering many overlap queries without allocating.
+ *
+ * Intervals are stored per chromosome, sorted by start, along with a
+ * running maximum of the ends. Queries go through a Cursor, which walks
+ * forward when queries arrive in coordinate order (as reads do within a
+ * region) and falls back to a binary search when they jump backwards.
+ *
+ * A filter can also be built as a window-scoped view of a parent filter,
+ * holding only the intervals near a set of regions. Queries that fall
+ * outside of the scope are sent to the parent.
+ */
+class IntervalFilter {
+
+ public:
+
+  IntervalFilter() {}
+
+  /** Index all of the intervals in a collection */
+  IntervalFilter(const SeqLib::GRC& grc);
+
+  /** Index the intervals of a parent that overlap the scope regions
+   * @param parent Filter with all of the intervals. Must outlive this one
+   * @param scope Regions that queries are expected to fall in. If empty, all queries go to the parent
+   * @param pad Pad the scope regions by this much on either side
+   */
+  IntervalFilter(const IntervalFilter& parent, const SeqLib::GRC& scope, int pad);
+
+  /** Are there no intervals to check against? */
+  bool empty() const { return m_size == 0 && (!m_parent || m_parent->empty()); }
+
+  /** Number of intervals held locally */
+  size_t size() const { return m_size; }
+
+  class Cursor {
+
+  public:
+
+    Cursor() {}
+
+    Cursor(const IntervalFilter* f) : m_f(f) {}
+
+    /** Does the region overlap any interval? */
+    bool Overlaps(int32_t chr, int32_t pos1, int32_t pos2);
+
+    bool Overlaps(const SeqLib::GenomicRegion& g) { return Overlaps(g.chr, g.pos1, g.pos2); }
+
+    /** Width of the largest intersection between the region and any interval (0 if none) */
+    int32_t MaxOverlap(int32_t chr, int32_t pos1, int32_t pos2);
+
+    int32_t MaxOverlap(const SeqLib::GenomicRegion& g) { return MaxOverlap(g.chr, g.pos1, g.pos2); }
+
+  private:
+
+    const IntervalFilter* m_f = nullptr;
+
+    int32_t m_chr = -1;
+    int32_t m_last = -1; // pos1 of the last query
+    size_t m_idx = 0;    // first interval on m_chr that could overlap m_last
+
+    // position the cursor at the first interval that could overlap pos1
+    void seek(int32_t chr, int32_t pos1);
+  };
+
+ private:
+
+  struct Interval {
+    int32_t pos1;
+    int32_t pos2;
+    bool operator<(const Interval& i) const { return pos1 < i.pos1 || (pos1 == i.pos1 && pos2 < i.pos2); }
+  };
+
+  typedef std::vector<Interval> IntervalVector;
+
+  std::vector<IntervalVector> m_ivals;          // by chr, sorted by pos1
+  std::vector<std::vector<int32_t> > m_maxend;  // running max of pos2 within m_ivals
+  std::vector<IntervalVector> m_scope;          // by chr, merged and sorted
+  bool m_scoped = false;                        // if false, everything is in scope
+  size_t m_size = 0;
+
+  const IntervalFilter* m_parent = nullptr;
+
+  void add(int32_t chr, int32_t pos1, int32_t pos2);
+
+  void finalize();
+
+  bool inScope(int32_t chr, int32_t pos1, int32_t pos2) const;
+
+  // stateless query (binary search), for out-of-scope lookups sent to the parent
+  int32_t query(int32_t chr, int32_t pos1, int32_t pos2, bool any) const;
+
+  // scan intervals from start for overlaps. If any, return on first hit
+  int32_t scan(int32_t chr, int32_t pos1, int32_t pos2, size_t start, bool any) const;
+
+  // first interval on chr whose running max end reaches pos1
+  size_t lowerBound(int32_t chr, int32_t pos1) const;
+
+};
+
+#endif
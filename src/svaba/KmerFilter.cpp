@@ -384,7 +384,7 @@ void KmerFilter::makeIndex(const std::vector<char*>& v) {
   // make suffix array
   pSAf = new SuffixArray(&pRT, 1, false);
   // make BWT
-  pBWT = new RLBWT(pSAf, &pRT);
+  pBWT = new BWT(pSAf, &pRT);
 
   return;
 }
@@ -421,7 +421,7 @@ void KmerFilter::makeIndex(const std::vector<char*>& v) {
   // make suffix array
   pSAf = new SuffixArray(&pRT, 1, false);
   // make BWT
-  pBWT= new RLBWT(pSAf, &pRT);
+  pBWT= new BWT(pSAf, &pRT);
 
 
 }
@@ -456,7 +456,7 @@ void KmerFilter::makeIndex(svabaReadVector& vec) {
   // make suffix array
   pSAf = new SuffixArray(&pRT, 1, false);
   // make BWT
-  pBWT= new RLBWT(pSAf, &pRT);
+  pBWT= new BWT(pSAf, &pRT);
 
 
 }
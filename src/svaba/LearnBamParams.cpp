@@ -1,8 +1,18 @@
 #include "LearnBamParams.h"
 
 #include <numeric>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "SeqLib/BamReader.h"
 #include "svabaUtils.h"
+#include "svaba_params.h"
 
 std::ostream& operator<<(std::ostream& out, const BamParams& p) {
  
@@ -19,13 +29,197 @@ std::ostream& operator<<(std::ostream& out, const BamParams& p) {
   return out;
 }
 
+// 2.5%, 50% and 97.5% insert sizes of each read group, against those of
+// the last round. True if every paired read group has enough of them and
+// none moved by more than LEARN_CONVERGE_FRAC
+static bool converged(BamParamsMap& p, std::unordered_map<std::string, std::vector<int> >& last) {
+
+  if (p.empty())
+    return false;
+
+  static const double tiles[3] = {0.025, 0.5, 0.975};
+
+  bool conv = true;
+  for (auto& i : p) {
+    std::vector<int>& v = i.second.isize_vec;
+
+    // plenty of reads, but too few pairs to get a distribution. Not paired
+    if (i.second.visited >= LEARN_MIN_ISIZE && v.size() < 100)
+      continue;
+    if (v.size() < LEARN_MIN_ISIZE) {
+      conv = false;
+      continue;
+    }
+
+    // partial sorts. collectStats sorts the whole thing at the end
+    std::vector<int> q(3);
+    for (int k = 0; k < 3; ++k) {
+      size_t n = std::floor(v.size() * tiles[k]);
+      std::nth_element(v.begin(), v.begin() + n, v.end());
+      q[k] = v[n];
+    }
+
+    auto ff = last.find(i.first);
+    if (ff == last.end())
+      conv = false;
+    else
+      for (int k = 0; k < 3; ++k)
+	if (std::abs(q[k] - ff->second[k]) > std::max(1.0, LEARN_CONVERGE_FRAC * ff->second[k]))
+	  conv = false;
+    last[i.first] = q;
+  }
+
+  return conv;
+}
+
 void LearnBamParams::learnParams(BamParamsMap& p, int max_count) {
 
-  SeqLib::GRC grv;
-  //grv.add(SeqLib::GenomicRegion(0, 1000000,2000000));
-  //grv.add(SeqLib::GenomicRegion(1,1000000,2000000));
+  m_from_cache = m_use_cache && read_cache(p, max_count);
+  if (m_from_cache)
+    return;
+
   SeqLib::BamReader bwalker;
-  assert(bwalker.Open(bam));
+  if (!cram_reference.empty())
+    bwalker.SetCramReference(cram_reference);
+  if (!bwalker.Open(bam)) {
+    std::cerr << "ERROR: Cannot open " << bam << " to learn its params" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  SeqLib::BamHeader h = bwalker.Header();
+
+  // random sites across the genome, weighted by length. Skip the short
+  // sequences (decoys etc) unless there is nothing else. Seeded, so that
+  // reruns learn the same thing
+  std::vector<int> chrs;
+  int64_t genome = 0;
+  for (int i = 0; i < h.NumSequences(); ++i)
+    if (h.GetSequenceLength(i) >= LEARN_MIN_CHR_LEN) {
+      chrs.push_back(i);
+      genome += h.GetSequenceLength(i);
+    }
+  if (chrs.empty())
+    for (int i = 0; i < h.NumSequences(); ++i) {
+      chrs.push_back(i);
+      genome += h.GetSequenceLength(i);
+    }
+
+  std::vector<SeqLib::GenomicRegion> sites;
+  std::mt19937_64 rng(1337);
+  size_t num_sites = max_count / LEARN_SITE_READS + 1;
+  for (size_t i = 0; i < num_sites && genome > 0; ++i) {
+    int64_t g = rng() % genome;
+    size_t c = 0;
+    while (g >= h.GetSequenceLength(chrs[c])) {
+      g -= h.GetSequenceLength(chrs[c]);
+      ++c;
+    }
+    sites.push_back(SeqLib::GenomicRegion(chrs[c], g, h.GetSequenceLength(chrs[c])));
+  }
+
+  // no index, so no seeking
+  if (sites.empty() || !bwalker.SetRegion(sites[0])) {
+    learn_from_start(p, max_count);
+  } else {
+
+    // a reader for each thread, kept across rounds
+    std::vector<SeqLib::BamReader> readers(m_threads);
+    for (auto& r : readers) {
+      if (!cram_reference.empty())
+	r.SetCramReference(cram_reference);
+      if (!r.Open(bam)) {
+	std::cerr << "ERROR: Cannot open " << bam << " to learn its params" << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    }
+
+    std::unordered_map<std::string, std::vector<int> > last;
+    size_t next = 0, records = 0;
+    int wid = 0;
+    while (next < sites.size() && records < (size_t)max_count) {
+
+      size_t n = std::min(sites.size() - next, (size_t)LEARN_SITES_PER_ROUND);
+      std::vector<Sampler> ss(m_threads);
+      for (int t = 0; t < m_threads; ++t) {
+	ss[t].lbp = this;
+	ss[t].reader = &readers[t];
+	ss[t].sites = &sites;
+	ss[t].begin = next + t;
+	ss[t].end = next + n;
+	ss[t].stride = m_threads;
+      }
+
+      if (m_threads == 1) {
+	sample_sites(ss[0]);
+      } else {
+	std::vector<pthread_t> tids(m_threads);
+	for (int t = 0; t < m_threads; ++t)
+	  pthread_create(&tids[t], NULL, run_sampler, &ss[t]);
+	for (int t = 0; t < m_threads; ++t)
+	  pthread_join(tids[t], NULL);
+      }
+
+      // add the round to the total
+      for (auto& s : ss) {
+	for (auto& i : s.p) {
+	  BamParamsMap::iterator ff = p.find(i.first);
+	  if (ff == p.end())
+	    p[i.first] = std::move(i.second);
+	  else
+	    ff->second.Add(i.second);
+	}
+	wid += s.wid;
+	records += s.records;
+      }
+      next += n;
+
+      if (converged(p, last))
+	break;
+    }
+
+    for (auto& i : p) {
+      i.second.collectStats();
+      i.second.mean_cov = (wid > 0) ? i.second.visited * i.second.readlen / wid : 0;
+    }
+  }
+
+  if (m_use_cache)
+    write_cache(p, max_count);
+}
+
+void* LearnBamParams::run_sampler(void * arg) {
+  Sampler * s = static_cast<Sampler*>(arg);
+  s->lbp->sample_sites(*s);
+  return NULL;
+}
+
+void LearnBamParams::sample_sites(Sampler& s) const {
+
+  SeqLib::BamRecord r;
+  for (size_t i = s.begin; i < s.end; i += s.stride) {
+
+    if (!s.reader->SetRegion((*s.sites)[i]))
+      continue;
+
+    // span of the reads of this site, as in learn_from_start
+    size_t count = 0;
+    double pos1 = 0, pos2 = 0, chr = -1;
+    int wid = 0;
+    while (count < LEARN_SITE_READS && s.reader->GetNextRecord(r))
+      process_read(r, ++count, s.p, pos1, pos2, chr, wid);
+    s.wid += wid + (pos2 - pos1);
+    s.records += count;
+  }
+}
+
+void LearnBamParams::learn_from_start(BamParamsMap& p, int max_count) const {
+
+  SeqLib::BamReader bwalker;
+  if (!cram_reference.empty())
+    bwalker.SetCramReference(cram_reference);
+  if (!bwalker.Open(bam)) {
+    std::cerr << "ERROR: Cannot open " << bam << " to learn its params" << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
   SeqLib::BamRecord r;
 
@@ -55,6 +249,89 @@ void LearnBamParams::learnParams(BamParamsMap& p, int max_count) {
   
 }
 
+// the sidecar is only good for the same BAM, learned with the same max_count.
+// It ends with a line giving the number of read groups, so a truncated
+// sidecar is not mistaken for a complete one
+#define CACHE_END "#end"
+
+static std::string cache_stamp(const std::string& bam, int max_count) {
+  struct stat st;
+  if (stat(bam.c_str(), &st) != 0)
+    return std::string();
+  return "#svaba_params\t" + std::to_string((int64_t)st.st_size) + "\t" +
+    std::to_string((int64_t)st.st_mtime) + "\t" + std::to_string(max_count);
+}
+
+bool LearnBamParams::read_cache(BamParamsMap& p, int max_count) const {
+
+  std::ifstream in(CachePath(bam));
+  std::string line;
+  if (!in || !std::getline(in, line) || line.empty() || line != cache_stamp(bam, max_count))
+    return false;
+
+  BamParamsMap tmp;
+  bool ended = false;
+  while (std::getline(in, line)) {
+    if (ended)
+      return false;
+    if (line.compare(0, strlen(CACHE_END), CACHE_END) == 0) {
+      if (line != CACHE_END "\t" + std::to_string(tmp.size()))
+	return false;
+      ended = true;
+      continue;
+    }
+    std::istringstream iss(line);
+    std::string rg;
+    if (!std::getline(iss, rg, '\t'))
+      continue;
+    BamParams b(rg);
+    if (!(iss >> b.readlen >> b.max_mapq >> b.mean_cov >> b.mean_isize >> b.median_isize
+	  >> b.sd_isize >> b.lp >> b.hp >> b.visited))
+      return false;
+    tmp[rg] = b;
+  }
+
+  if (!ended)
+    return false;
+  p = tmp;
+  return true;
+}
+
+void LearnBamParams::write_cache(const BamParamsMap& p, int max_count) const {
+
+  // write to a temp file of this process and move it in, so neither a
+  // reader nor another svaba learning the same BAM sees a partial sidecar
+  std::string stamp = cache_stamp(bam, max_count);
+  std::string tmp = CachePath(bam) + ".tmp." + std::to_string(getpid());
+  bool ok = !stamp.empty();
+  if (ok) {
+    std::ofstream out(tmp);
+    out << stamp << "\n";
+    for (const auto& i : p)
+      out << i.first << "\t" << i.second.readlen << "\t" << i.second.max_mapq << "\t" << i.second.mean_cov
+	  << "\t" << i.second.mean_isize << "\t" << i.second.median_isize << "\t" << i.second.sd_isize
+	  << "\t" << i.second.lp << "\t" << i.second.hp << "\t" << i.second.visited << "\n";
+    out << CACHE_END << "\t" << p.size() << "\n";
+    out.close();
+    ok = out.good();
+  }
+  ok = ok && rename(tmp.c_str(), CachePath(bam).c_str()) == 0;
+  if (!ok) {
+    unlink(tmp.c_str());
+    std::cerr << "WARNING: Could not write the params sidecar " << CachePath(bam) << std::endl;
+  }
+}
+
+void BamParams::Add(const BamParams& o) {
+  visited += o.visited;
+  num_clip += o.num_clip;
+  num_disc += o.num_disc;
+  num_bad += o.num_bad;
+  readlen = std::max(readlen, o.readlen);
+  max_mapq = std::max(max_mapq, o.max_mapq);
+  isize_vec.insert(isize_vec.end(), o.isize_vec.begin(), o.isize_vec.end());
+}
+
 void BamParams::collectStats() {
 
   if (isize_vec.size() < 100) {
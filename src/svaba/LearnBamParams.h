@@ -1,12 +1,14 @@
 #ifndef SVABA_LEARN_BAM_PARAMS_H__
 #define SVABA_LEARN_BAM_PARAMS_H__
 
+#include <algorithm>
 #include <string>
 #include <ostream>
 #include <unordered_map>
 #include <vector>
 
 #include "SeqLib/BamRecord.h"
+#include "SeqLib/BamReader.h"
 
 struct BamParams {
   
@@ -18,6 +20,9 @@ struct BamParams {
 
   void collectStats();
 
+  /** Add the tallies of another sample of the same read group */
+  void Add(const BamParams& o);
+
   friend std::ostream& operator<<(std::ostream& out, const BamParams& p);
   
   int visited = 0;
@@ -47,11 +52,34 @@ struct BamParams {
 
 typedef std::unordered_map<std::string, BamParams> BamParamsMap;
 
+/** Learns the read length, insert sizes etc. of each read group of a BAM.
+ *
+ * If the BAM is indexed, batches of reads are taken from random sites
+ * across the genome, on several threads, in rounds that stop once the
+ * insert-size distributions settle (or max_count reads were read).
+ * Otherwise reads are taken from the start of the BAM.
+ */
 class LearnBamParams {
 
  public:
  LearnBamParams(const std::string& b) : bam(b) { };
+
+  /** @param ref Reference fasta for decoding, if the input is a CRAM */
+ LearnBamParams(const std::string& b, const std::string& ref) : bam(b), cram_reference(ref) { };
   
+  /** Sample on this many threads */
+  void SetThreads(int t) { m_threads = std::max(1, t); }
+
+  /** Load the params from the BAM's sidecar file if it matches the BAM,
+   * and write them there after learning them otherwise */
+  void UseCache(bool c) { m_use_cache = c; }
+
+  /** Path of the params sidecar of a BAM */
+  static std::string CachePath(const std::string& b) { return b + ".svaba_params"; }
+
+  /** Were the last params learned loaded from the sidecar? */
+  bool FromCache() const { return m_from_cache; }
+
   void learnParams(BamParams& p, int max_count);
 
   void learnParams(BamParamsMap& p, int max_count);
@@ -59,6 +87,34 @@ class LearnBamParams {
  private:
   std::string bam;
 
+  std::string cram_reference;
+
+  int m_threads = 1;
+  bool m_use_cache = false;
+  bool m_from_cache = false;
+
+  // one thread's share of the sites of a round
+  struct Sampler {
+    const LearnBamParams * lbp;
+    SeqLib::BamReader * reader;
+    const std::vector<SeqLib::GenomicRegion> * sites;
+    size_t begin, end, stride;
+    BamParamsMap p;
+    int wid = 0;
+    size_t records = 0;
+  };
+
+  static void* run_sampler(void * arg);
+
+  void sample_sites(Sampler& s) const;
+
+  // read from the start of the BAM (no index)
+  void learn_from_start(BamParamsMap& p, int max_count) const;
+
+  bool read_cache(BamParamsMap& p, int max_count) const;
+
+  void write_cache(const BamParamsMap& p, int max_count) const;
+
   void process_read(const SeqLib::BamRecord& r, size_t count, 
 		    BamParamsMap& p, double& pos1, double& pos2, double& chr, int& wid) const;
 
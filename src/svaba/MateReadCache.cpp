@@ -0,0 +1,194 @@
+#include "MateReadCache.h"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+#include "SeqLib/SeqLibUtils.h"
+#include "svaba_params.h"
+
+MateReadCache::MateReadCache() {
+  pthread_mutex_init(&m_mutex, NULL);
+}
+
+MateReadCache::~MateReadCache() {
+  pthread_mutex_destroy(&m_mutex);
+}
+
+static std::string tile_key(int32_t chr, int32_t t) {
+  return std::to_string(chr) + ":" + std::to_string(t);
+}
+
+SeqLib::GRC MateReadCache::ReadRegions(svabaBamWalker& w, const SeqLib::GRC& regions, std::ofstream * log) {
+
+  SeqLib::GRC bad;
+
+  // tiles covering the regions, sorted and without repeats
+  std::vector<std::pair<int32_t, int32_t> > tiles;
+  for (const auto& g : regions)
+    for (int32_t t = g.pos1 / MATE_CACHE_TILE; t <= g.pos2 / MATE_CACHE_TILE; ++t)
+      tiles.push_back(std::pair<int32_t, int32_t>(g.chr, t));
+  std::sort(tiles.begin(), tiles.end());
+  tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+  // hold the walker's reads aside, so each readBam call
+  // leaves only the reads of one tile in the walker
+  svabaReadVector kept;
+  kept.swap(w.reads);
+
+  // mate regions are calculated once below, from all of the tiles
+  bool get_mate_regions = w.get_mate_regions;
+  w.get_mate_regions = false;
+
+  for (const auto& t : tiles) {
+
+    SeqLib::GenomicRegion tile(t.first, t.second * MATE_CACHE_TILE, (t.second + 1) * MATE_CACHE_TILE - 1);
+    if (isBad(tile))
+      continue;
+
+    std::string key = w.prefix + ":" + tile_key(t.first, t.second);
+    svabaReadVector tile_reads;
+
+    if (!get(key, tile_reads)) {
+
+      SeqLib::GRC tg;
+      tg.add(tile);
+      w.SetMultipleRegions(tg);
+
+      SeqLib::GRC tbad = w.readBam(log);
+      if (tbad.size()) {
+	bad.Concat(tbad);
+	if (m_bad)
+	  m_bad->Add(tbad);
+	w.reads.clear();
+	continue;
+      }
+
+      tile_reads.swap(w.reads);
+      put(key, tile_reads);
+    }
+
+    // tiles run past the regions, so keep only the reads in the regions themselves
+    for (const auto& r : tile_reads) {
+      for (const auto& g : regions) {
+	if (r.ChrID() == g.chr && r.PositionEnd() >= g.pos1 && r.Position() <= g.pos2) {
+	  kept.push_back(r);
+	  break;
+	}
+      }
+    }
+  }
+
+  w.reads.swap(kept);
+  w.get_mate_regions = get_mate_regions;
+
+  // calculateMateRegions takes the main region from the walker
+  w.SetMultipleRegions(regions);
+  if (w.get_mate_regions && w.reads.size() >= 3)
+    w.calculateMateRegions();
+
+  return bad;
+}
+
+bool MateReadCache::isBad(const SeqLib::GenomicRegion& tile) {
+
+  if (!m_bad || !m_bad->Overlaps(tile))
+    return false;
+
+  pthread_mutex_lock(&m_mutex);
+  ++m_bad_skips;
+  pthread_mutex_unlock(&m_mutex);
+
+  return true;
+}
+
+bool MateReadCache::get(const std::string& key, svabaReadVector& reads) {
+
+  pthread_mutex_lock(&m_mutex);
+
+  auto ff = m_map.find(key);
+  if (ff == m_map.end()) {
+    ++m_misses;
+    pthread_mutex_unlock(&m_mutex);
+    return false;
+  }
+
+  ++m_hits;
+  m_lru.splice(m_lru.begin(), m_lru, ff->second.lru);
+
+  // copy out while locked, so an eviction can't pull the reads out from under us.
+  // Copies are deep, since reads get tags added downstream
+  reads.reserve(ff->second.reads.size());
+  for (const auto& r : ff->second.reads)
+    reads.push_back(r.DeepCopy());
+
+  pthread_mutex_unlock(&m_mutex);
+  return true;
+}
+
+void MateReadCache::put(const std::string& key, const svabaReadVector& reads) {
+
+  // make the copy outside of the lock
+  svabaReadVector cached;
+  cached.reserve(reads.size());
+  for (const auto& r : reads)
+    cached.push_back(r.DeepCopy());
+  size_t b = svabaMemory::bytes(cached) + key.capacity();
+
+  // don't let one tile take over the cache
+  if (b > m_max_bytes / 4)
+    return;
+
+  pthread_mutex_lock(&m_mutex);
+
+  // another thread may have fetched the same tile in the meantime
+  if (m_map.count(key)) {
+    pthread_mutex_unlock(&m_mutex);
+    return;
+  }
+
+  // evict least recently used tiles until there is room
+  size_t freed = 0;
+  while (m_bytes + b > m_max_bytes && !m_lru.empty()) {
+    auto ff = m_map.find(m_lru.back());
+    m_bytes -= ff->second.bytes;
+    freed += ff->second.bytes;
+    m_map.erase(ff);
+    m_lru.pop_back();
+    ++m_evictions;
+  }
+
+  m_lru.push_front(key);
+  Entry& e = m_map[key];
+  e.reads.swap(cached);
+  e.bytes = b;
+  e.lru = m_lru.begin();
+  m_bytes += b;
+
+  pthread_mutex_unlock(&m_mutex);
+
+  if (m_gov) {
+    m_gov->Add(b);
+    m_gov->Release(freed);
+  }
+
+}
+
+std::string MateReadCache::Stats() const {
+
+  pthread_mutex_lock(&m_mutex);
+
+  std::stringstream ss;
+  size_t lookups = m_hits + m_misses;
+  ss << "...mate-region cache: " << SeqLib::AddCommas(m_hits) << " hits, "
+     << SeqLib::AddCommas(m_misses) << " misses";
+  if (lookups)
+    ss << " (" << std::fixed << std::setprecision(1) << (100.0 * m_hits / lookups) << "% hit rate)";
+  ss << ", " << SeqLib::AddCommas(m_evictions) << " evictions, "
+     << SeqLib::AddCommas(m_bad_skips) << " bad tiles skipped. Holding "
+     << svabaMemory::toString(m_bytes) << " in " << SeqLib::AddCommas(m_map.size()) << " tiles";
+
+  pthread_mutex_unlock(&m_mutex);
+
+  return ss.str();
+}
@@ -0,0 +1,97 @@
+#ifndef SVABA_MATE_READ_CACHE_H__
+#define SVABA_MATE_READ_CACHE_H__
+
+#include <pthread.h>
+#include <fstream>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "svabaBamWalker.h"
+#include "svabaMemory.h"
+#include "BadRegionSet.h"
+
+/** Thread-shared LRU cache of filtered reads from mate-lookup regions.
+ *
+ * Many windows point their mates at the same hot loci (satellites, viral
+ * integrations, amplicon partners), so without a cache the same BGZF
+ * blocks are decompressed and filtered over and over on different threads.
+ * Mate regions are broken into fixed-size tiles (MATE_CACHE_TILE), and the
+ * reads that pass the walker's filters for each BAM / tile are cached.
+ * Reads handed out from the cache are deep copies, so a window can modify
+ * them without affecting other threads.
+ *
+ * Tiles that hit the mate-region read limit go into the run's shared set of
+ * bad regions, and tiles that overlap any bad region are never fetched.
+ *
+ * The results are not exactly those of uncached lookups: the read limit
+ * applies per tile instead of per mate region, and reads handed out from
+ * the cache are not seen by the walker's error-correction training, so
+ * they depend on which thread read a tile first. Hence the cache is opt-in.
+ */
+class MateReadCache {
+
+ public:
+
+  MateReadCache();
+
+  ~MateReadCache();
+
+  /** Set the max size of the cached reads, in bytes. 0 turns off the cache */
+  void SetMaxBytes(size_t b) { m_max_bytes = b; }
+
+  /** Check tiles against, and add the tiles that hit the limit to, the shared bad regions */
+  void SetBadRegions(BadRegionSet * b) { m_bad = b; }
+
+  /** Charge cached reads against a memory governor */
+  void SetGovernor(svabaMemoryGovernor * g) { m_gov = g; }
+
+  bool Enabled() const { return m_max_bytes > 0; }
+
+  /** Read the reads from a set of mate regions into the walker, through the cache.
+   * Tiles not in the cache are read with the walker and added.
+   * @param w Walker for one BAM, with read filters and limits already set
+   * @param regions Mate regions to read
+   * @param log Log file to pass on to the walker
+   * @return Regions that hit the read limit
+   */
+  SeqLib::GRC ReadRegions(svabaBamWalker& w, const SeqLib::GRC& regions, std::ofstream * log);
+
+  /** Hit rate etc. for the log */
+  std::string Stats() const;
+
+ private:
+
+  struct Entry {
+    svabaReadVector reads;
+    size_t bytes = 0;
+    std::list<std::string>::iterator lru; // position in the LRU list
+  };
+
+  std::unordered_map<std::string, Entry> m_map;
+  std::list<std::string> m_lru; // most recently used at the front
+
+  BadRegionSet * m_bad = nullptr;
+
+  size_t m_max_bytes = 0;
+  size_t m_bytes = 0;
+
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+  size_t m_evictions = 0;
+  size_t m_bad_skips = 0;
+
+  svabaMemoryGovernor * m_gov = nullptr;
+
+  mutable pthread_mutex_t m_mutex;
+
+  // copy of a cached tile into reads. False if not cached
+  bool get(const std::string& key, svabaReadVector& reads);
+
+  void put(const std::string& key, const svabaReadVector& reads);
+
+  bool isBad(const SeqLib::GenomicRegion& tile);
+
+};
+
+#endif
@@ -1,73 +1,314 @@
 #include "PONFilter.h"
 
-#include <regex>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
 #include <sstream>
+#include <algorithm>
 
 #include "gzstream.h"
 #include "SeqLib/SeqLibUtils.h"
 
 using namespace SeqLib;
 
+#define PON_MAGIC "SVBAPON1"
+
+// layout of a binary panel: this header, the sorted keys, then the count for each key
+struct PONHeader {
+  char magic[8];
+  uint64_t n;
+};
+
+typedef std::vector<std::pair<uint64_t, uint32_t> > PONSites;
+
   std::ostream& operator<<(std::ostream& out, const PONFilter& p) {
     size_t max_samples = 0;
-    for (auto& i : p.m_map)
-      if (i.second > max_samples)
-	max_samples = i.second;
-    out << "Indel PON Num sites: " << AddCommas(p.m_map.size()) << " Max Samples Found " << AddCommas(max_samples);
+    for (size_t i = 0; i < p.m_size; ++i)
+      if (p.m_counts[i] > max_samples)
+	max_samples = p.m_counts[i];
+    out << "Indel PON Num sites: " << AddCommas(p.m_size) << " Max Samples Found " << AddCommas(max_samples);
     return out;
   }
 
+uint64_t PONFilter::PackKey(int32_t chr, int32_t pos, int type, int32_t len) {
+  // an untyped site has no length, and a typed one at least 1
+  uint32_t l = type == TYPE_ANY ? 0 : std::max<uint32_t>(1, std::min<uint32_t>(std::max(len, 0), IndelKey::MAX_LEN));
+  return IndelKey::Pack(chr, pos, l, type == TYPE_DEL);
+}
+
+// is this a binary panel?
+static bool is_binary_panel(const std::string& file) {
+  FILE * fp = fopen(file.c_str(), "rb");
+  if (!fp)
+    return false;
+  char magic[8];
+  bool bin = fread(magic, 1, 8, fp) == 8 && memcmp(magic, PON_MAGIC, 8) == 0;
+  fclose(fp);
+  return bin;
+}
+
+// read the normal sites of a text panel. Lines are a site key, one leading
+// character then T or N then the site (e.g. xN<chr>_<pos>_<len><I/D>),
+// then the read count in each normal
+static bool read_text_panel(const std::string& file, PONSites& sites) {
+
+  igzstream izp(file.c_str());
+  if (!izp) {
+    std::cerr << "Can't read file " << file << std::endl;
+    return false;
+  }
+
+  std::string pval;
+  while (std::getline(izp, pval, '\n')) {
+
+    size_t tab = pval.find('\t');
+    if (tab == std::string::npos || tab < 3)
+      continue;
+    if (pval.at(1) == 'T') // only accumulate normal
+      continue;
+
+    // count the normals with reads at the site
+    uint32_t sample_count_total = 0;
+    for (size_t s = tab + 1; s < pval.length();) {
+      size_t e = pval.find('\t', s);
+      if (e == std::string::npos)
+	e = pval.length();
+      if (e > s)
+	sample_count_total += atoi(pval.c_str() + s) > 0 ? 1 : 0;
+      s = e + 1;
+    }
+    if (!sample_count_total)
+      continue;
+
+    // chr_pos, then the length and type if there
+    int32_t chr = 0, pos = 0, len = 0;
+    char type = 0;
+    int nf = sscanf(pval.c_str() + 2, "%d_%d_%d%c", &chr, &pos, &len, &type);
+    int t = nf < 4 ? PONFilter::TYPE_ANY : type == 'D' ? PONFilter::TYPE_DEL : type == 'I' ? PONFilter::TYPE_INS : PONFilter::TYPE_ANY;
+    if (nf < 2 || !IndelKey::Fits(chr, pos, 0)) {
+      std::cerr << "PON: can't parse site " << pval.substr(0, tab) << std::endl;
+      continue;
+    }
+    sites.push_back(std::pair<uint64_t, uint32_t>(PONFilter::PackKey(chr, pos, t, len), sample_count_total));
+  }
+
+  return true;
+}
+
+// sort the sites and sum the counts of repeated keys
+static void collapse_sites(PONSites& sites) {
+  std::sort(sites.begin(), sites.end());
+  size_t j = 0;
+  for (size_t i = 0; i < sites.size(); ++i) {
+    if (j && sites[j - 1].first == sites[i].first)
+      sites[j - 1].second += sites[i].second;
+    else
+      sites[j++] = sites[i];
+  }
+  sites.resize(j);
+}
+
   PONFilter::PONFilter(const std::string& file) {
 
-    // import the pon
-    igzstream izp(file.c_str());
-    if (!izp) {
-      std::cerr << "Can't read file " << file << std::endl;
+    if (is_binary_panel(file)) {
+      if (!mapPanel(file)) {
+	std::cerr << "Can't read panel of normals " << file << std::endl;
+	exit(EXIT_FAILURE);
+      }
+      return;
+    }
+
+    // import the text pon
+    PONSites sites;
+    if (!read_text_panel(file, sites))
       exit(EXIT_FAILURE);
+    collapse_sites(sites);
+
+    m_loaded_keys.reserve(sites.size());
+    m_loaded_counts.reserve(sites.size());
+    for (const auto& s : sites) {
+      m_loaded_keys.push_back(s.first);
+      m_loaded_counts.push_back(s.second);
     }
+    m_keys = m_loaded_keys.data();
+    m_counts = m_loaded_counts.data();
+    m_size = m_loaded_keys.size();
+  }
 
-    std::string pval;
-    while (std::getline(izp, pval, '\n')) {
-
-      std::istringstream gg(pval);
-      std::string tval;
-      std::string key;
-
-      int sample_count_total = 0;
-
-      size_t c = 0;
-      while (std::getline(gg, tval, '\t')) {
-	++c;
-	if (c == 1 && tval.length()) {
-	  key = tval.substr(1,tval.length() - 1);
-	  if (key.at(0) == 'T') // only accumulate normal
-	    break;
-	}
-	else if (tval.length())
-	  try { 
-	    sample_count_total += (stoi(tval) > 0 ? 1 : 0); 
-	  } catch(...) { 
-	    std::cerr << "stoi error in PON read with val " << tval << " on line " << pval << std::endl; 
-	  }
-	//else if (tval.length() && c==2)
-	//	try { read_count_total += stoi(tval); } catch(...) { std::cerr << "stoi error in PON read with val " << tval << " on line " << pval << std::endl; }
-	
-      }
-      
-      // trim it down
-      std::regex regc("(.*?_.*?)_.*");
-      std::smatch smatchr;
-      if (!std::regex_search(key, smatchr, regc)) {
-	std::cerr << "regex failed on " << key << std::endl; 
-      } else {
-	key = smatchr[1].str();
-      }
+PONFilter::~PONFilter() {
+  if (m_map)
+    munmap(m_map, m_map_size);
+}
+
+bool PONFilter::mapPanel(const std::string& file) {
+
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PONHeader)) {
+    close(fd);
+    return false;
+  }
 
-      if (sample_count_total > 1) {
-	m_map[key] = sample_count_total;
+  void * base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  const PONHeader * h = (const PONHeader*)base;
+  if (memcmp(h->magic, PON_MAGIC, 8) != 0 ||
+      sizeof(PONHeader) + h->n * (sizeof(uint64_t) + sizeof(uint32_t)) != (uint64_t)st.st_size) {
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  m_map = base;
+  m_map_size = st.st_size;
+  m_size = h->n;
+  m_keys = (const uint64_t*)((const char*)base + sizeof(PONHeader));
+  m_counts = (const uint32_t*)(m_keys + m_size);
+  return true;
+}
+
+int PONFilter::NSamps(int32_t chr, int32_t pos, int type, int32_t len) const {
+
+  if (!IndelKey::Fits(chr, pos, 0))
+    return 0;
+
+  // the sites at this position run from the untyped key to the longest deletion
+  const uint64_t * lo = std::lower_bound(m_keys, m_keys + m_size, IndelKey::Pack(chr, pos, 0, false));
+  const uint64_t * hi = std::upper_bound(lo, m_keys + m_size, IndelKey::Pack(chr, pos, IndelKey::MAX_LEN, true));
+
+  uint64_t want = PackKey(chr, pos, type, len);
+  uint32_t n = 0;
+  for (const uint64_t * k = lo; k != hi; ++k) {
+    if (type == TYPE_ANY || IndelKey::Length(*k) == 0 || *k == want)
+      n = std::max(n, m_counts[k - m_keys]);
+  }
+
+  return n >= PON_MIN_SAMPLES ? n : 0;
+}
+
+int PONFilter::NSamps(const std::string& s) const {
+  int32_t chr, pos;
+  if (sscanf(s.c_str(), "%d_%d", &chr, &pos) != 2)
+    return 0;
+  return NSamps(chr, pos);
+}
+
+int64_t PONFilter::Build(const std::vector<std::string>& inputs, const std::string& out) {
+
+  PONSites sites;
+  for (const auto& f : inputs) {
+    if (is_binary_panel(f)) {
+      PONFilter p;
+      if (!p.mapPanel(f)) {
+	std::cerr << "Can't read panel of normals " << f << std::endl;
+	return -1;
       }
+      sites.reserve(sites.size() + p.m_size);
+      for (size_t i = 0; i < p.m_size; ++i)
+	sites.push_back(std::pair<uint64_t, uint32_t>(p.m_keys[i], p.m_counts[i]));
+    } else if (!read_text_panel(f, sites)) {
+      return -1;
+    }
+  }
+  collapse_sites(sites);
+
+  PONHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, PON_MAGIC, 8);
+  h.n = sites.size();
 
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> counts;
+  keys.reserve(sites.size());
+  counts.reserve(sites.size());
+  for (const auto& s : sites) {
+    keys.push_back(s.first);
+    counts.push_back(s.second);
+  }
+  PONSites().swap(sites);
+
+  // write to a temp file and move it in, so merging into a panel in use is safe
+  std::string tmp = out + ".tmp";
+  FILE * fp = fopen(tmp.c_str(), "wb");
+  bool ok = fp && fwrite(&h, sizeof(h), 1, fp) == 1 &&
+    fwrite(keys.data(), sizeof(uint64_t), keys.size(), fp) == keys.size() &&
+    fwrite(counts.data(), sizeof(uint32_t), counts.size(), fp) == counts.size();
+  if (fp)
+    ok = (fclose(fp) == 0) && ok;
+  ok = ok && rename(tmp.c_str(), out.c_str()) == 0;
+  if (!ok) {
+    unlink(tmp.c_str());
+    return -1;
+  }
+
+  return h.n;
+}
+
+static const char* shortopts = "ho:m:";
+static const struct option longopts[] = {
+  { "help",                    no_argument, NULL, 'h' },
+  { "output",                  required_argument, NULL, 'o'},
+  { "merge",                   required_argument, NULL, 'm'},
+  { NULL, 0, NULL, 0 }
+};
+
+static const char *PON_USAGE_MESSAGE =
+  "Usage: svaba pon-build -o panel.pon normals1.txt.gz [normals2.txt.gz ...]\n"
+  "       svaba pon-build -m panel.pon new_normals.txt.gz [...]\n\n"
+  "  Description: Build a binary indel panel of normals, which svaba maps into memory.\n"
+  "               Inputs are text panels or other binary panels. Sample counts of a site are summed.\n"
+  "\n"
+  "  -h, --help                           Display this help and exit\n"
+  "  -o, --output                         Binary panel to write\n"
+  "  -m, --merge                          Fold the inputs into this binary panel. Writes it back in place unless -o is given\n"
+  "\n";
+
+void runPONBuild(int argc, char** argv) {
+
+  std::string out, merge;
+  bool die = argc <= 2;
+
+  for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    switch (c) {
+    case 'o': arg >> out; break;
+    case 'm': arg >> merge; break;
+    default: die = true;
     }
+  }
+
+  std::vector<std::string> inputs;
+  if (!merge.empty()) {
+    inputs.push_back(merge);
+    if (out.empty())
+      out = merge;
+  }
+  for (int i = optind; i < argc; ++i)
+    inputs.push_back(argv[i]);
+
+  if (out.empty() || inputs.size() == (merge.empty() ? 0 : 1))
+    die = true;
+
+  if (die) {
+    std::cerr << "\n" << PON_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
 
-    
+  std::cerr << "...building panel of normals " << out << " from " << inputs.size() << " inputs" << std::endl;
+  int64_t n = PONFilter::Build(inputs, out);
+  if (n < 0) {
+    std::cerr << "ERROR: Could not build panel of normals " << out << std::endl;
+    exit(EXIT_FAILURE);
   }
+  std::cerr << "...wrote " << AddCommas<int64_t>(n) << " sites" << std::endl;
+}
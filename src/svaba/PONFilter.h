@@ -2,32 +2,81 @@
 #define SNOWTOOLS_PONFILTER_H__
 
 #include <string>
+#include <vector>
 #include <cstdlib>
-#include <unordered_map>
+#include <cstdint>
+#include <iostream>
 
+#include "IndelKey.h"
+
+// a site needs to be in this many normals to count against a call
+#define PON_MIN_SAMPLES 2
+
+/** Indel sites seen in a panel of normals, with the number of normals
+ * they were seen in.
+ *
+ * Sites are packed into 64-bit IndelKey keys (chr, pos, length, type), the
+ * same keys as the read CIGAR counts, and kept sorted, so a lookup is a
+ * binary search. The panel is either parsed from the gzipped
+ * text panel, or mapped read-only from a binary panel written by
+ * svaba pon-build. Binary panels hold every count, so new normals can be
+ * folded in later with pon-build --merge.
+ */
 class PONFilter {
-  
- public: 
-  
+
+ public:
+
+  enum { TYPE_ANY = 0, TYPE_DEL = 1, TYPE_INS = 2 };
+
   PONFilter() {}
-  
+
   PONFilter(const std::string& file);
-  
+
+  ~PONFilter();
+
+  PONFilter(const PONFilter&) = delete;
+  PONFilter& operator=(const PONFilter&) = delete;
+
   friend std::ostream& operator<<(std::ostream& out, const PONFilter& p);
-  
-  bool count(const std::string& s) const { return m_map.count(s); }
-  
-  int NSamps(const std::string& s) const { 
-    std::unordered_map<std::string, size_t>::const_iterator it = m_map.find(s);
-    if (it == m_map.end())
-      return 0;
-    return it->second; 
-  }
+
+  /** Is a "chr_pos" site in enough normals? */
+  bool count(const std::string& s) const { return NSamps(s) > 0; }
+
+  /** Number of normals with an indel at a "chr_pos" site (0 if below PON_MIN_SAMPLES) */
+  int NSamps(const std::string& s) const;
+
+  /** Number of normals with an indel at a site (0 if below PON_MIN_SAMPLES).
+   * With TYPE_ANY, the most of any indel starting there */
+  int NSamps(int32_t chr, int32_t pos, int type = TYPE_ANY, int32_t len = 0) const;
+
+  /** Pack a site into its sort key. Lengths are capped at IndelKey::MAX_LEN,
+   * and the site must otherwise fit (IndelKey::Fits) */
+  static uint64_t PackKey(int32_t chr, int32_t pos, int type, int32_t len);
+
+  /** Sum the counts of text and/or binary panels into one binary panel
+   * @return Number of sites written, or -1 on a read or write error
+   */
+  static int64_t Build(const std::vector<std::string>& inputs, const std::string& out);
 
  private:
-  
-  std::unordered_map<std::string, size_t> m_map;
-  
+
+  const uint64_t * m_keys = nullptr;
+  const uint32_t * m_counts = nullptr;
+  size_t m_size = 0;
+
+  // backing store when parsed from text
+  std::vector<uint64_t> m_loaded_keys;
+  std::vector<uint32_t> m_loaded_counts;
+
+  // backing store when mapped from a binary panel
+  void * m_map = nullptr;
+  size_t m_map_size = 0;
+
+  bool mapPanel(const std::string& file);
+
 };
 
+/** Entry point for svaba pon-build */
+void runPONBuild(int argc, char** argv);
+
 #endif
@@ -0,0 +1,35 @@
+#include "PackedCigarMap.h"
+
+#include <algorithm>
+#include <cassert>
+
+void PackedCigarMap::Finalize() {
+
+  if (m_final)
+    return;
+
+  std::sort(m_keys.begin(), m_keys.end());
+
+  // collapse runs of the same key in place
+  m_counts.clear();
+  size_t n = 0;
+  for (size_t i = 0; i < m_keys.size(); ++i) {
+    if (n && m_keys[n-1] == m_keys[i]) {
+      ++m_counts.back();
+    } else {
+      m_keys[n++] = m_keys[i];
+      m_counts.push_back(1);
+    }
+  }
+  m_keys.resize(n);
+  m_final = true;
+}
+
+int PackedCigarMap::Count(uint64_t key) const {
+
+  assert(m_final);
+  auto ff = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+  if (ff == m_keys.end() || *ff != key)
+    return 0;
+  return m_counts[ff - m_keys.begin()];
+}
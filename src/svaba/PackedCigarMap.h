@@ -0,0 +1,61 @@
+#ifndef SVABA_PACKED_CIGAR_MAP_H__
+#define SVABA_PACKED_CIGAR_MAP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "IndelKey.h"
+
+/** Number of reads with each indel in their CIGAR, for one sample in a window.
+ *
+ * Indels are packed into 64-bit IndelKey keys, which sort by position
+ * and are the same keys the panel of normals uses. Keys are appended as reads are
+ * walked, then sorted and collapsed to counts by Finalize, after which
+ * counts are looked up by binary search. This replaces a string-keyed
+ * map ("chr_pos_lenD"), whose keys had to be formatted and hashed for
+ * every indel of every read.
+ */
+class PackedCigarMap {
+
+ public:
+
+  /** Key of an indel. 0 if it can't be packed (an indel over 8191 bp, or
+   * a chromosome ID over 2^19), which is never counted */
+  static uint64_t Key(int32_t chr, int32_t pos, uint32_t len, bool del) {
+    if (len == 0 || !IndelKey::Fits(chr, pos, len))
+      return 0;
+    return IndelKey::Pack(chr, pos, len, del);
+  }
+
+  /** Count one read with this indel */
+  void Add(uint64_t key) {
+    if (key)
+      m_keys.push_back(key);
+  }
+
+  /** Sort and collapse the keys to counts. Call before Count */
+  void Finalize();
+
+  /** Number of reads with this indel */
+  int Count(uint64_t key) const;
+
+  /** Number of distinct indels (once finalized) */
+  size_t size() const { return m_keys.size(); }
+
+  void clear() {
+    m_keys.clear();
+    m_counts.clear();
+    m_final = false;
+  }
+
+ private:
+
+  std::vector<uint64_t> m_keys;
+  std::vector<uint32_t> m_counts; // parallel to m_keys, once finalized
+
+  bool m_final = false;
+
+};
+
+#endif
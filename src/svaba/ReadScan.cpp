@@ -0,0 +1,60 @@
+#include "ReadScan.h"
+
+// CAAGCAGAAGACGGCAT, the Illumina PE 2.0 primer
+#define PRIMER_LEN 17
+static const char * PRIMER = "CAAGCAGAAGACGGCAT";
+
+// BAM 4-bit base to 2 bits, or -1 for anything but A, C, G or T
+static const int8_t NT16_TO_2BIT[16] = {-1, 0, 1, -1, 2, -1, -1, -1, 3, -1, -1, -1, -1, -1, -1, -1};
+
+// the primer as the rolling code of its bases
+static uint64_t primer_code() {
+  uint64_t c = 0;
+  for (int i = 0; i < PRIMER_LEN; ++i)
+    c = (c << 2) | (PRIMER[i] == 'A' ? 0 : PRIMER[i] == 'C' ? 1 : PRIMER[i] == 'G' ? 2 : 3);
+  return c;
+}
+
+void ReadScan::Scan(const bam1_t * b, int qual_trim) {
+
+  static const uint64_t code = primer_code();
+  static const uint64_t mask = (1ULL << (2 * PRIMER_LEN)) - 1;
+
+  const uint8_t * seq = bam_get_seq(b);
+  const uint8_t * qual = bam_get_qual(b);
+  int32_t len = b->core.l_qseq;
+
+  // Ns and the primer, in one pass over the bases
+  n_count = 0;
+  primer = false;
+  uint64_t roll = 0;
+  int run = 0; // bases since the last non-ACGT
+  for (int32_t i = 0; i < len; ++i) {
+    int c = bam_seqi(seq, i);
+    n_count += (c == 15);
+    int t = NT16_TO_2BIT[c];
+    if (t < 0) {
+      run = 0;
+      continue;
+    }
+    roll = ((roll << 2) | t) & mask;
+    if (++run >= PRIMER_LEN && roll == code)
+      primer = true;
+  }
+
+  // quality trim bounds. No qualities keeps the whole read
+  trim_start = 0;
+  trim_end = -1;
+  if (!len || qual[0] == 0xff)
+    return;
+  for (int32_t i = 0; i < len; ++i)
+    if (qual[i] >= qual_trim) {
+      trim_start = i;
+      break;
+    }
+  for (int32_t i = len - 1; i >= 0; --i)
+    if (qual[i] >= qual_trim) {
+      trim_end = i + 1;
+      break;
+    }
+}
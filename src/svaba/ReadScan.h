@@ -0,0 +1,35 @@
+#ifndef SVABA_READ_SCAN_H__
+#define SVABA_READ_SCAN_H__
+
+#include <cstdint>
+
+#include "htslib/sam.h"
+
+/** The per-read checks of the BAM walker, made on the packed BAM record.
+ *
+ * One pass over the 4-bit bases counts the Ns and looks for the Illumina
+ * PE primer (as a rolling 2-bit code of the last 17 bases), and the
+ * quality-trim bounds are found from the two ends of the qualities. No
+ * std::string of the read is made.
+ */
+struct ReadScan {
+
+  int n_count = 0;
+
+  // quality trimmed read is [trim_start, trim_end). trim_end is -1 if
+  // the read has no qualities, or none pass, as with
+  // BamRecord::QualityTrimmedSequence
+  int32_t trim_start = 0;
+  int32_t trim_end = -1;
+
+  bool primer = false; // has the Illumina PE 2.0 primer
+
+  /** Scan a read
+   * @param b Read to scan
+   * @param qual_trim Quality bases are trimmed below
+   */
+  void Scan(const bam1_t * b, int qual_trim);
+
+};
+
+#endif
@@ -0,0 +1,13 @@
+#include "SampleIndex.h"
+
+std::vector<std::string> SampleIndex::s_names;
+
+std::unordered_map<std::string, int> SampleIndex::s_index;
+
+void SampleIndex::Set(const std::vector<std::string>& prefixes) {
+
+  s_names = prefixes;
+  s_index.clear();
+  for (size_t i = 0; i < s_names.size(); ++i)
+    s_index[s_names[i]] = i;
+}
@@ -0,0 +1,44 @@
+#ifndef SVABA_SAMPLE_INDEX_H__
+#define SVABA_SAMPLE_INDEX_H__
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** The samples (input BAMs) of a run, by ID prefix (e.g. t000, n001).
+ *
+ * Samples are numbered in prefix order, which is the order of the sample
+ * columns of the outputs, so that per-sample data (the alleles of a
+ * BreakPoint, the cigar maps and coverages of a window) can be held in
+ * dense arrays instead of maps keyed on the prefix strings.
+ */
+class SampleIndex {
+
+ public:
+
+  /** Set the samples of the run, in column (prefix) order. Call before
+   * making any BreakPoints */
+  static void Set(const std::vector<std::string>& prefixes);
+
+  static size_t size() { return s_names.size(); }
+
+  /** Number of a sample, or -1 if it is not one of the run */
+  static int Get(const std::string& prefix) {
+    auto ff = s_index.find(prefix);
+    return ff == s_index.end() ? -1 : ff->second;
+  }
+
+  static const std::string& Name(size_t i) { return s_names[i]; }
+
+  /** Is it a case (tumor) sample, rather than a control? */
+  static bool IsCase(size_t i) { return s_names[i].at(0) == 't'; }
+
+ private:
+
+  static std::vector<std::string> s_names;
+
+  static std::unordered_map<std::string, int> s_index;
+
+};
+
+#endif
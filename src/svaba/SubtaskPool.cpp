@@ -0,0 +1,108 @@
+#include "SubtaskPool.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "SeqLib/SeqLibUtils.h"
+
+SubtaskPool::SubtaskPool() {
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_work, NULL);
+  pthread_cond_init(&m_done, NULL);
+}
+
+SubtaskPool::~SubtaskPool() {
+  pthread_mutex_destroy(&m_mutex);
+  pthread_cond_destroy(&m_work);
+  pthread_cond_destroy(&m_done);
+}
+
+bool SubtaskPool::take(Job * j, size_t& begin, size_t& end) {
+  if (j->next >= j->n)
+    return false;
+  begin = j->next;
+  end = std::min(j->n, begin + j->chunk);
+  j->next = end;
+  if (j->next >= j->n) // nothing left to hand out
+    m_jobs.remove(j);
+  return true;
+}
+
+void SubtaskPool::run(Job * j, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i)
+    (*j->fn)(i);
+  pthread_mutex_lock(&m_mutex);
+  if (++j->done_chunks == j->num_chunks)
+    pthread_cond_broadcast(&m_done);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void SubtaskPool::ParallelFor(size_t n, size_t chunk, const std::function<void(size_t)>& fn) {
+
+  if (!n)
+    return;
+
+  Job j;
+  j.fn = &fn;
+  j.n = n;
+  j.chunk = std::max(chunk, (size_t)1);
+  j.num_chunks = (n + j.chunk - 1) / j.chunk;
+
+  pthread_mutex_lock(&m_mutex);
+  ++m_num_jobs;
+  if (j.num_chunks > 1) {
+    m_jobs.push_back(&j);
+    pthread_cond_broadcast(&m_work);
+  }
+
+  // work through it here too
+  size_t begin, end;
+  while (take(&j, begin, end)) {
+    pthread_mutex_unlock(&m_mutex);
+    run(&j, begin, end);
+    pthread_mutex_lock(&m_mutex);
+  }
+
+  // wait on chunks still running on helpers
+  while (j.done_chunks < j.num_chunks)
+    pthread_cond_wait(&m_done, &m_mutex);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void SubtaskPool::Help() {
+
+  pthread_mutex_lock(&m_mutex);
+  ++m_idle;
+
+  for (;;) {
+
+    // everyone is out of windows, so nothing more can be posted
+    if (m_idle >= m_workers && m_jobs.empty()) {
+      pthread_cond_broadcast(&m_work);
+      break;
+    }
+
+    // jobs in the list always have chunks left
+    if (!m_jobs.empty()) {
+      Job * j = m_jobs.front();
+      size_t begin, end;
+      take(j, begin, end);
+      ++m_helped_chunks;
+      pthread_mutex_unlock(&m_mutex);
+      run(j, begin, end);
+      pthread_mutex_lock(&m_mutex);
+      continue;
+    }
+
+    pthread_cond_wait(&m_work, &m_mutex);
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+}
+
+std::string SubtaskPool::Stats() const {
+  std::stringstream ss;
+  ss << "...idle threads helped with " << SeqLib::AddCommas(m_helped_chunks) << " chunks of "
+     << SeqLib::AddCommas(m_num_jobs) << " hot-window loops";
+  return ss.str();
+}
@@ -0,0 +1,71 @@
+#ifndef SVABA_SUBTASK_POOL_H__
+#define SVABA_SUBTASK_POOL_H__
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include <functional>
+
+/** Lets worker threads that have run out of windows help with the loops
+ * of windows that are still running.
+ *
+ * A few pathological windows (satellites, amplicons, viral integrations)
+ * can take minutes on one thread while the rest of the pool sits idle at
+ * the end of the run. A hot window posts its per-read and per-contig loops
+ * here with ParallelFor. The posting thread works through the loop itself,
+ * and any worker parked in Help takes chunks of it too. With no helpers
+ * around, ParallelFor is just the serial loop.
+ */
+class SubtaskPool {
+
+ public:
+
+  SubtaskPool();
+
+  ~SubtaskPool();
+
+  /** Number of workers that will call Help when out of windows */
+  void SetNumWorkers(int n) { m_workers = n; }
+
+  /** Run fn(i) for every i in [0, n), in chunks of chunk indices. Returns once all are done */
+  void ParallelFor(size_t n, size_t chunk, const std::function<void(size_t)>& fn);
+
+  /** Park a worker that is out of windows, running chunks of posted loops
+   * until every worker is out of windows */
+  void Help();
+
+  /** Summary of the work done by helpers, for the log */
+  std::string Stats() const;
+
+ private:
+
+  struct Job {
+    const std::function<void(size_t)> * fn;
+    size_t n;
+    size_t chunk;
+    size_t next = 0;        // first index not yet taken
+    size_t num_chunks = 0;
+    size_t done_chunks = 0;
+  };
+
+  std::list<Job*> m_jobs; // loops with chunks left to take
+
+  int m_workers = 0;
+  int m_idle = 0;
+
+  size_t m_num_jobs = 0;
+  size_t m_helped_chunks = 0; // chunks run by a thread other than the poster
+
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_work; // helpers wait for jobs
+  pthread_cond_t m_done; // posters wait for their chunks to finish
+
+  // take the next chunk of a job. Call with the lock held
+  bool take(Job * j, size_t& begin, size_t& end);
+
+  // run a chunk and mark it done
+  void run(Job * j, size_t begin, size_t end);
+
+};
+
+#endif
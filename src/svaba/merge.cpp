@@ -0,0 +1,322 @@
+#include "merge.h"
+
+#include <getopt.h>
+#include <sstream>
+#include <iostream>
+#include <unordered_map>
+
+#include "gzstream.h"
+#include "SeqLib/BamReader.h"
+
+#include "BgzfOutput.h"
+#include "AlignmentPlot.h"
+
+#include "vcf.h"
+#include "BreakPoint.h"
+#include "DiscordantCluster.h"
+#include "svabaUtils.h"
+
+namespace opt {
+
+  static std::string analysis_id = "no_id";
+  static int num_shards = 0;
+  static std::string bam;
+  static std::string refgenome;
+  static bool zip = false;
+  static bool no_unfiltered = false;
+  static int verbose = 1;
+  static std::string args = "svaba merge ";
+}
+
+enum {
+  OPT_NO_UNFILTERED
+};
+
+static const char* shortopts = "ha:N:b:G:v:z";
+static const struct option longopts[] = {
+  { "help",                    no_argument, NULL, 'h' },
+  { "id-string",               required_argument, NULL, 'a'},
+  { "num-shards",              required_argument, NULL, 'N'},
+  { "bam",                     required_argument, NULL, 'b'},
+  { "reference-genome",        required_argument, NULL, 'G'},
+  { "verbose",                 required_argument, NULL, 'v' },
+  { "g-zip",                   no_argument, NULL, 'z' },
+  { "no-unfiltered",           no_argument, NULL, OPT_NO_UNFILTERED },
+  { NULL, 0, NULL, 0 }
+};
+
+static const char *MERGE_USAGE_MESSAGE =
+"Usage: svaba merge -a <id> -N <num shards> -b <bam>\n\n"
+"  Description: Combine the outputs of svaba run --shard i/N into one set of outputs and VCFs\n"
+"\n"
+"  General options\n"
+"  -v, --verbose                        Select verbosity level (0-4). Default: 1 \n"
+"  -h, --help                           Display this help and exit\n"
+"  Required input\n"
+"  -a, --id-string                      Analysis ID given to svaba run. Shard outputs are read from <id>.shard<i>of<N>.*\n"
+"  -N, --num-shards                     Number of shards the run was split into\n"
+"  -b, --bam                            BAM file used to grab header from\n"
+"  Optional input\n"
+"  -G, --reference-genome               Reference genome, recorded in the VCF header\n"
+"  Output options\n"
+"  -z, --g-zip                          Gzip and tabix the output VCF files. [off]\n"
+"      --no-unfiltered                  Don't output the unfiltered variants to a separate VCF\n"
+"\n";
+
+// parse the command line options
+void parseMergeOptions(int argc, char** argv) {
+
+  bool die = false;
+
+  if (argc <= 2)
+    die = true;
+
+  for (int i = 1; i < argc; ++i)
+    opt::args += std::string(argv[i]) + " ";
+
+  for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    switch (c) {
+    case 'h': die = true; break;
+    case 'a': arg >> opt::analysis_id; break;
+    case 'N': arg >> opt::num_shards; break;
+    case 'b': arg >> opt::bam; break;
+    case 'G': arg >> opt::refgenome; break;
+    case 'v': arg >> opt::verbose; break;
+    case 'z': opt::zip = true; break;
+    case OPT_NO_UNFILTERED: opt::no_unfiltered = true; break;
+    default: die = true;
+    }
+  }
+
+  if (opt::num_shards < 1) {
+    std::cerr << "ERROR: number of shards (-N) is required" << std::endl;
+    die = true;
+  }
+
+  if (opt::bam.length() == 0) {
+    std::cerr << "ERROR: BAM is required (for the header)" << std::endl;
+    die = true;
+  }
+
+  if (die) {
+    std::cerr << "\n" << MERGE_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// name of one shard's output file
+static std::string shard_file(int shard, const std::string& suffix) {
+  return svabaUtils::shardPrefix(opt::analysis_id, shard, opt::num_shards) + suffix;
+}
+
+// concatenate the alignment plot records, re-indexing them
+static void merge_plots(OutputPool * pool) {
+
+  AlignmentPlotWriter out;
+  out.Open(opt::analysis_id + ".alignments.bin", pool);
+
+  std::string name, rec;
+  for (int i = 1; i <= opt::num_shards; ++i) {
+    AlignmentPlotReader in;
+    if (!in.Open(shard_file(i, ".alignments.bin"))) {
+      std::cerr << "WARNING: Skipping the alignment plots of shard " << i << std::endl;
+      continue;
+    }
+    while (in.NextRaw(name, rec))
+      out.WriteRaw(name, rec);
+  }
+  out.Close();
+}
+
+// first two columns of a line, as the chromosome (by name) and
+// position the output is sorted on
+static void line_position(const std::string& line, const SeqLib::BamHeader& hdr, int32_t& chr, int32_t& pos) {
+  size_t t1 = line.find('\t');
+  size_t t2 = t1 == std::string::npos ? t1 : line.find('\t', t1 + 1);
+  chr = -1;
+  pos = 0;
+  if (t2 == std::string::npos)
+    return;
+  try {
+    chr = hdr.Name2ID(line.substr(0, t1));
+    pos = std::stoi(line.substr(t1 + 1, t2 - t1 - 1));
+  } catch (...) {
+    chr = -1;
+  }
+}
+
+void runMergeShards(int argc, char** argv) {
+
+  parseMergeOptions(argc, argv);
+
+  // make sure every shard finished before writing anything
+  for (int i = 1; i <= opt::num_shards; ++i) {
+    if (!SeqLib::read_access_test(shard_file(i, ".bps.txt.gz"))) {
+      std::cerr << "ERROR: Cannot read " << shard_file(i, ".bps.txt.gz") << ". Did shard " << i << " finish?" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  SeqLib::BamReader bwalker;
+  if (!bwalker.Open(opt::bam)) {
+    std::cerr << "ERROR: Cannot open BAM " << opt::bam << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  SeqLib::BamHeader hdr = bwalker.Header();
+
+  // compress on a couple of threads while the shards are read
+  OutputPool pool;
+  pool.Init(2);
+
+  // breakpoints. Every window ran in exactly one shard, so the rows are the
+  // same as from an unsharded run. Events called twice in overlapping windows
+  // (in the same or different shards) are deduplicated by VCFFile below
+  if (opt::verbose)
+    std::cerr << "...merging breakpoints from " << opt::num_shards << " shards" << std::endl;
+  std::string bps_header;
+  std::string bps_file = opt::analysis_id + ".bps.txt.gz";
+  BgzfTextWriter os_allbps;
+  os_allbps.Open(bps_file, &pool);
+  os_allbps.SetSorted(svabaUtils::tabixConf());
+  std::string line;
+  int32_t chr, pos;
+  size_t bps_count = 0;
+  for (int i = 1; i <= opt::num_shards; ++i) {
+    igzstream in(shard_file(i, ".bps.txt.gz").c_str(), std::ios::in);
+    bool first = true;
+    while (std::getline(in, line, '\n')) {
+      if (first) {
+	first = false;
+	if (bps_header.empty()) {
+	  // the samples are found after the fixed columns, so those have to match
+	  if (line.compare(0, BreakPoint::header().length() + 1, BreakPoint::header() + "\t") != 0) {
+	    std::cerr << "ERROR: Breakpoint columns of " << shard_file(i, ".bps.txt.gz") << " don't match those of this svaba" << std::endl;
+	    exit(EXIT_FAILURE);
+	  }
+	  bps_header = line;
+	  os_allbps.Write(line);
+	} else if (line != bps_header) {
+	  std::cerr << "ERROR: Samples in " << shard_file(i, ".bps.txt.gz") << " don't match those of shard 1" << std::endl;
+	  exit(EXIT_FAILURE);
+	}
+	continue;
+      }
+      line_position(line, hdr, chr, pos);
+      os_allbps.Write(chr, pos, line);
+      ++bps_count;
+    }
+  }
+  os_allbps.Close();
+  if (opt::verbose)
+    std::cerr << "...merged " << SeqLib::AddCommas(bps_count) << " breakpoints" << std::endl;
+
+  // discordant clusters. Clusters from overlapping windows near a shard
+  // boundary come out more than once, so keep the best supported per region
+  std::vector<std::string> dlines;
+  std::unordered_map<std::string, size_t> dindex; // region string to line
+  std::unordered_map<std::string, int> dsupport;
+  size_t dcount = 0;
+  for (int i = 1; i <= opt::num_shards; ++i) {
+    igzstream in(shard_file(i, ".discordant.txt.gz").c_str(), std::ios::in);
+    bool first = true;
+    while (std::getline(in, line, '\n')) {
+      if (first) {
+	first = false;
+	continue;
+      }
+      ++dcount;
+      std::vector<std::string> fields;
+      std::istringstream f(line);
+      std::string val;
+      while (std::getline(f, val, '\t'))
+	fields.push_back(val);
+      if (fields.size() < 14)
+	continue;
+      const std::string& key = fields[13]; // region_string
+      int support = std::stoi(fields[6]) + std::stoi(fields[7]); // tcount + ncount
+      auto ff = dindex.find(key);
+      if (ff == dindex.end()) {
+	dindex[key] = dlines.size();
+	dsupport[key] = support;
+	dlines.push_back(line);
+      } else if (support > dsupport[key]) {
+	dlines[ff->second] = line;
+	dsupport[key] = support;
+      }
+    }
+  }
+  BgzfTextWriter os_discordant;
+  os_discordant.Open(opt::analysis_id + ".discordant.txt.gz", &pool);
+  os_discordant.SetSorted(svabaUtils::tabixConf());
+  os_discordant.Write(DiscordantCluster::header());
+  for (const auto& d : dlines) {
+    line_position(d, hdr, chr, pos);
+    os_discordant.Write(chr, pos, d);
+  }
+  os_discordant.Close();
+  if (opt::verbose)
+    std::cerr << "...merged " << SeqLib::AddCommas(dcount) << " discordant clusters down to " << SeqLib::AddCommas(dlines.size()) << std::endl;
+
+  // contig alignment plots
+  merge_plots(&pool);
+
+  // contigs, sorted and indexed
+  SeqLib::BamHeader contig_header;
+  SortedBamWriter contig_writer;
+  for (int i = 1; i <= opt::num_shards; ++i) {
+    SeqLib::BamReader r;
+    if (!r.Open(shard_file(i, ".contigs.bam"))) {
+      std::cerr << "WARNING: Cannot open " << shard_file(i, ".contigs.bam") << ". Skipping its contigs" << std::endl;
+      continue;
+    }
+    if (!contig_writer.IsOpen()) {
+      contig_header = r.Header();
+      if (!contig_writer.Open(opt::analysis_id + ".contigs.bam", contig_header, &pool))
+	exit(EXIT_FAILURE);
+    }
+    SeqLib::BamRecord rec;
+    while (r.GetNextRecord(rec))
+      contig_writer.WriteRecord(rec);
+  }
+  contig_writer.Close();
+
+  // make the VCF header, as in svaba run
+  VCFHeader header;
+  header.filedate = svabaUtils::fileDateString();
+  header.source = opt::args;
+  header.reference = opt::refgenome;
+  if (!contig_header.isEmpty())
+    for (int i = 0; i < contig_header.NumSequences(); ++i)
+      header.addContigField(contig_header.IDtoName(i), contig_header.GetSequenceLength(i));
+
+  // samples are the bps columns after the fixed ones, as <prefix>_<bam>
+  bool case_control_run = false;
+  std::istringstream f(bps_header.substr(BreakPoint::header().length() + 1));
+  std::string val;
+  while (std::getline(f, val, '\t')) {
+    size_t u = val.find('_');
+    std::string fname = u == std::string::npos ? val : val.substr(u + 1);
+    header.addSampleField(fname);
+    header.colnames += "\t" + fname;
+    if (val.at(0) == 'n')
+      case_control_run = true;
+  }
+
+  if (opt::verbose)
+    std::cerr << "...making the primary VCFs (unfiltered and filtered) from file " << bps_file << std::endl;
+  VCFFile snowvcf(bps_file, opt::analysis_id, hdr, header, !opt::no_unfiltered);
+
+  if (!opt::no_unfiltered) {
+    std::string basename = opt::analysis_id + ".svaba.unfiltered.";
+    snowvcf.include_nonpass = true;
+    snowvcf.writeIndels(basename, opt::zip, !case_control_run);
+    snowvcf.writeSVs(basename, opt::zip,    !case_control_run);
+  }
+
+  std::string basename = opt::analysis_id + ".svaba.";
+  snowvcf.include_nonpass = false;
+  snowvcf.writeIndels(basename, opt::zip, !case_control_run);
+  snowvcf.writeSVs(basename, opt::zip,    !case_control_run);
+
+}
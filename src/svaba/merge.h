@@ -0,0 +1,7 @@
+#ifndef SVABA_MERGE_H__
+#define SVABA_MERGE_H__
+
+void parseMergeOptions(int argc, char** argv);
+void runMergeShards(int argc, char** argv);
+
+#endif
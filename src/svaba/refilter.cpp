@@ -89,7 +89,7 @@ static const char *BP_USAGE_MESSAGE =
 "  -i, --input-bps                      Original bps.txt.gz file\n"
 "  -b, --bam                            BAM file used to grab header from\n"
 "  Optional external database\n"
-"  -D, --dbsnp-vcf                      DBsnp database (VCF) to compare indels against\n"
+"  -D, --dbsnp-vcf                      DBsnp database (VCF, or index from svaba index-dbsnp) to compare indels against\n"
 "  -B, --blacklist                      BED-file with blacklisted regions to not extract any reads from.\n"
 "  -Y, --microbial-genome               Path to indexed reference genome of microbial sequences to be used by BWA-MEM to filter reads.\n"
 "  -V, --germline-sv-database           BED file containing sites of known germline SVs. Used as additional filter for somatic SV detection\n"
@@ -191,7 +191,6 @@ void runRefilterBreakpoints(int argc, char** argv) {
 
   // read in the BPS
   std::vector<std::string> allele_names; // store with real name
-  std::map<std::string, SampleInfo> tmp_alleles;
   std::string line, line2, val;
   igzstream infile(opt::input_file.c_str(), std::ios::in);
   size_t line_count = 0;
@@ -212,23 +211,18 @@ void runRefilterBreakpoints(int argc, char** argv) {
 	}
       }
 
+      // the sample columns, which the alleles of each BreakPoint follow
+      SampleIndex::Set(allele_names);
+
     } else {
 	BreakPoint * bp = new BreakPoint(line, hdr);
 
-	// fill in with the correct names from the header of bps.txt
-	std::string id ;
-	for (auto& i : allele_names) {
-	  id += "A";
-	  tmp_alleles[i] = bp->allele[id];
-	}
-	bp->allele = tmp_alleles;
-
 	// fill in discordant info
-	for (auto& i : bp->allele) {
-	  if (i.first.at(0) == 't')
-	    bp->dc.tcount += i.second.disc;
+	for (size_t i = 0; i < bp->allele.size(); ++i) {
+	  if (SampleIndex::IsCase(i))
+	    bp->dc.tcount += bp->allele[i].disc;
 	  else
-	    bp->dc.ncount += i.second.disc;
+	    bp->dc.ncount += bp->allele[i].disc;
 
 	}
 
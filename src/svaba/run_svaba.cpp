@@ -3,10 +3,16 @@
 #include <getopt.h>
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <numeric>
 #include <unordered_map>
 #include <map>
+#include <deque>
+#include <functional>
 #include <vector>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 
 #include "SeqLib/ReadFilter.h"
 #include "KmerFilter.h"
@@ -16,6 +22,17 @@
 #include "LearnBamParams.h"
 #include "SeqLib/BFC.h"
 #include "svaba_params.h"
+#include "svabaMemory.h"
+#include "IntervalFilter.h"
+#include "MateReadCache.h"
+#include "BadRegionSet.h"
+#include "BamReaderPool.h"
+#include "ContigAlignmentCache.h"
+#include "BgzfOutput.h"
+#include "AlignmentPlot.h"
+#include "CramReference.h"
+#include "BwaImage.h"
+#include "SubtaskPool.h"
 
 // useful replace function
 std::string myreplace(std::string &s,
@@ -25,8 +42,12 @@ std::string myreplace(std::string &s,
   return(s.replace(s.find(toReplace), toReplace.length(), replaceWith));
 }
 
+// threads compressing the outputs, shared by all files (so declared before them)
+static OutputPool out_pool;
+
 // output files
-static ogzstream all_align, os_allbps, os_discordant, os_corrected;
+static BgzfTextWriter os_allbps, os_discordant, os_corrected;
+static AlignmentPlotWriter all_align;
 static std::ofstream log_file, bad_bed;
 static std::stringstream ss; // initalize a string stream once
 
@@ -47,7 +68,6 @@ static SeqLib::RefGenome * ref_genome, * ref_genome_viral;
 static std::unordered_map<std::string, BamParamsMap> params_map; // key is bam id (t000), value is map with read group as key
 static SeqLib::BamHeader bwa_header, viral_header;
 
-static std::set<std::string> prefixes;
 
 static int min_dscrd_size_for_variant = 0; // set a min size for what we can call with discordant reads only. 
 // something like max(mean + 3*sd) for all read groups
@@ -55,17 +75,41 @@ static int min_dscrd_size_for_variant = 0; // set a min size for what we can cal
 static std::unordered_map<std::string, int> min_isize_for_disc;
 
 static SeqLib::BamHeader b_header; // header for main bam
-static SeqLib::BamReader b_reader; // reader for the main bam
-static SeqLib::BamWriter er_writer, b_microbe_writer, b_contig_writer;
+static SortedBamWriter er_writer, b_microbe_writer, b_contig_writer;
 static SeqLib::BWAWrapper * microbe_bwa = nullptr;
 static SeqLib::BWAWrapper * main_bwa = nullptr;
 static SeqLib::Filter::ReadFilterCollection * mr;
 static SeqLib::GRC blacklist, germline_svs, simple_seq;
+static IntervalFilter blacklist_index, simple_seq_index; // flat sorted copies, for fast lookup
 static DBSnpFilter * dbsnp_filter;
 static SeqLib::GRC file_regions, regions_torun;
 
 // mutex and time
 static pthread_mutex_t snow_lock;
+
+// tally of bytes held across all threads, capped by --max-memory
+static svabaMemoryGovernor mem_gov;
+
+// filtered reads from mate regions, shared across threads
+static MateReadCache mate_cache;
+
+// mate regions that hit the read limit, shared across threads
+static BadRegionSet bad_regions;
+
+// genome and microbe alignments of contigs, shared across windows
+static ContigAlignmentCache contig_cache;
+
+// reference and decoding threads shared by all CRAM readers
+static CramReference cram_ref;
+
+// reader for the main bam (after cram_ref, since it may hold the reference and has to close first)
+static svabaBamWalker b_reader;
+
+// open readers of the input BAMs, lent to the walkers of all threads
+static BamReaderPool bam_readers;
+
+// lets threads that are out of windows help with hot ones
+static SubtaskPool subtasks;
 static struct timespec start;
 
 // learned value 
@@ -83,6 +127,9 @@ namespace opt {
     static int num_assembly_rounds = 3;
   }
 
+  // assembler: (s) SGA string graph, (f) fermi-lite, (a) SGA with fermi-lite for deep windows
+  static std::string assembler = "a";
+
   // error correction options
   static std::string ec_correct_type = "f";
   static double ec_subsample = 0.50;
@@ -120,6 +167,8 @@ namespace opt {
   static int max_cov = 100;
   static size_t mate_lookup_min = 3;
   static size_t mate_region_lookup_limit = 400;
+  static size_t mate_cache_mb = MATE_CACHE_SIZE_MB;
+  static size_t contig_cache_mb = CONTIG_CACHE_SIZE_MB;
   static bool interchrom_lookup = true;
   static int32_t max_reads_per_assembly = -1; // set default of 50000 in parseRunOptions
 
@@ -128,11 +177,18 @@ namespace opt {
   static std::string regionFile;  // region to run on
   static std::string analysis_id = "no_id";
   static int num_to_sample = 2000000;  // num to learn from (eg isize distribution)
+  static bool params_cache = false; // keep learned params in a sidecar next to each BAM
 
   // runtime parameters
   static int verbose = 0;
   static int numThreads = 1;
   static bool hp = false; // should run in highly-parallel mode? (no file dump til end)
+  static size_t max_memory = 0; // global memory budget in bytes. 0 is no limit
+  static int cram_threads = 0; // threads for decoding CRAM slices, shared by all readers
+  static int write_threads = 2; // threads for compressing the outputs, shared by all files
+  static int shard = 0; // run only this shard of the windows (1-based). 0 runs all
+  static int num_shards = 0;
+  static std::string bwa_image; // prebuilt image of the -G index, if not at <reference>.img
 
   // data
   static BamMap bam;
@@ -143,6 +199,7 @@ namespace opt {
   static std::string germline_sv_file;
   static std::string dbsnp; // = "/xchip/gistic/Jeremiah/SnowmanFilters/dbsnp_138.b37_indel.vcf";
   static std::string main_bam = "-"; // the main bam
+  static bool streaming = false; // read the inputs once, in order, cutting windows as we go (stdin or chunk 0)
 
   // optimize defaults for single sample mode
   static bool germline = false; 
@@ -170,6 +227,7 @@ enum {
   OPT_DISCORDANT_ONLY,
   OPT_WRITE_EXTRACTED_READS,
   OPT_NUM_ASSEMBLY_ROUNDS,
+  OPT_ASSEMBLER,
   OPT_NUM_TO_SAMPLE,
   OPT_GAP_OPEN,
   OPT_MATCH_SCORE,
@@ -182,7 +240,15 @@ enum {
   OPT_CLIP3,
   OPT_GERMLINE,
   OPT_SCALE_ERRORS,
-  OPT_NO_UNFILTERED
+  OPT_NO_UNFILTERED,
+  OPT_MAX_MEMORY,
+  OPT_MATE_CACHE_SIZE,
+  OPT_CONTIG_CACHE_SIZE,
+  OPT_CRAM_THREADS,
+  OPT_WRITE_THREADS,
+  OPT_SHARD,
+  OPT_BWA_IMAGE,
+  OPT_PARAMS_CACHE
 };
 
 static const char* shortopts = "hzIAt:n:p:v:r:G:e:k:c:a:m:B:D:Y:S:L:s:V:R:K:E:C:x:M:";
@@ -194,6 +260,13 @@ static const struct option longopts[] = {
   { "panel-of-normals",        required_argument, NULL, 'P' },
   { "id-string",               required_argument, NULL, 'a' },
   { "hp",                      no_argument, NULL, OPT_HP },
+  { "max-memory",              required_argument, NULL, OPT_MAX_MEMORY },
+  { "mate-cache-size",         required_argument, NULL, OPT_MATE_CACHE_SIZE },
+  { "contig-cache-size",       required_argument, NULL, OPT_CONTIG_CACHE_SIZE },
+  { "cram-threads",            required_argument, NULL, OPT_CRAM_THREADS },
+  { "write-threads",           required_argument, NULL, OPT_WRITE_THREADS },
+  { "shard",                   required_argument, NULL, OPT_SHARD },
+  { "bwa-image",               required_argument, NULL, OPT_BWA_IMAGE },
   { "normal-bam",              required_argument, NULL, 'n' },
   { "threads",                 required_argument, NULL, 'p' },
   { "no-unfiltered",           no_argument, NULL, OPT_NO_UNFILTERED },
@@ -230,6 +303,7 @@ static const struct option longopts[] = {
   { "scale-errors",            required_argument, NULL, OPT_SCALE_ERRORS },
   { "discordant-only",         no_argument, NULL, OPT_DISCORDANT_ONLY },
   { "num-to-sample",           required_argument, NULL, OPT_NUM_TO_SAMPLE },
+  { "params-cache",            no_argument, NULL, OPT_PARAMS_CACHE },
   { "write-asqg",              no_argument, NULL, OPT_ASQG   },
   { "ec-correct-type",         required_argument, NULL, 'K'},
   { "error-rate",              required_argument, NULL, 'e'},
@@ -239,6 +313,7 @@ static const struct option longopts[] = {
   { "max-reads",               required_argument, NULL, 'x' },
   { "max-reads-mate-region",   required_argument, NULL, 'M' },
   { "num-assembly-rounds",     required_argument, NULL, OPT_NUM_ASSEMBLY_ROUNDS },
+  { "assembler",               required_argument, NULL, OPT_ASSEMBLER },
   { NULL, 0, NULL, 0 }
 };
 
@@ -266,22 +341,31 @@ static const char *RUN_USAGE_MESSAGE =
 "  Additional options\n"                       
 "  -L, --mate-lookup-min                Minimum number of somatic reads required to attempt mate-region lookup [3]\n"
 "  -s, --disc-sd-cutoff                 Number of standard deviations of calculated insert-size distribution to consider discordant. [3.92]\n"
-"  -c, --chunk-size                     Size of a local assembly window (in bp). Set 0 for whole-BAM in one assembly. [25000]\n"
+"  -c, --chunk-size                     Size of a local assembly window (in bp). Set 0 to stream the whole BAM in one sorted pass (as for stdin). [25000]\n"
 "  -x, --max-reads                      Max total read count to read in from assembly region. Set 0 to turn off. [50000]\n"
 "  -M, --max-reads-mate-region          Max weird reads to include from a mate lookup region. [400]\n"
+"      --mate-cache-size                Size (MB) of a cache of mate-region reads shared across threads (e.g. 256). Faster, but the\n"
+"                                       mate read limit is per 2 kb tile and cached reads don't train error correction, so calls can differ. [0, off]\n"
+"      --contig-cache-size              Size (MB) of the cache of contig alignments shared across windows. 0 to turn off. [64]\n"
 "  -C, --max-coverage                   Max read coverage to send to assembler (per BAM). Subsample reads if exceeded. [500]\n"
 "      --no-interchrom-lookup           Skip mate lookup for inter-chr candidate events. Reduces power for translocations but less I/O.\n"
 "      --discordant-only                Only run the discordant read clustering module, skip assembly. \n"
 "      --num-assembly-rounds            Run assembler multiple times. > 1 will bootstrap the assembly. [2]\n"
-"      --num-to-sample                  When learning about inputs, number of reads to sample. [2,000,000]\n"
+"      --num-to-sample                  When learning about inputs, max number of reads to sample. [2,000,000]\n"
+"      --params-cache                   Reuse the learned input params from (or save them to) <bam>.svaba_params.\n"
 "      --hp                             Highly parallel. Don't write output until completely done. More memory, but avoids all thread-locks.\n"
+"      --shard                          Run only shard i of N (e.g. 2/8) of the windows, balanced by estimated cost. Combine with svaba merge.\n"
+"      --max-memory                     Approximate memory budget across all threads (e.g. 16G). Flushes output and holds back new windows near the limit. [off]\n"
+"      --cram-threads                   Extra threads for decoding CRAM slices, shared by all readers. CRAMs are decoded with the -G reference. [0]\n"
+"      --write-threads                  Extra threads for compressing the outputs, shared by all files. [2]\n"
+"      --bwa-image                      Map this image of the -G index (from svaba index-image) instead of loading the index. [<reference>.img if present]\n"
 "  Output options\n"
 "  -z, --g-zip                          Gzip and tabix the output VCF files. [off]\n"
 "  -A, --all-contigs                    Output all contigs that were assembled, regardless of mapping or length. [off]\n"
 "      --read-tracking                  Track supporting reads by qname. Increases file sizes. [off]\n"
 "      --write-extracted-reads          For the case BAM, write reads sent to assembly to a BAM file. [off]\n"
 "  Optional external database\n"
-"  -D, --dbsnp-vcf                      DBsnp database (VCF) to compare indels against\n"
+"  -D, --dbsnp-vcf                      DBsnp database (VCF, or index from svaba index-dbsnp) to compare indels against\n"
 "  -B, --blacklist                      BED-file with blacklisted regions to not extract any reads from.\n"
 "  -Y, --microbial-genome               Path to indexed reference genome of microbial sequences to be used by BWA-MEM to filter reads.\n"
 "  -V, --germline-sv-database           BED file containing sites of known germline SVs. Used as additional filter for somatic SV detection\n"
@@ -292,6 +376,7 @@ static const char *RUN_USAGE_MESSAGE =
 "  -K, --ec-correct-type                (f) Fermi-kit BFC correction, (s) Kmer-correction from SGA, (0) no correction (then suggest non-zero -e) [f]\n"
 "  -E, --ec-subsample                   Learn from fraction of non-weird reads during error-correction. Lower number = faster compute [0.5]\n"
 "      --write-asqg                     Output an ASQG graph file for each assembly window.\n"
+"      --assembler                      (s) SGA string graph, (f) fermi-lite unitigs, (a) SGA, with fermi-lite for deep windows that SGA would skip [a]\n"
 "  BWA-MEM alignment params\n"
 "      --bwa-match-score                Set the BWA-MEM match score. BWA-MEM -A [2]\n"
 "      --gap-open-penalty               Set the BWA-MEM gap open penalty for contig to genome alignments. BWA-MEM -O [32]\n"
@@ -310,6 +395,7 @@ void runsvaba(int argc, char** argv) {
 
   // open the output streams
   svabaUtils::fopen(opt::analysis_id + ".log", log_file);
+  out_pool.Init(opt::write_threads);
   //  svabaUtils::fopen(opt::analysis_id + ".bad_mate_regions.bed", bad_bed);
 
   // will check later if reads have different max mapq or readlen
@@ -346,7 +432,8 @@ void runsvaba(int argc, char** argv) {
     "    Subsample-rate for correction learning: " + std::to_string(opt::ec_subsample) << std::endl;
     ss << 
       "    ErrorRate: " << (opt::sga::error_rate < 0.001f ? "EXACT (0)" : std::to_string(opt::sga::error_rate)) << std::endl << 
-      "    Num assembly rounds: " << opt::sga::num_assembly_rounds << std::endl;
+      "    Num assembly rounds: " << opt::sga::num_assembly_rounds << std::endl << 
+      "    Assembler: " << opt::assembler << std::endl;
   ss << 
     "    Num reads to sample: " << opt::num_to_sample << std::endl << 
     "    Discordant read extract SD cutoff:  " << opt::sd_disc_cutoff << std::endl << 
@@ -375,6 +462,14 @@ void runsvaba(int argc, char** argv) {
     ss << "    ######## ONLY DISCORDANT READ CLUSTERING. NO ASSEMBLY ##############" << std::endl;
   if (!opt::interchrom_lookup)
     ss << "    ######## NOT LOOKING UP MATES FOR INTERCHROMOSOMAL #################" << std::endl;
+  if (opt::max_memory)
+    ss << "    Memory budget: " << svabaMemory::toString(opt::max_memory) << std::endl;
+  if (opt::cram_threads)
+    ss << "    CRAM decoding threads: " << opt::cram_threads << std::endl;
+  if (opt::write_threads)
+    ss << "    Output compression threads: " << opt::write_threads << std::endl;
+  if (!opt::bwa_image.empty())
+    ss << "    BWA index image: " << opt::bwa_image << std::endl;
   ss <<
     "*****************************************************************" << std::endl;	  
   WRITELOG(ss.str(), opt::verbose >= 1, true);
@@ -389,10 +484,14 @@ void runsvaba(int argc, char** argv) {
   if (!opt::microbegenome.empty()) {
     WRITELOG("...loading the microbe reference sequence", opt::verbose > 0, true)
     microbe_bwa = new SeqLib::BWAWrapper();
-    svabaUtils::__open_index_and_writer(opt::microbegenome, microbe_bwa, opt::analysis_id + ".microbe.bam", b_microbe_writer, ref_genome_viral, viral_header);  
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    svabaUtils::__open_index(opt::microbegenome, microbe_bwa, ref_genome_viral, viral_header);  
+    b_microbe_writer.Open(opt::analysis_id + ".microbe.bam", viral_header, &out_pool);
+    log_index_load(opt::microbegenome, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
   }
 
-  // open the main bam to get header info
+  // open the main bam to get header info. It may be stdin, which can
+  // only be read once, so its format is checked on this reader
   if (!b_reader.Open(opt::main_bam)) {
     if (opt::main_bam == "-")
       std::cerr << "ERROR: Cannot read from stdin" << std::endl;
@@ -401,6 +500,34 @@ void runsvaba(int argc, char** argv) {
     exit(EXIT_FAILURE);
   }
 
+  // load the reference once for all of the CRAM inputs. A main CRAM holds it
+  // itself, else the first other CRAM file is opened for it (stdin is
+  // left to the stream, which is the only one that can read it)
+  std::string cram_file;
+  if (CramReference::IsCram(b_reader.File()))
+    cram_file = opt::main_bam;
+  else
+    for (auto& b : opt::bam)
+      if (b.second != opt::main_bam && b.second != "-" && CramReference::IsCram(b.second)) {
+	cram_file = b.second;
+	break;
+      }
+  if (!cram_file.empty()) {
+    WRITELOG("...loading shared CRAM reference " + opt::refgenome, opt::verbose > 0, true);
+    bool ok = cram_file == opt::main_bam ? cram_ref.Init(opt::refgenome, b_reader.File(), opt::cram_threads) :
+      cram_ref.Init(opt::refgenome, cram_file, opt::cram_threads);
+    if (!ok) {
+      std::cerr << "ERROR: Unable to decode CRAM " << cram_file << " with reference " << opt::refgenome << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  b_reader.UseCramReference(&cram_ref);
+
+  // the threads share the open readers of each input
+  for (auto& b : opt::bam)
+    bam_readers.Add(b.first, b.second);
+  bam_readers.SetCramReference(&cram_ref);
+
   // then open the main header
   b_header = b_reader.Header();
   if (b_header.isEmpty()) {
@@ -410,7 +537,7 @@ void runsvaba(int argc, char** argv) {
   
   // open some writer bams
   if (opt::write_extracted_reads) // open the extracted reads writer
-    svabaUtils::__openWriterBam(b_header, opt::analysis_id + ".extracted.reads.bam", er_writer);    
+    er_writer.Open(opt::analysis_id + ".extracted.reads.bam", b_header, &out_pool);
 
   // open the blacklists
   svabaUtils::__open_bed(opt::blacklist, blacklist, b_header);
@@ -427,19 +554,29 @@ void runsvaba(int argc, char** argv) {
   if (simple_seq.size())
     ss << "...loaded " << simple_seq.size() << " simple sequence regions from " << opt::simple_file << std::endl;
 
+  // index them for the per-read checks
+  blacklist_index = IntervalFilter(blacklist);
+  simple_seq_index = IntervalFilter(simple_seq);
+
   // open the DBSnpFilter
   if (opt::dbsnp.length()) {
     WRITELOG("...loading the DBsnp database", opt::verbose > 0, true)
       dbsnp_filter = new DBSnpFilter(opt::dbsnp, b_header);
-    WRITELOG("...loaded DBsnp database", opt::verbose > 0, true)
+    std::stringstream dss;
+    dss << "...loaded " << *dbsnp_filter;
+    WRITELOG(dss.str(), opt::verbose > 0, true)
   }
 
-  // needed for aligned contig
+  // number the samples, for the per-sample arrays of the breakpoints
+  std::vector<std::string> prefixes;
   for (auto& b : opt::bam)
-    prefixes.insert(b.first);
+    prefixes.push_back(b.first);
+  SampleIndex::Set(prefixes);
 
-  if (opt::main_bam == "-")
-    opt::single_end = true;
+  // stdin is read once, by the stream, so there is nothing to learn from
+  for (auto& b : opt::bam)
+    if (b.second == "-")
+      opt::single_end = true;
 
   // parse the region file, count number of jobs
   int num_jobs = svabaUtils::countJobs(opt::regionFile, file_regions, regions_torun,
@@ -452,9 +589,13 @@ void runsvaba(int argc, char** argv) {
   // learn bam
   min_dscrd_size_for_variant = 0; // set a min size for what we can call with discordant reads only. 
   for (auto& b : opt::bam) {
-    LearnBamParams parm(b.second);
+    LearnBamParams parm(b.second, cram_ref.Enabled() ? cram_ref.Fasta() : std::string());
+    parm.SetThreads(opt::numThreads);
+    parm.UseCache(opt::params_cache);
     params_map[b.first] = BamParamsMap();
     parm.learnParams(params_map[b.first], opt::num_to_sample);
+    if (parm.FromCache())
+      ss << "...loaded params from " << LearnBamParams::CachePath(b.second) << std::endl;
     for (auto& i : params_map[b.first]) {
       readlen = std::max(readlen, i.second.readlen);
       max_mapq_possible = std::max(max_mapq_possible, i.second.max_mapq);
@@ -526,14 +667,52 @@ afterlearn:
   // open the reference for reading seqeuence
   ref_genome = new SeqLib::RefGenome;
 
-  svabaUtils::__open_index_and_writer(opt::refgenome, main_bwa, opt::analysis_id + ".contigs.bam", b_contig_writer, ref_genome, bwa_header);
+  if (!opt::bwa_image.empty())
+    BwaImage::SetPath(opt::refgenome, opt::bwa_image);
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  svabaUtils::__open_index(opt::refgenome, main_bwa, ref_genome, bwa_header);
+  log_index_load(opt::refgenome, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
   if (ref_genome->IsEmpty()) {
     std::cerr << "ERROR: Unable to open index file: " << opt::refgenome << std::endl;
     exit(EXIT_FAILURE);
    }
+  b_contig_writer.Open(opt::analysis_id + ".contigs.bam", bwa_header, &out_pool);
   
-  if (num_jobs) {
+  // keep only this shard's windows
+  if (opt::num_shards) {
+    if (!num_jobs) {
+      WRITELOG("ERROR: --shard needs windows to split. Can't shard with chunk size <= 0", true, true);
+      exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> bam_files;
+    for (auto& b : opt::bam)
+      bam_files.push_back(b.second);
+    std::vector<double> costs = svabaUtils::windowCosts(bam_files, regions_torun);
+    double total_cost = std::accumulate(costs.begin(), costs.end(), 0.0);
+    SeqLib::GRC shard_windows;
+    double shard_cost = 0;
+    for (const auto& i : svabaUtils::shardWindows(costs, opt::shard - 1, opt::num_shards)) {
+      shard_windows.add(regions_torun[i]);
+      shard_cost += costs[i];
+    }
+
+    std::stringstream sss;
+    sss << "...shard " << opt::shard << " of " << opt::num_shards << ": " << SeqLib::AddCommas(shard_windows.size()) 
+	<< " of " << SeqLib::AddCommas(regions_torun.size()) << " windows, " << std::fixed << std::setprecision(1) 
+	<< (total_cost > 0 ? 100.0 * shard_cost / total_cost : 0) << "% of estimated cost";
+    WRITELOG(sss.str(), opt::verbose, true);
+
+    regions_torun = shard_windows;
+    num_jobs = regions_torun.size();
+  }
+
+  if (num_jobs && opt::streaming) {
+    WRITELOG("...streaming " + (opt::main_bam == "-" ? std::string("stdin") : std::string("inputs")) + " in one pass through " + 
+	     SeqLib::AddCommas(num_jobs) + " windows of " + SeqLib::AddCommas(opt::chunk) + " bp", opt::verbose, true);
+  } else if (num_jobs) {
     WRITELOG("...running on " + SeqLib::AddCommas(num_jobs) + " chunks", opt::verbose, true);
+  } else if (opt::num_shards) {
+    WRITELOG("...no windows in this shard", opt::verbose, true);
   } else {
     WRITELOG("Chunk was <= 0: READING IN WHOLE GENOME AT ONCE", opt::verbose, true);
   }
@@ -580,25 +759,40 @@ afterlearn:
   num_jobs = (num_jobs == 0) ? 1 : num_jobs;
   opt::numThreads = std::min(num_jobs, opt::numThreads);
 
+  // set the global memory budget
+  mem_gov.SetBudget(opt::max_memory);
+
+  // set up the mate-region read cache
+  mate_cache.SetMaxBytes(opt::mate_cache_mb * 1024 * 1024);
+  mate_cache.SetGovernor(&mem_gov);
+  mate_cache.SetBadRegions(&bad_regions);
+
+  // set up the contig alignment cache
+  contig_cache.SetMaxBytes(opt::contig_cache_mb * 1024 * 1024);
+  contig_cache.SetGovernor(&mem_gov);
+
   // open the mutex
   if (pthread_mutex_init(&snow_lock, NULL) != 0) {
     std::cerr << "\n mutex init failed\n";
     exit(EXIT_FAILURE);
   }
 
-  // open the text files
-  svabaUtils::fopen(opt::analysis_id + ".alignments.txt.gz", all_align);
-  svabaUtils::fopen(opt::analysis_id + ".bps.txt.gz", os_allbps);
-  svabaUtils::fopen(opt::analysis_id + ".discordant.txt.gz", os_discordant);
+  // open the text files. Breakpoints and discordant clusters are
+  // sorted and tabix indexed on the first break-end
+  all_align.Open(opt::analysis_id + ".alignments.bin", &out_pool);
+  os_allbps.Open(opt::analysis_id + ".bps.txt.gz", &out_pool);
+  os_allbps.SetSorted(svabaUtils::tabixConf());
+  os_discordant.Open(opt::analysis_id + ".discordant.txt.gz", &out_pool);
+  os_discordant.SetSorted(svabaUtils::tabixConf());
   if (opt::write_extracted_reads) 
-    svabaUtils::fopen(opt::analysis_id + ".corrected.fa.gz", os_corrected); 
+    os_corrected.Open(opt::analysis_id + ".corrected.fa.gz", &out_pool); 
   
   // write the headers to the text files
-  os_allbps << BreakPoint::header();
+  std::string bps_header = BreakPoint::header();
   for (auto& b : opt::bam) 
-    os_allbps << "\t" << b.first << "_" << b.second;
-  os_allbps << std::endl;
-  os_discordant << DiscordantCluster::header() << std::endl;
+    bps_header += "\t" + b.first + "_" + b.second;
+  os_allbps.Write(bps_header);
+  os_discordant.Write(DiscordantCluster::header());
 
   // put args into string for VCF later
   for (int i = 0; i < argc; ++i)
@@ -611,7 +805,8 @@ afterlearn:
 
   // send the jobs to the queue
   WRITELOG("--- Loaded non-read data. Starting detection pipeline", true, true);
-  sendThreads(regions_torun);
+  if (regions_torun.size() || !opt::num_shards) // an empty region list means whole genome, unless sharded
+    sendThreads(regions_torun);
 
   if (microbe_bwa)
     delete microbe_bwa;
@@ -630,12 +825,15 @@ afterlearn:
   bad_bed.close();
   */
 
-  // close the files
-  all_align.close();
-  os_allbps.close();
-  os_discordant.close();
-  if (opt::write_corrected_reads) 
-    os_corrected.close();
+  // close the files. Sorted files are merged and indexed here
+  WRITELOG("...sorting and indexing the outputs", opt::verbose > 0, true);
+  all_align.Close();
+  os_allbps.Close();
+  os_discordant.Close();
+  os_corrected.Close();
+  b_contig_writer.Close();
+  b_microbe_writer.Close();
+  er_writer.Close();
   log_file.close();
 
   // more clean up 
@@ -644,14 +842,26 @@ afterlearn:
   if (ref_genome_viral)
     delete ref_genome_viral;
   
-  // make the VCF file
-  makeVCFs();
+  // make the VCF file. Shards are combined into VCFs by svaba merge
+  if (opt::num_shards)
+    std::cerr << "...done with shard " << opt::shard << " of " << opt::num_shards << ". Run svaba merge once all shards finish" << std::endl;
+  else
+    makeVCFs();
   
 #ifndef __APPLE__
   //  std::cerr << SeqLib::displayRuntime(start) << std::endl;
 #endif
 }
 
+void log_index_load(const std::string& prefix, double seconds) {
+  std::stringstream lss;
+  lss << std::fixed << std::setprecision(1) << "...loaded BWA index " << prefix
+      << (BwaImage::Attached(prefix) ? " from image" : " from index files") << " in " << seconds << " seconds."
+      << " RSS " << svabaMemory::toString(svabaMemory::procStatus("VmRSS"))
+      << " (private " << svabaMemory::toString(svabaMemory::procStatus("RssAnon")) << ")";
+  WRITELOG(lss.str(), opt::verbose > 0, true);
+}
+
 void makeVCFs() {
 
   if (opt::bam.size() == 0) {
@@ -776,9 +986,32 @@ void parseRunOptions(int argc, char** argv) {
     case OPT_LOD_SOMATIC: arg >> opt::lod_somatic; break;
     case OPT_LOD_SOMATIC_DB: arg >> opt::lod_somatic_db; break;
     case OPT_HP: opt::hp = true; break;
+    case OPT_MAX_MEMORY: 
+      tmp = "";
+      arg >> tmp;
+      try {
+	opt::max_memory = svabaMemory::parseBytes(tmp);
+      } catch (const std::invalid_argument& e) {
+	std::cerr << "ERROR: Could not parse --max-memory: " << e.what() << std::endl;
+	die = true;
+      }
+      break;
+    case OPT_MATE_CACHE_SIZE: arg >> opt::mate_cache_mb; break;
+    case OPT_CONTIG_CACHE_SIZE: arg >> opt::contig_cache_mb; break;
+    case OPT_CRAM_THREADS: arg >> opt::cram_threads; break;
+    case OPT_WRITE_THREADS: arg >> opt::write_threads; break;
+    case OPT_BWA_IMAGE: arg >> opt::bwa_image; break;
+    case OPT_SHARD: 
+      if (sscanf(optarg, "%d/%d", &opt::shard, &opt::num_shards) != 2 || 
+	  opt::num_shards < 1 || opt::shard < 1 || opt::shard > opt::num_shards) {
+	std::cerr << "ERROR: --shard must be i/N with 1 <= i <= N. Got " << optarg << std::endl;
+	die = true;
+      }
+      break;
     case OPT_SCALE_ERRORS: arg >> opt::scale_error; break;
     case 'C': arg >> opt::max_cov;  break;
     case OPT_NUM_TO_SAMPLE: arg >> opt::num_to_sample;  break;
+    case OPT_PARAMS_CACHE: opt::params_cache = true; break;
     case OPT_READ_TRACK: opt::read_tracking = true; break;
 	case 't': 
 	  tmp = svabaUtils::__bamOptParse(opt::bam, arg, sample_number++, "t");
@@ -802,16 +1035,31 @@ void parseRunOptions(int argc, char** argv) {
       case OPT_DISCORDANT_ONLY: opt::disc_cluster_only = true; break;
       case OPT_WRITE_EXTRACTED_READS: opt::write_extracted_reads = true; break;
     case OPT_NUM_ASSEMBLY_ROUNDS: arg >> opt::sga::num_assembly_rounds; break;
+    case OPT_ASSEMBLER: arg >> opt::assembler; break;
     case 'K': arg >> opt::ec_correct_type; break;
       default: die= true; 
     }
   }
 
-  if (opt::chunk <= 0 || opt::main_bam == "-")
-    opt::max_reads_per_assembly = INT_MAX;
-  else if (opt::max_reads_per_assembly < 0) 
+  // stdin and whole-BAM runs are read once in coordinate order, and
+  // cut into windows as the reads go by. So are whole-genome joint runs
+  // of many samples, in one sweep merged across the inputs
+  bool from_stdin = false;
+  for (auto& b : opt::bam)
+    from_stdin = from_stdin || b.second == "-";
+  opt::streaming = opt::chunk <= 0 || from_stdin ||
+    (opt::bam.size() >= JOINT_STREAM_SAMPLES && opt::regionFile.empty() && !opt::num_shards);
+  if (opt::streaming && opt::chunk <= 0)
+    opt::chunk = STREAM_WINDOW;
+
+  if (opt::max_reads_per_assembly < 0) 
     opt::max_reads_per_assembly = 50000; //set a default
 
+  if (opt::num_shards && from_stdin) {
+    WRITELOG("ERROR: --shard needs indexed BAMs to estimate window costs, not stdin", true, true);
+    die = true;
+  }
+
       
 
   if (!(opt::ec_correct_type == "s" || opt::ec_correct_type == "f" || opt::ec_correct_type == "0")) {
@@ -819,6 +1067,11 @@ void parseRunOptions(int argc, char** argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (!(opt::assembler == "s" || opt::assembler == "f" || opt::assembler == "a")) {
+    WRITELOG("ERROR: Assembler must be one of s, f, or a", true, true);
+    exit(EXIT_FAILURE);
+  }
+
   // check that we input something
   if (opt::bam.size() == 0 && !die) {
     WRITELOG("Must add a bam file with -t flag. stdin with -t -", true, true);
@@ -838,14 +1091,39 @@ void parseRunOptions(int argc, char** argv) {
       else 
 	exit(EXIT_SUCCESS);	
     }
+
+  // each shard writes its own set of outputs, for svaba merge
+  if (opt::num_shards)
+    opt::analysis_id = svabaUtils::shardPrefix(opt::analysis_id, opt::shard, opt::num_shards);
 }
 
-bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long unsigned int thread_id) {
+bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long unsigned int thread_id, StreamedReads * streamed) {
   
   WRITELOG("Running region " + region.ToString() + " on thread " + std::to_string(thread_id), opt::verbose > 1, true);
 
+  // if close to the memory budget, empty this threads buffer and 
+  // wait for the other running windows to free up room
+  if (mem_gov.NearBudget() && wu.m_bytes) {
+    WRITELOG("writing contigs etc on thread " + std::to_string(thread_id) + " for memory budget", opt::verbose > 1, true);
+    pthread_mutex_lock(&snow_lock);    
+    WriteFilesOut(wu); 
+    pthread_mutex_unlock(&snow_lock);
+  }
+  mem_gov.WaitForRoom();
+
+  // bytes of reads and assembly structures this window adds to the tally
+  size_t window_bytes = 0, added_bytes = 0;
+
+  // pull the blacklist and simple-seq intervals for this window once,
+  // to be shared by the walkers, mate-region screening and contig tagging
+  SeqLib::GRC window_scope;
+  if (!region.IsEmpty())
+    window_scope.add(region);
+  IntervalFilter window_blacklist(blacklist_index, window_scope, INTERVAL_FILTER_PAD);
+  IntervalFilter window_simple(simple_seq_index, window_scope, INTERVAL_FILTER_PAD);
+  
   for (auto& w : wu.walkers)
-    set_walker_params(w.second);
+    set_walker_params(w.second, &window_blacklist, &window_simple);
 
   // create a new BFC read error corrector for this
   SeqPointer<SeqLib::BFC> bfc;
@@ -869,8 +1147,12 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
   // read in alignments from the main region
   for (auto& w : wu.walkers) {
 
-    // set the region to jump to
-    if (!region.IsEmpty()) {
+    // set the region to jump to, or hand over the window's reads from the stream
+    if (streamed) {
+      w.second.SetFeed(&(*streamed)[w.first], region);
+    } else if (!bam_readers.Acquire(w.second)) {
+      ERROR_EXIT("ERROR: Cannot read " + opt::bam[w.first] + " for window " + region.ToString());
+    } else if (!region.IsEmpty()) {
       w.second.SetRegion(region);
     } else { // whole BAM analysis. If region file set, then set regions
       if (file_regions.size()) {
@@ -881,10 +1163,12 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
     }
 
     // do the reading, and store the bad mate regions
-    wu.badd.Concat(w.second.readBam(&log_file)); 
-    wu.badd.MergeOverlappingIntervals();
-    wu.badd.CreateTreeMap();
-
+    SeqLib::GRC wbad = w.second.readBam(&log_file);
+    if (streamed) // the walker keeps what it needs
+      SeqLib::BamRecordVector().swap((*streamed)[w.first]);
+    else
+      bam_readers.Release(w.second);
+    bad_regions.Add(wbad);
     
     // adjust the counts
     if (w.first.at(0) == 't') {
@@ -895,10 +1179,14 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
 
   }
 
-  // collect all of the cigar strings in a hash
-  std::unordered_map<std::string, SeqLib::CigarMap> cigmap;
-  for (const auto& w : wu.walkers) 
-    cigmap[w.first] = w.second.cigmap;
+  // collect the indel counts of the window reads. Moved out, so the
+  // mate reads read in below don't add to them
+  std::vector<PackedCigarMap> cigmap(SampleIndex::size());
+  for (auto& w : wu.walkers) {
+    w.second.cigmap.Finalize();
+    cigmap[SampleIndex::Get(w.first)] = std::move(w.second.cigmap);
+    w.second.cigmap.clear();
+  }
 
   // setup read collectors
   std::vector<char*> all_seqs;
@@ -914,11 +1202,15 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
 
   // get the mate reads, if this is local assembly and has insert-size distro
   if (!region.IsEmpty() && !opt::single_end && min_dscrd_size_for_variant) {
-    run_mate_collection_loop(region, wu.walkers, wu.badd);
+    run_mate_collection_loop(region, wu.walkers, &window_blacklist);
     // collect the reads together from the mate walkers
     collect_and_clear_reads(wu.walkers, bav_this, all_seqs, dedupe);
     st.stop("m");
   }
+
+  // add the reads for this window to the memory tally
+  window_bytes = svabaMemory::bytes(bav_this);
+  mem_gov.Add(window_bytes);
   
 
   // do the discordant read clustering
@@ -948,7 +1240,7 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
   // print out results
   if (opt::verbose > 3)
     for (auto& i : dmap) 
-      WRITELOG(i.first + " " + i.second.toFileString(false), true, false);
+      WRITELOG(i.first + " " + i.second.toFileString(b_header, false), true, false);
 
  afterdiscclustering:
 
@@ -966,8 +1258,9 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
   if (opt::disc_cluster_only)
     goto afterassembly;
 
-  // check that we don't have too many reads
-  if (bav_this.size() > (size_t)(region.Width() * 20) && region.Width() > 20000) {
+  // check that we don't have too many reads. Other assemblers
+  // take these windows to fermi-lite
+  if (opt::assembler == "s" && bav_this.size() > (size_t)(region.Width() * 20) && region.Width() > 20000) {
     std::stringstream ssss;
     WRITELOG("TOO MANY READS IN REGION " + SeqLib::AddCommas(bav_this.size()) + "\t" + region.ToString(), opt::verbose, false);
     goto afterassembly;
@@ -1019,9 +1312,15 @@ bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long
 
   st.stop("k");
   
+  // tally the suffix arrays / BWTs for the life of the assembly
+  added_bytes = svabaMemory::assemblyBytes(bav_this);
+  mem_gov.Add(added_bytes);
+
   // do the assembly, contig realignment, contig local realignment, and read realignment
   // modifes bav_this, alc, all_contigs and all_microbial_contigs
-  run_assembly(region, bav_this, alc, all_contigs, all_microbial_contigs, dmap, cigmap, wu.ref_genome);
+  run_assembly(region, bav_this, alc, all_contigs, all_microbial_contigs, dmap, cigmap, wu.ref_genome, &window_simple);
+
+  mem_gov.Release(added_bytes);
 
 afterassembly:
 
@@ -1065,13 +1364,12 @@ afterassembly:
   }
   
   // de duplicate the breakpoints
-  std::sort(bp_glob.begin(), bp_glob.end());
-  bp_glob.erase( std::unique( bp_glob.begin(), bp_glob.end() ), bp_glob.end() );
+  BreakPoint::sortUnique(bp_glob);
 
   // add the coverage data to breaks for allelic fraction computation
-  std::unordered_map<std::string, STCoverage*> covs;
-  for (auto& i : opt::bam) 
-    covs[i.first] = &wu.walkers[i.first].cov;
+  std::vector<STCoverage*> covs(SampleIndex::size());
+  for (auto& i : wu.walkers) 
+    covs[SampleIndex::Get(i.first)] = &i.second.cov;
 
   for (auto& i : bp_glob)
     i.addCovs(covs);
@@ -1082,43 +1380,47 @@ afterassembly:
   }
 
   // label somatic breakpoints that intersect directly with normal as NOT somatic
-  std::unordered_set<std::string> norm_hash;
+  // (break end positions are keyed as integers: BreakEnd::key)
+  std::unordered_set<uint64_t> norm_hash;
   for (auto& i : bp_glob) // hash the normals
     if (!i.somatic_score && i.confidence == "PASS" && i.evidence == "INDEL") {
-      norm_hash.insert(i.b1.hash());
-      norm_hash.insert(i.b2.hash());
-      norm_hash.insert(i.b1.hash(1));
-      norm_hash.insert(i.b1.hash(-1));
+      norm_hash.insert(i.b1.key());
+      norm_hash.insert(i.b2.key());
+      norm_hash.insert(i.b1.key(1));
+      norm_hash.insert(i.b1.key(-1));
     }
 
   // find somatic that intersect with norm. Set somatic = 0;
   for (auto& i : bp_glob)  
-    if (i.somatic_score && i.evidence == "INDEL" && (norm_hash.count(i.b1.hash()) || norm_hash.count(i.b2.hash()))) {
+    if (i.somatic_score && i.evidence == "INDEL" && (norm_hash.count(i.b1.key()) || norm_hash.count(i.b2.key()))) {
       i.somatic_score = -3;
     }
 
   // remove indels at repeats that have multiple variants
-  std::unordered_map<std::string, size_t> ccc;
+  std::unordered_map<uint64_t, size_t> ccc;
   for (auto& i : bp_glob) {
     if (i.evidence == "INDEL" && i.repeat_seq.length() > 6) {
-      ++ccc[i.b1.hash()];
+      ++ccc[i.b1.key()];
     }
   }
   for (auto& i : bp_glob) {
-    if (i.evidence == "INDEL" && ccc[i.b1.hash()] > 1)
+    if (i.evidence == "INDEL" && ccc.count(i.b1.key()) && ccc[i.b1.key()] > 1)
       i.confidence = "REPVAR";
   }
 
   // remove somatic calls if they have a germline normal SV in them or indels with 
-  // 2+germline normal in same contig
-  std::unordered_set<std::string> bp_hash;
+  // 2+germline normal in same contig. The contig names are sorted and
+  // searched in place, rather than copied into a hash
+  std::vector<const std::string*> bp_hash;
   for (auto& i : bp_glob) { // hash the normals
     if (!i.somatic_score && i.evidence != "INDEL" && i.confidence == "PASS") {
-      bp_hash.insert(i.cname);
+      bp_hash.push_back(&i.cname);
     }
   }
+  auto cname_less = [](const std::string* a, const std::string* b) { return *a < *b; };
+  std::sort(bp_hash.begin(), bp_hash.end(), cname_less);
   for (auto& i : bp_glob)  // find somatic that intersect with norm. Set somatic = 0;
-    if (i.somatic_score && i.num_align > 1 && bp_hash.count(i.cname)) {
+    if (i.somatic_score && i.num_align > 1 && std::binary_search(bp_hash.begin(), bp_hash.end(), &i.cname, cname_less)) {
       i.somatic_score = -2;
     }
 
@@ -1144,26 +1446,44 @@ afterassembly:
     i.setRefAlt(wu.ref_genome, wu.vir_genome);
 
   // transfer local versions to thread store
+  added_bytes = 0;
   for (const auto& a : alc)
     if (a.hasVariant()) {
       wu.m_alc.push_back(a);
       wu.m_bamreads_count += a.NumBamReads();
+      added_bytes += a.NumBytes();
     }
-  for (const auto& d : dmap)
+  for (const auto& d : dmap) {
     wu.m_disc_reads += d.second.reads.size();
+    added_bytes += svabaMemory::bytes(d.second);
+  }
   
   wu.m_contigs.insert(wu.m_contigs.end(), all_contigs.begin(), all_contigs.end());
   wu.m_vir_contigs.insert(wu.m_vir_contigs.end(), all_microbial_contigs.begin(), all_microbial_contigs.end());
   wu.m_disc.insert(dmap.begin(), dmap.end());
+  added_bytes += svabaMemory::bytes(all_contigs) + svabaMemory::bytes(all_microbial_contigs);
   for (const auto& a : alc)
     wu.m_bamreads_count += a.NumBamReads();
   for (auto& i : bp_glob) 
-    if ( i.hasMinimal() && (i.confidence != "NOLOCAL" || i.complex_local ) ) 
+    if ( i.hasMinimal() && (i.confidence != "NOLOCAL" || i.complex_local ) ) {
       wu.m_bps.push_back(i);
+      added_bytes += svabaMemory::bytes(i);
+    }
+  wu.m_bytes += added_bytes;
+  mem_gov.Add(added_bytes);
   
-  // dump if getting to much memory
-  if (wu.MemoryLimit(THREAD_READ_LIMIT, THREAD_CONTIG_LIMIT) && !opt::hp) {
-    WRITELOG("writing contigs etc on thread " + std::to_string(thread_id) + " with limit hit of " + std::to_string(wu.m_bamreads_count), opt::verbose > 1, true);
+  // dump if getting to much memory. With a memory budget, flush on bytes 
+  // (even in --hp mode if the whole budget is close to being hit)
+  bool flush;
+  if (mem_gov.Enabled())
+    flush = mem_gov.NearBudget() || 
+      (!opt::hp && wu.MemoryLimit(mem_gov.Budget() * MEMORY_THREAD_BUFFER_FRAC / opt::numThreads));
+  else
+    flush = wu.MemoryLimit(THREAD_READ_LIMIT, THREAD_CONTIG_LIMIT) && !opt::hp;
+  
+  if (flush) {
+    WRITELOG("writing contigs etc on thread " + std::to_string(thread_id) + " with limit hit of " + std::to_string(wu.m_bamreads_count) + 
+	     " reads, " + svabaMemory::toString(wu.m_bytes), opt::verbose > 1, true);
     pthread_mutex_lock(&snow_lock);    
     WriteFilesOut(wu); 
     pthread_mutex_unlock(&snow_lock);
@@ -1186,7 +1506,7 @@ afterassembly:
       if (seq.empty())
 	seq = r.QualitySequence();
       //os_corrected << ">" << SRTAG(r) << std::endl << seq << std::endl;
-      os_corrected << ">" << r.SR() << std::endl << seq << std::endl;
+      os_corrected.Write(">" + r.SR() + "\n" + seq);
     }
     pthread_mutex_unlock(&snow_lock);
   }
@@ -1202,6 +1522,10 @@ afterassembly:
     w.second.m_limit = opt::max_reads_per_assembly;
   }
 
+  // this window's reads are freed on return
+  mem_gov.Release(window_bytes);
+  mem_gov.WindowDone();
+
   return true;
 }
 
@@ -1210,24 +1534,33 @@ void sendThreads(SeqLib::GRC& regions_torun) {
   // Create the queue and consumer (worker) threads
   wqueue<svabaWorkItem*>  queue;
   std::vector<ConsumerThread<svabaWorkItem>*> threadqueue;
+  subtasks.SetNumWorkers(opt::numThreads);
+  // a reader per busy thread, plus one idle for each input
+  bam_readers.SetMaxIdle(opt::numThreads + opt::bam.size());
   for (int i = 0; i < opt::numThreads; i++) {
     ConsumerThread<svabaWorkItem>* threadr = new ConsumerThread<svabaWorkItem>(queue, opt::verbose > 0,
 										   opt::refgenome, opt::microbegenome,
-										   opt::bam);
+										   opt::bam, &subtasks);
     threadr->start();
     threadqueue.push_back(threadr);
   }
 
   // send the jobs
   size_t count = 0;
-  for (auto& i : regions_torun) {
-    svabaWorkItem * item     = new svabaWorkItem(SeqLib::GenomicRegion(i.chr, i.pos1, i.pos2), ++count);
-    queue.add(item);
-  }
-  if (!regions_torun.size()) { // whole genome 
-    svabaWorkItem * item     = new svabaWorkItem(SeqLib::GenomicRegion(), ++count);
-    queue.add(item);
+  if (opt::streaming) {
+    queue.setCapacity(opt::numThreads * STREAM_QUEUE_PER_THREAD);
+    streamWindows(queue, regions_torun);
+  } else {
+    for (auto& i : regions_torun) {
+      svabaWorkItem * item     = new svabaWorkItem(SeqLib::GenomicRegion(i.chr, i.pos1, i.pos2), ++count);
+      queue.add(item);
+    }
+    if (!regions_torun.size()) { // whole genome 
+      svabaWorkItem * item     = new svabaWorkItem(SeqLib::GenomicRegion(), ++count);
+      queue.add(item);
+    }
   }
+  queue.close();
   
   // wait for the threads to finish
   for (int i = 0; i < opt::numThreads; ++i) 
@@ -1239,6 +1572,231 @@ void sendThreads(SeqLib::GRC& regions_torun) {
     WriteFilesOut(threadqueue[i]->wu); 
   pthread_mutex_unlock(&snow_lock);
 
+  ss << "...peak tracked memory " << svabaMemory::toString(mem_gov.Peak());
+  if (mem_gov.Enabled())
+    ss << " of " << svabaMemory::toString(mem_gov.Budget()) << " budget. Windows held back for memory: " << SeqLib::AddCommas(mem_gov.NumWaits());
+  WRITELOG(ss.str(), opt::verbose > 0, true);
+  ss.str(std::string());
+
+  if (mate_cache.Enabled())
+    WRITELOG(mate_cache.Stats(), opt::verbose > 0, true);
+
+  if (contig_cache.Enabled())
+    WRITELOG(contig_cache.Stats(), opt::verbose > 0, true);
+
+  if (opt::numThreads > 1)
+    WRITELOG(subtasks.Stats(), opt::verbose > 0, true);
+
+  WRITELOG(bam_readers.Stats(), opt::verbose > 0, true);
+
+  // read-in throughput per input, summed over the threads
+  size_t total_rec = 0;
+  double total_secs = 0;
+  for (auto& b : opt::bam) {
+    size_t nrec = 0;
+    double secs = 0;
+    bool is_cram = false;
+    for (int i = 0; i < opt::numThreads; ++i) {
+      const svabaBamWalker& w = threadqueue[i]->wu.walkers[b.first];
+      nrec += w.num_records;
+      secs += w.read_seconds;
+      is_cram = is_cram || w.is_cram;
+    }
+    total_rec += nrec;
+    total_secs += secs;
+    std::stringstream ts;
+    ts << "...read " << SeqLib::AddCommas(nrec) << " records from " << b.first << " (" << (is_cram ? "CRAM" : "BAM") 
+       << ") in " << std::fixed << std::setprecision(1) << secs << " reader-seconds";
+    if (secs > 0)
+      ts << " (" << SeqLib::AddCommas((size_t)(nrec / secs)) << " records/s per thread)";
+    WRITELOG(ts.str(), opt::verbose > 0, true);
+  }
+
+  // and over all of the samples, to see how a joint run scales with them
+  if (opt::bam.size() > 1) {
+    std::stringstream ts;
+    ts << "...read " << SeqLib::AddCommas(total_rec) << " records over " << opt::bam.size() << " samples";
+    if (total_secs > 0)
+      ts << " (" << SeqLib::AddCommas((size_t)(total_rec / total_secs)) << " records/s per thread)";
+    ts << ", peak tracked memory " << svabaMemory::toString(mem_gov.Peak() / opt::bam.size()) << " per sample";
+    WRITELOG(ts.str(), opt::verbose > 0, true);
+  }
+
+}
+
+// one input being swept in a streamed run. Its reads are decoded on a
+// thread of its own, and handed to the sweep in batches
+struct StreamInput {
+  std::string prefix;
+  SeqLib::BamReader * reader = nullptr;
+  pthread_t decoder;
+  wqueue<SeqLib::BamRecordVector*> batches;
+  std::atomic<bool> stop{false}; // set by the sweep when it needs no more reads
+  SeqLib::BamRecordVector * batch = nullptr; // batch being swept, and the place in it
+  size_t i = 0;
+  SeqLib::BamRecord next; // read at the head of the input
+  bool done = false;
+  std::deque<SeqLib::BamRecord> buffer; // reads that can still reach the current window
+};
+
+// read an input to the end (or until the sweep stops), a batch at a time
+static void* decode_stream_input(void* arg) {
+  StreamInput * in = static_cast<StreamInput*>(arg);
+  bool more = true;
+  while (more && !in->stop) {
+    SeqLib::BamRecordVector * b = new SeqLib::BamRecordVector();
+    b->reserve(STREAM_BATCH_READS);
+    SeqLib::BamRecord r;
+    while (b->size() < STREAM_BATCH_READS && (more = in->reader->GetNextRecord(r)))
+      b->push_back(r);
+    if (b->empty())
+      delete b;
+    else
+      in->batches.add(b);
+  }
+  in->batches.close();
+  return NULL;
+}
+
+// move an input on to its next read. False at the end of the input
+static bool next_stream_read(StreamInput& in) {
+  while (!in.batch || in.i == in.batch->size()) {
+    delete in.batch;
+    in.batch = in.batches.remove();
+    in.i = 0;
+    if (!in.batch)
+      return false;
+  }
+  in.next = (*in.batch)[in.i++];
+  return true;
+}
+
+// queue a window with the buffered reads that overlap it. Empty windows are dropped
+static void queue_stream_window(wqueue<svabaWorkItem*>& queue, std::vector<StreamInput>& inputs, 
+				const SeqLib::GenomicRegion& win, size_t& count) {
+  StreamedReads reads;
+  size_t n = 0;
+  for (auto& in : inputs) {
+    SeqLib::BamRecordVector& v = reads[in.prefix];
+    for (const auto& r : in.buffer)
+      if (r.ChrID() == win.chr && r.Position() <= win.pos2 && r.PositionEnd() >= win.pos1)
+	v.push_back(r);
+    n += v.size();
+  }
+  if (n)
+    queue.add(new svabaWorkItem(win, ++count, reads));
+}
+
+// drop the reads that end before a window. Buffers are start-sorted,
+// so a long read at the front can hold a few more back for a while
+static void prune_stream_buffers(std::vector<StreamInput>& inputs, const SeqLib::GenomicRegion& win) {
+  for (auto& in : inputs)
+    while (in.buffer.size() && (in.buffer.front().ChrID() != win.chr || in.buffer.front().PositionEnd() < win.pos1))
+      in.buffer.pop_front();
+}
+
+void streamWindows(wqueue<svabaWorkItem*>& queue, const SeqLib::GRC& windows) {
+
+  // the main input is already open (and may be stdin). Open the others
+  std::vector<StreamInput> inputs(opt::bam.size());
+  std::vector<svabaBamWalker*> opened;
+  size_t k = 0;
+  bool main_taken = false;
+  for (auto& b : opt::bam) {
+    StreamInput& in = inputs[k++];
+    in.prefix = b.first;
+    if (!main_taken && b.second == opt::main_bam) {
+      in.reader = &b_reader;
+      main_taken = true;
+    } else {
+      svabaBamWalker * w = new svabaBamWalker();
+      if (cram_ref.Enabled())
+	w->SetCramReference(cram_ref.Fasta());
+      if (!w->Open(b.second)) {
+	std::cerr << "ERROR: Cannot open " << b.second << " for streaming" << std::endl;
+	exit(EXIT_FAILURE);
+      }
+      w->UseCramReference(&cram_ref);
+      opened.push_back(w);
+      in.reader = w;
+    }
+  }
+
+  // decode every input at once, rather than one after another on this thread
+  for (auto& in : inputs) {
+    in.batches.setCapacity(STREAM_BATCHES_PER_INPUT);
+    pthread_create(&in.decoder, NULL, decode_stream_input, &in);
+  }
+  for (auto& in : inputs)
+    in.done = !next_stream_read(in);
+
+  size_t w = 0, count = 0, num_reads = 0, max_buffer = 0;
+
+  while (w < windows.size()) {
+
+    // next read in coordinate order across the inputs
+    StreamInput * in = nullptr;
+    for (auto& i : inputs)
+      if (!i.done && (!in || i.next.ChrID() < in->next.ChrID() || 
+		      (i.next.ChrID() == in->next.ChrID() && i.next.Position() < in->next.Position())))
+	in = &i;
+    if (!in || in->next.ChrID() < 0) // done, or into the unplaced reads at the end
+      break;
+
+    const SeqLib::BamRecord& r = in->next;
+    int32_t chr = r.ChrID(), pos = r.Position();
+
+    // queue every window the sweep has passed
+    while (w < windows.size() && (windows[w].chr < chr || (windows[w].chr == chr && windows[w].pos2 < pos))) {
+      queue_stream_window(queue, inputs, windows[w], count);
+      if (++w < windows.size())
+	prune_stream_buffers(inputs, windows[w]);
+    }
+    if (w == windows.size())
+      break;
+
+    // keep it if it reaches the current window (skips reads between region-file windows)
+    if (chr == windows[w].chr && r.PositionEnd() >= windows[w].pos1) {
+      in->buffer.push_back(r);
+      max_buffer = std::max(max_buffer, in->buffer.size());
+    }
+    ++num_reads;
+
+    in->done = !next_stream_read(*in);
+    if (!in->done && in->next.ChrID() >= 0 && (in->next.ChrID() < chr || (in->next.ChrID() == chr && in->next.Position() < pos))) {
+      std::cerr << "ERROR: Streaming needs coordinate-sorted input. " << in->prefix << " has " 
+		<< in->next.Brief() << " after a read at " << chr << ":" << pos << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // windows the stream ended in or before
+  for (; w < windows.size(); ++w) {
+    queue_stream_window(queue, inputs, windows[w], count);
+    if (w + 1 < windows.size())
+      prune_stream_buffers(inputs, windows[w + 1]);
+  }
+
+  // the sweep can end before the inputs do (at the unplaced reads, or past
+  // the last window), so stop the decoders and drop what they still hold
+  for (auto& in : inputs) {
+    in.stop = true;
+    delete in.batch;
+    in.batch = nullptr;
+    while (SeqLib::BamRecordVector * b = in.batches.remove())
+      delete b;
+    pthread_join(in.decoder, NULL);
+  }
+
+  for (auto& o : opened) {
+    o->Close();
+    delete o;
+  }
+
+  std::stringstream sss;
+  sss << "...streamed " << SeqLib::AddCommas(num_reads) << " reads into " << SeqLib::AddCommas(count) 
+      << " non-empty windows. Max look-back buffer " << SeqLib::AddCommas(max_buffer) << " reads";
+  WRITELOG(sss.str(), opt::verbose > 0, true);
 }
 
 void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequenceVector& usv, 
@@ -1283,8 +1841,13 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
   bw_ref.SetMismatchPenalty(9); // default 2
   bw.SetMismatchPenalty(9); // default 4
 
-  for (auto i : bav_this) {
-    
+  // align each read to the contigs and the reference alleles, keeping the
+  // contig alignments that pass. Hot windows share this with idle threads,
+  // so results go by read and are applied to the contigs in order below
+  std::vector<SeqLib::BamRecordVector> read_passes(bav_this.size());
+  std::function<void(size_t)> align_read = [&](size_t k) {
+
+    const svabaRead& i = bav_this[k];
     SeqLib::BamRecordVector brv, brv_ref;
 
     // try the corrected seq first
@@ -1298,7 +1861,7 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
     bw.AlignSequence(seqr, i.Qname(), brv, hardclip, 0.60, 10000);
 
     if (brv.size() == 0) 
-      continue;
+      return;
 
     // get the maximum non-reference alignment score
     int max_as = 0;
@@ -1324,7 +1887,7 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
     if (max_as_r > max_as) {
       //std::cerr << " Alignment Rejected for " << max_as_r << ">" << max_as << "  " << i << std::endl;
       //std::cerr << "                        " << max_as_r << ">" << max_as << "  " << brv_ref[0] << std::endl;
-      continue;
+      return;
     }
 
     // convert to a svabaReadVector
@@ -1353,9 +1916,21 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
 	cc.insert(usv[r.ChrID()].Name);
       }
     }
+    read_passes[k].swap(bpass);
+  };
+
+  if (bav_this.size() >= HOT_WINDOW_READS)
+    subtasks.ParallelFor(bav_this.size(), HOT_WINDOW_CHUNK, align_read);
+  else
+    for (size_t k = 0; k < bav_this.size(); ++k)
+      align_read(k);
+
+  for (size_t k = 0; k < bav_this.size(); ++k) {
+
+    svabaRead i = bav_this[k];
 
     // annotate the original read
-    for (auto& r : bpass) {
+    for (auto& r : read_passes[k]) {
 
       r2c this_r2c; // alignment of this read to this contig
       if (r.ReverseFlag())
@@ -1388,20 +1963,21 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
   } // end main read loop
 }
 
-void set_walker_params(svabaBamWalker& walk) {
+void set_walker_params(svabaBamWalker& walk, const IntervalFilter * bl, const IntervalFilter * ss) {
 
   walk.main_bwa = main_bwa; // set the pointer
-  walk.blacklist = blacklist;
+  walk.blacklist = blacklist.size() ? bl : nullptr;
   walk.do_kmer_filtering = (opt::ec_correct_type == "s" || opt::ec_correct_type == "f");
-  walk.simple_seq = &simple_seq;
+  walk.simple_seq = simple_seq.size() ? ss : nullptr;
   walk.kmer_subsample = opt::ec_subsample;
   walk.max_cov = opt::max_cov;
   walk.m_mr = mr;  // set the read filter pointer
   walk.m_limit = opt::max_reads_per_assembly;
+  walk.m_byte_limit = mem_gov.Enabled() ? mem_gov.Budget() / opt::numThreads * MEMORY_WINDOW_READ_FRAC : 0;
 
 }
 
-CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, SeqLib::GRC& badd) {
+CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, const IntervalFilter * bl) {
 
   SeqLib::GRC this_bad_mate_regions; // store the newly found bad mate regions
   
@@ -1418,7 +1994,7 @@ CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMa
     
     // get the mates from somatic 3+ mate regions
     // that don't overlap with normal mate region
-    MateRegionVector tmp_somatic_mate_regions = __collect_somatic_mate_regions(wmap, normal_mate_regions);
+    MateRegionVector tmp_somatic_mate_regions = __collect_somatic_mate_regions(wmap, normal_mate_regions, bl);
     
     // no more regions to check
     if (!tmp_somatic_mate_regions.size())
@@ -1429,9 +2005,8 @@ CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMa
     for (auto& s : tmp_somatic_mate_regions) {
       
       // check if its not bad from mate region
-      if (badd.size())
-	if (badd.CountOverlaps(s))
-	  continue;
+      if (bad_regions.Overlaps(s))
+	continue;
 
       // check if we are allowed to lookup interchromosomal
       if (!opt::interchrom_lookup && (s.chr != region.chr || std::abs(s.pos1 - region.pos1) < LARGE_INTRA_LOOKUP_LIMIT))
@@ -1475,11 +2050,9 @@ CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMa
 
   } // mate collection round loop
 
-  // update this threads tally of bad mate regions
-  badd.Concat(this_bad_mate_regions);
-  badd.MergeOverlappingIntervals();
-  badd.CreateTreeMap();
-  WRITELOG("\tTotal of " + SeqLib::AddCommas(badd.size()) + " bad mate regions for this thread", opt::verbose > 1, true);
+  // share the bad regions with the other threads
+  bad_regions.Add(this_bad_mate_regions);
+  WRITELOG("\tTotal of " + SeqLib::AddCommas(bad_regions.size()) + " bad mate regions", opt::verbose > 1, true);
 
   return counts;
 }
@@ -1487,34 +2060,47 @@ CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMa
 
 MateRegionVector __collect_normal_mate_regions(WalkerMap& walkers) {
   
-  MateRegionVector normal_mate_regions;
+  std::vector<MateRegion> normal_mate_regions;
   for (auto& b : opt::bam)
     if (b.first.at(0) == 'n')
-      normal_mate_regions.Concat(walkers[b.first].mate_regions);
+      normal_mate_regions.insert(normal_mate_regions.end(), walkers[b.first].mate_regions.begin(),
+				 walkers[b.first].mate_regions.end());
 
-  normal_mate_regions.MergeOverlappingIntervals();
-  normal_mate_regions.CreateTreeMap();
-  
-  return normal_mate_regions;
+  // sorted and disjoint, for the sweep in __collect_somatic_mate_regions
+  return mergeMateRegions(normal_mate_regions);
 
 }
 
-MateRegionVector __collect_somatic_mate_regions(WalkerMap& walkers, MateRegionVector& bl) {
+MateRegionVector __collect_somatic_mate_regions(WalkerMap& walkers, MateRegionVector& bl, const IntervalFilter * blf) {
 
 
-  MateRegionVector somatic_mate_regions;
+  std::vector<MateRegion> cand;
   for (auto& b : opt::bam)
     if (b.first.at(0) == 't')
-      for (auto& i : walkers[b.first].mate_regions) {
-	if (i.count >= opt::mate_lookup_min && !bl.CountOverlaps(i)
-	    && (!blacklist.size() || !blacklist.CountOverlaps(i)))
-	  somatic_mate_regions.add(i); 
-      }
+      for (auto& i : walkers[b.first].mate_regions)
+	if (i.count >= opt::mate_lookup_min)
+	  cand.push_back(i);
+
+  std::stable_sort(cand.begin(), cand.end(), [](const MateRegion& a, const MateRegion& b) {
+      return a.chr < b.chr || (a.chr == b.chr && a.pos1 < b.pos1);
+    });
+
+  // drop the ones in a normal mate region. bl is sorted and disjoint, so
+  // one sweep along it covers the sorted candidates
+  IntervalFilter::Cursor blc(blf);
+  std::vector<MateRegion> somatic_mate_regions;
+  size_t j = 0;
+  for (auto& i : cand) {
+    while (j < bl.size() && (bl[j].chr < i.chr || (bl[j].chr == i.chr && bl[j].pos2 < i.pos1)))
+      ++j;
+    if (j < bl.size() && bl[j].chr == i.chr && bl[j].pos1 <= i.pos2)
+      continue;
+    if (!blacklist.size() || !blc.Overlaps(i))
+      somatic_mate_regions.push_back(i);
+  }
   
   // reduce it down
-  somatic_mate_regions.MergeOverlappingIntervals();
-
-  return somatic_mate_regions;
+  return mergeMateRegions(somatic_mate_regions);
 
 }
 
@@ -1555,7 +2141,7 @@ void remove_hardclips(svabaReadVector& brv) {
 
 void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this, std::vector<AlignedContig>& master_alc, 
 		  SeqLib::BamRecordVector& master_contigs, SeqLib::BamRecordVector& master_microbial_contigs, DiscordantClusterMap& dmap,
-		  std::unordered_map<std::string, SeqLib::CigarMap>& cigmap, SeqLib::RefGenome* refg) {
+		  std::vector<PackedCigarMap>& cigmap, SeqLib::RefGenome* refg, const IntervalFilter * simple) {
 
   // get the local region
   std::string lregion;
@@ -1585,9 +2171,23 @@ void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this
   SeqLib::UnalignedSequenceVector all_contigs_this;
   
   // setup the engine
+  // hot windows share their loops with idle threads
+  bool hot = bav_this.size() >= HOT_WINDOW_READS;
+
+  // deep windows go to fermi-lite, whose time stays bounded
+  bool fermi = opt::assembler == "f" || (opt::assembler == "a" && 
+    (bav_this.size() >= FERMI_WINDOW_READS || (!region.IsEmpty() &&
+      bav_this.size() * readlen >= (size_t)region.Width() * FERMI_WINDOW_DEPTH)));
+  if (fermi)
+    WRITELOG("...assembling " + SeqLib::AddCommas(bav_this.size()) + " reads with fermi-lite for " + name, opt::verbose > 1, true);
+
   svabaAssemblerEngine engine(name, opt::sga::error_rate, opt::sga::minOverlap, readlen);
+  if (fermi)
+    engine.setToUseFermi();
   if (opt::sga::writeASQG)
     engine.setToWriteASQG();
+  if (hot)
+    engine.setSubtaskPool(&subtasks);
   engine.fillReadTable(bav_this);
   
   // do the actual assembly
@@ -1604,20 +2204,48 @@ void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this
   WRITELOG("...aliging contigs to genome", opt::verbose > 1, false);
 
   SeqLib::UnalignedSequenceVector usv;
+
+  // for checking overlaps with simple sequence
+  IntervalFilter::Cursor simple_cursor(simple);
+
+  // the local, genome and microbe alignments of each contig
+  std::vector<SeqLib::BamRecordVector> local_hits(all_contigs_this.size()), genome_hits(all_contigs_this.size()), 
+    microbe_hits(all_contigs_this.size());
+  std::function<void(size_t)> align_contig = [&](size_t k) {
+    const SeqLib::UnalignedSequence& i = all_contigs_this[k];
+    if ((int)i.Seq.length() < (readlen * 1.15) && !opt::all_contigs)
+      return;
+    bool hardclip = false;
+    if (!local_bwa.IsEmpty())
+      local_bwa.AlignSequence(i.Seq, i.Name, local_hits[k], hardclip, SECONDARY_FRAC, SECONDARY_CAP);
+
+    // the same contig is often assembled in neighboring windows
+    if (contig_cache.Enabled() && contig_cache.Get(i.Seq, i.Name, genome_hits[k], microbe_hits[k]))
+      return;
+    main_bwa->AlignSequence(i.Seq, i.Name, genome_hits[k], hardclip, SECONDARY_FRAC, SECONDARY_CAP);	
+    if (microbe_bwa && !svabaUtils::hasRepeat(i.Seq))
+      microbe_bwa->AlignSequence(i.Seq, i.Name, microbe_hits[k], hardclip, SECONDARY_FRAC, SECONDARY_CAP);
+    if (contig_cache.Enabled())
+      contig_cache.Put(i.Seq, genome_hits[k], microbe_hits[k]);
+  };
+
+  if (hot)
+    subtasks.ParallelFor(all_contigs_this.size(), 1, align_contig);
+  else
+    for (size_t k = 0; k < all_contigs_this.size(); ++k)
+      align_contig(k);
   
-  for (auto& i : all_contigs_this) {
+  for (size_t k = 0; k < all_contigs_this.size(); ++k) {
+
+    const SeqLib::UnalignedSequence& i = all_contigs_this[k];
     
     // if too short, skip
     if ((int)i.Seq.length() < (readlen * 1.15) && !opt::all_contigs)
       continue;
     
-    bool hardclip = false;	
-
     //// LOCAL REALIGNMENT
     // align to the local region
-    SeqLib::BamRecordVector local_ct_alignments;
-    if (!local_bwa.IsEmpty())
-      local_bwa.AlignSequence(i.Seq, i.Name, local_ct_alignments, hardclip, SECONDARY_FRAC, SECONDARY_CAP);
+    SeqLib::BamRecordVector& local_ct_alignments = local_hits[k];
     
     // check if it has a non-local alignment
     bool valid_sv = true;
@@ -1628,8 +2256,7 @@ void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this
     ////////////
     
     // do the main realignment
-    SeqLib::BamRecordVector ct_alignments;
-    main_bwa->AlignSequence(i.Seq, i.Name, ct_alignments, hardclip, SECONDARY_FRAC, SECONDARY_CAP);	
+    SeqLib::BamRecordVector& ct_alignments = genome_hits[k];
 
     if (opt::verbose > 3)
       for (auto& i : ct_alignments)
@@ -1641,9 +2268,7 @@ void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this
     if (microbe_bwa && !svabaUtils::hasRepeat(i.Seq)) {
       
       // do the microbial alignment
-      SeqLib::BamRecordVector microbial_alignments;
-      bool hardclip = false;
-      microbe_bwa->AlignSequence(i.Seq, i.Name, microbial_alignments, hardclip, SECONDARY_FRAC, SECONDARY_CAP);
+      SeqLib::BamRecordVector& microbial_alignments = microbe_hits[k];
       
       // if the microbe alignment is large enough and doesn't overlap human...
       for (auto& j : microbial_alignments) {
@@ -1696,18 +2321,12 @@ void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this
     // check simple sequence overlaps
     if (simple_seq.size())
       for (auto& k : human_alignments) {
-	SeqLib::GRC ovl = simple_seq.FindOverlaps(k.AsGenomicRegion(), true);
-	int msize = 0;
-	for (auto& j: ovl) {
-	  int nsize = j.Width() - k.MaxDeletionBases() - 1;
-	  if (nsize > msize && nsize > 0)
-	    msize = nsize;
-	}
-	k.AddIntTag("SZ", msize);
+	int msize = simple_cursor.MaxOverlap(k.AsGenomicRegion()) - (int)k.MaxDeletionBases() - 1;
+	k.AddIntTag("SZ", std::max(msize, 0));
       }
 
     // make the aligned contigs
-    AlignedContig ac(human_alignments, prefixes);
+    AlignedContig ac(human_alignments);
     
     // assign the local variable to each
     ac.checkLocal(region);
@@ -1758,17 +2377,31 @@ CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, in
   if (!mrv.size())
     return counts;
   
+  // convert MateRegionVector to GRC
+  SeqLib::GRC gg;
+  for (auto& s : mrv) 
+    gg.add(SeqLib::GenomicRegion(s.chr, s.pos1, s.pos2, s.strand));
+
+  // pull the blacklist / simple-seq intervals for the mate regions
+  IntervalFilter mate_blacklist(blacklist_index, gg, INTERVAL_FILTER_PAD);
+  IntervalFilter mate_simple(simple_seq_index, gg, INTERVAL_FILTER_PAD);
+
   for (auto& w : walkers) {
 
+    // stdin is read once, by the stream, so it has no mates to look up
+    if (opt::bam[w.first] == "-")
+      continue;
+
     int oreads = w.second.reads.size();
     w.second.m_limit = opt::mate_region_lookup_limit;
 
-    // convert MateRegionVector to GRC
-    SeqLib::GRC gg;
-    for (auto& s : mrv) 
-      gg.add(SeqLib::GenomicRegion(s.chr, s.pos1, s.pos2, s.strand));
+    // swap in the mate region filters (window ones put back below)
+    const IntervalFilter * wbl = w.second.blacklist, * wss = w.second.simple_seq;
+    if (wbl)
+      w.second.blacklist = &mate_blacklist;
+    if (wss)
+      w.second.simple_seq = &mate_simple;
 
-    assert(w.second.SetMultipleRegions(gg));
     w.second.get_coverage = false;
     w.second.get_mate_regions = (round != MAX_MATE_ROUNDS);
 
@@ -1776,7 +2409,20 @@ CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, in
     // already added these to the to-do pile
     w.second.mate_regions.clear();
 
-    this_bad_mate_regions.Concat(w.second.readBam(&log_file)); 
+    // borrow an open reader for the lookups
+    if (!bam_readers.Acquire(w.second))
+      ERROR_EXIT("ERROR: Cannot read " + opt::bam[w.first] + " for mate lookups");
+
+    if (mate_cache.Enabled()) {
+      this_bad_mate_regions.Concat(mate_cache.ReadRegions(w.second, gg, &log_file));
+    } else if (w.second.SetMultipleRegions(gg)) {
+      this_bad_mate_regions.Concat(w.second.readBam(&log_file)); 
+    }
+
+    bam_readers.Release(w.second);
+
+    w.second.blacklist = wbl;
+    w.second.simple_seq = wss;
     
     // update the counts
     if (w.first.at(0) == 't') 
@@ -1817,10 +2463,10 @@ void collect_and_clear_reads(WalkerMap& walkers, svabaReadVector& brv, std::vect
 
 void WriteFilesOut(svabaThreadUnit& wu) {
 
-  // print the alignment plots
+  // store the alignment plots, drawn later by svaba view-alignments
   for (const auto& i : wu.m_alc) 
-    if (i.hasVariant()) 
-      all_align << i << std::endl;
+    if (i.hasVariant())
+      all_align.Write(i.plotRecord());
 
   // send the microbe to file
   for (const auto& b : wu.m_vir_contigs)
@@ -1829,7 +2475,7 @@ void WriteFilesOut(svabaThreadUnit& wu) {
   // send the discordant to file
   for (auto& i : wu.m_disc)
     if (i.second.valid()) //std::max(i.second.mapq1, i.second.mapq2) >= 5)
-      os_discordant << i.second.toFileString(opt::read_tracking) << std::endl;
+      os_discordant.Write(i.second.m_reg1.chr, i.second.EdgePos1(), i.second.toFileString(b_header, opt::read_tracking));
   
   // write ALL contigs
   if (opt::verbose > 2)
@@ -1846,10 +2492,11 @@ void WriteFilesOut(svabaThreadUnit& wu) {
   // send breakpoints to file
   for (auto& i : wu.m_bps) {
     if ( i.hasMinimal() && (i.confidence != "NOLOCAL" || i.complex_local))
-      os_allbps << i.toFileString(!opt::read_tracking) << std::endl;
+      os_allbps.Write(i.b1.gr.chr, i.b1.gr.pos1, i.toFileString(!opt::read_tracking));
   }
 
   // clear them out
+  mem_gov.Release(wu.m_bytes);
   wu.clear();
 
 }
@@ -21,6 +21,7 @@
 #include "svabaBamWalker.h"
 #include "DiscordantCluster.h"
 #include "svabaAssemblerEngine.h"
+#include "IntervalFilter.h"
 
 #include "workqueue.h"
 
@@ -28,9 +29,13 @@
 typedef std::map<std::string, std::string> BamMap;
 typedef std::pair<int, int> CountPair;
 typedef std::map<std::string, SeqLib::SharedHTSFile> HTSFileMap;
+typedef std::map<std::string, SeqLib::BamRecordVector> StreamedReads; // key is bam id (t000)
+
+class svabaWorkItem;
 
 void learnBamParams(SeqLib::BamReader& walk, std::string id);
 void makeVCFs();
+void log_index_load(const std::string& prefix, double seconds);
 int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& subject);
 bool hasRepeat(const std::string& seq);
 void parseRunOptions(int argc, char** argv);
@@ -38,20 +43,21 @@ void runsvaba(int argc, char** argv);
 void learnParameters(const SeqLib::GRC& regions);
 int countJobs(SeqLib::GRC &file_regions, SeqLib::GRC &run_regions);
 void sendThreads(SeqLib::GRC& regions_torun);
-bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long unsigned int thread_id);
+void streamWindows(wqueue<svabaWorkItem*>& queue, const SeqLib::GRC& windows);
+bool runWorkItem(const SeqLib::GenomicRegion& region, svabaThreadUnit& wu, long unsigned int thread_id, StreamedReads * streamed = nullptr);
 SeqLib::GRC makeAssemblyRegions(const SeqLib::GenomicRegion& region);
 void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequenceVector& usv, SeqLib::BamRecordVector& bav_this, std::vector<AlignedContig>& this_alc, const SeqLib::RefGenome * rg);
-void set_walker_params(svabaBamWalker& walk);
+void set_walker_params(svabaBamWalker& walk, const IntervalFilter * bl, const IntervalFilter * ss);
 MateRegionVector __collect_normal_mate_regions(WalkerMap& walkers);
-MateRegionVector __collect_somatic_mate_regions(WalkerMap& walkers, MateRegionVector& bl);
+MateRegionVector __collect_somatic_mate_regions(WalkerMap& walkers, MateRegionVector& bl, const IntervalFilter * blf);
 SeqLib::GRC __get_exclude_on_badness(std::map<std::string, svabaBamWalker>& walkers, const SeqLib::GenomicRegion& region);
 void correct_reads(std::vector<char*>& learn_seqs, svabaReadVector& brv);
 void run_assembly(const SeqLib::GenomicRegion& region, svabaReadVector& bav_this, std::vector<AlignedContig>& master_alc, 
 		  SeqLib::BamRecordVector& master_contigs, SeqLib::BamRecordVector& master_microbial_contigs, DiscordantClusterMap& dmap,
-		  std::unordered_map<std::string, SeqLib::CigarMap>& cigmap, SeqLib::RefGenome* refg);
+		  std::vector<PackedCigarMap>& cigmap, SeqLib::RefGenome* refg, const IntervalFilter * simple);
 void remove_hardclips(svabaReadVector& brv);
 CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, int round, SeqLib::GRC& this_bad_mate_regions);
-CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, SeqLib::GRC& badd);
+CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, const IntervalFilter * bl);
 void collect_and_clear_reads(WalkerMap& walkers, svabaReadVector& brv, std::vector<char*>& learn_seqs, std::unordered_set<std::string>& dedupe);
 void WriteFilesOut(svabaThreadUnit& wu); 
 void run_test_assembly();
@@ -61,16 +67,22 @@ class svabaWorkItem {
  private:
   SeqLib::GenomicRegion m_gr;
   int m_number;  
+  bool m_streamed = false;
+  StreamedReads m_reads; // reads of the window, if cut from a stream
 
  public:
   svabaWorkItem(const SeqLib::GenomicRegion& gr, int number)  
     : m_gr(gr), m_number(number) {}
+
+  // take the reads of a streamed window
+  svabaWorkItem(const SeqLib::GenomicRegion& gr, int number, StreamedReads& reads)  
+    : m_gr(gr), m_number(number), m_streamed(true) { m_reads.swap(reads); }
     ~svabaWorkItem() {}
     
     int getNumber() { return m_number; }
     
     bool run(svabaThreadUnit& wu, long unsigned int thread_id) { 
-      return runWorkItem(m_gr, wu, thread_id);
+      return runWorkItem(m_gr, wu, thread_id, m_streamed ? &m_reads : nullptr);
     }
 };
 
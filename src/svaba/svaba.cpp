@@ -10,6 +10,11 @@
  */
 
 #include "refilter.h"
+#include "merge.h"
+#include "BwaImage.h"
+#include "DBSnpFilter.h"
+#include "PONFilter.h"
+#include "AlignmentPlot.h"
 #include "run_svaba.h"
 
 #define AUTHOR "Jeremiah Wala <jwala@broadinstitute.org>"
@@ -25,6 +30,11 @@ static const char *SVABA_USAGE_MESSAGE =
 "Commands:\n"
 "           run            Run SvABA SV and Indel detection on BAM(s)\n"
 "           refilter       Refilter the SvABA breakpoints with additional/different criteria to created filtered VCF and breakpoints file.\n"
+"           merge          Combine the outputs of a sharded run (svaba run --shard i/N) and make the VCFs.\n"
+"           index-image    Write a BWA index as one memory-mappable image, shared by concurrent svaba runs.\n"
+"           index-dbsnp    Write the indels of a DBSnp VCF as a binary index that loads instantly.\n"
+"           pon-build      Build or add to a binary indel panel of normals.\n"
+"           view-alignments  Draw the ASCII alignment plots of contigs from a run.\n"
 "\nReport bugs to jwala@broadinstitute.org \n\n";
 
 int main(int argc, char** argv) {
@@ -41,6 +51,16 @@ int main(int argc, char** argv) {
       runsvaba(argc -1, argv + 1);
     } else if (command == "refilter") {
       runRefilterBreakpoints(argc-1, argv+1);
+    } else if (command == "merge") {
+      runMergeShards(argc-1, argv+1);
+    } else if (command == "index-image") {
+      BwaImage::runIndexImage(argc-1, argv+1);
+    } else if (command == "index-dbsnp") {
+      runIndexDBSnp(argc-1, argv+1);
+    } else if (command == "pon-build") {
+      runPONBuild(argc-1, argv+1);
+    } else if (command == "view-alignments") {
+      runViewAlignments(argc-1, argv+1);
     }
     else {
       std::cerr << SVABA_USAGE_MESSAGE;
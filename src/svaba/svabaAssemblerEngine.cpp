@@ -1,8 +1,11 @@
 #include "svabaAssemblerEngine.h"
 #include "svabaUtils.h"
+#include "SubtaskPool.h"
 
 #include <map>
+#include <unordered_map>
 #include <algorithm>
+#include <cmath>
 
 #include "SGACommon.h"
 
@@ -11,20 +14,12 @@
 #include "svabaOverlapAlgorithm.h"
 
 #include "OverlapCommon.h"
+#include "SACASmallReads.h"
 #include "CorrectionThresholds.h"
 
-//#define DEBUG_ENGINE 1
+#include "SeqLib/FermiAssembler.h"
 
-static std::string POLYA = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
-static std::string POLYT = "TTTTTTTTTTTTTTTTTTTTTTTTTTTTTT";
-static std::string POLYC = "CCCCCCCCCCCCCCCCCCCCCCCCCCCCCC";
-static std::string POLYG = "GGGGGGGGGGGGGGGGGGGGGGGGGGGGGG";
-static std::string POLYAT = "ATATATATATATATATATATATATATATATATATATATAT";
-static std::string POLYTC = "TCTCTCTCTCTCTCTCTCTCTCTCTCTCTCTCTCTCTCTC";
-static std::string POLYAG = "AGAGAGAGAGAGAGAGAGAGAGAGAGAGAGAGAGAGAGAG";
-static std::string POLYCG = "CGCGCGCGCGCGCGCGCGCGCGCGCGCGCGCGCGCGCGCG";
-static std::string POLYTG = "TGTGTGTGTGTGTGTGTGTGTGTGTGTGTGTGTGTGTGTG";
-static std::string POLYCA = "CACACACACACACACACACACACACACACACACACACACA";
+//#define DEBUG_ENGINE 1
 
 void svabaAssemblerEngine::fillReadTable(const std::vector<std::string>& r) {
 
@@ -77,25 +72,73 @@ void svabaAssemblerEngine::fillReadTable(svabaReadVector& r) {
 
 bool svabaAssemblerEngine::hasRepeat(const std::string& seq) {
 
-  if (seq.find("N") != std::string::npos)
-    return true;
+  // any N, or for reads of 40+ bases, a 30 base homopolymer or 40 base
+  // two-base repeat. This is the (corrected) read the assembler gets, so
+  // it is scanned here rather than with the BAM bases
   if (seq.length() < 40)
+    return seq.find('N') != std::string::npos;
+  return svabaUtils::hasRepeatRun(seq, 30, 40, true);
+
+}
+
+bool svabaAssemblerEngine::find_components(std::vector<std::vector<size_t> >& comps) const {
+
+  // an overlap of min_overlap with e mismatches has an exact match of
+  // min_overlap / (e + 1), so reads sharing no k-mer that long can't overlap
+  size_t errs = std::ceil(m_error_rate * m_min_overlap);
+  size_t k = std::min<size_t>(31, m_min_overlap / (errs + 1));
+  if (k < COMPONENT_MIN_KMER)
     return false;
-  if ((seq.find(POLYT) == std::string::npos) && 
-      (seq.find(POLYA) == std::string::npos) && 
-      (seq.find(POLYC) == std::string::npos) && 
-      (seq.find(POLYG) == std::string::npos) && 
-      (seq.find(POLYCG) == std::string::npos) && 
-      (seq.find(POLYAT) == std::string::npos) && 
-      (seq.find(POLYTC) == std::string::npos) && 
-      (seq.find(POLYAG) == std::string::npos) && 
-      (seq.find(POLYCA) == std::string::npos) && 
-      (seq.find(POLYTG) == std::string::npos) && 
-      (seq.find("N") == std::string::npos))
-    return false;
-  
-  return true;
 
+  size_t n = m_pRT.getCount();
+  std::vector<size_t> parent(n);
+  for (size_t i = 0; i < n; ++i)
+    parent[i] = i;
+  auto find = [&parent](size_t i) {
+    while (parent[i] != i)
+      i = parent[i] = parent[parent[i]];
+    return i;
+  };
+
+  // union reads on their canonical k-mers
+  const uint64_t mask = (1ULL << (2 * k)) - 1;
+  std::unordered_map<uint64_t, size_t> first_read; // k-mer to first read with it
+  for (size_t r = 0; r < n; ++r) {
+    std::string seq = m_pRT.getRead(r).seq.toString();
+    uint64_t fw = 0, rc = 0;
+    size_t len = 0;
+    for (char c : seq) {
+      int b;
+      switch (c) {
+      case 'A': b = 0; break;
+      case 'C': b = 1; break;
+      case 'G': b = 2; break;
+      case 'T': b = 3; break;
+      default: len = 0; continue;
+      }
+      fw = ((fw << 2) | b) & mask;
+      rc = (rc >> 2) | ((uint64_t)(3 - b) << (2 * (k - 1)));
+      if (++len < k)
+	continue;
+      auto ins = first_read.insert(std::pair<uint64_t, size_t>(std::min(fw, rc), r));
+      if (!ins.second) {
+	size_t a = find(ins.first->second), b = find(r);
+	if (a != b)
+	  parent[std::max(a, b)] = std::min(a, b);
+      }
+    }
+  }
+
+  // components in order of their first read
+  std::unordered_map<size_t, size_t> comp_of_root;
+  for (size_t r = 0; r < n; ++r) {
+    auto ins = comp_of_root.insert(std::pair<size_t, size_t>(find(r), comps.size()));
+    if (ins.second)
+      comps.push_back(std::vector<size_t>());
+    comps[ins.first->second].push_back(r);
+  }
+
+  return true;
 }
 
 bool svabaAssemblerEngine::performAssembly(int num_assembly_rounds) 
@@ -107,8 +150,57 @@ bool svabaAssemblerEngine::performAssembly(int num_assembly_rounds)
   std::cout << "Doing assembly on: " << m_id << " with " << m_pRT.getCount() << " reads" << std::endl; 
 #endif
 
-  SeqLib::UnalignedSequenceVector contigs0;
-  //ContigVector contigs0;
+  if (m_use_fermi) {
+    assemble_fermi();
+    return true;
+  }
+
+  std::vector<std::vector<size_t> > comps;
+  if (!find_components(comps) || comps.size() < 2) {
+    assemble_rounds(num_assembly_rounds);
+    return true;
+  }
+
+  // drop the components too small to make a contig
+  size_t j = 0;
+  for (size_t i = 0; i < comps.size(); ++i)
+    if (comps[i].size() >= COMPONENT_MIN_READS)
+      comps[j++].swap(comps[i]);
+  comps.resize(j);
+
+#ifdef DEBUG_ENGINE
+  std::cout << "...split into " << comps.size() << " components" << std::endl;
+#endif
+
+  // each component gets an engine of its own
+  std::vector<SeqLib::UnalignedSequenceVector> comp_contigs(comps.size());
+  std::function<void(size_t)> assemble_comp = [&](size_t c) {
+    svabaAssemblerEngine e(m_id + "_" + std::to_string(c), m_error_rate, m_min_overlap, m_readlen);
+    e.m_write_asqg = m_write_asqg;
+    e.m_pool = m_pool;
+    for (auto r : comps[c])
+      e.m_pRT.addRead(m_pRT.getRead(r));
+    e.assemble_rounds(num_assembly_rounds);
+    comp_contigs[c].swap(e.m_contigs);
+  };
+  if (m_pool)
+    m_pool->ParallelFor(comps.size(), 1, assemble_comp);
+  else
+    for (size_t c = 0; c < comps.size(); ++c)
+      assemble_comp(c);
+
+  // number the contigs as if from one assembly
+  for (auto& cc : comp_contigs)
+    for (auto& c : cc) {
+      c.Name = m_id + "_" + std::to_string(m_contigs.size()) + "C";
+      m_contigs.push_back(c);
+    }
+
+  return true;
+}
+
+void svabaAssemblerEngine::assemble_rounds(int num_assembly_rounds) 
+{
 
 #ifdef DEBUG_ENGINE
   std::cout << "...round 1" << std::endl;
@@ -137,10 +229,32 @@ bool svabaAssemblerEngine::performAssembly(int num_assembly_rounds)
     doAssembly(&pRTc0, m_contigs, yy);      
     
   }
-  return true;
 }
 
 
+void svabaAssemblerEngine::assemble_fermi()
+{
+  SeqLib::FermiAssembler fml;
+  fml.SetMinOverlap(m_min_overlap);
+  for (size_t i = 0; i < m_pRT.getCount(); ++i) {
+    const SeqItem& si = m_pRT.getRead(i);
+    fml.AddRead(SeqLib::UnalignedSequence(si.id, si.seq.toString(), std::string()));
+  }
+
+  fml.PerformAssembly();
+
+  // named as the string graph contigs are
+  for (auto& s : fml.GetContigs())
+    m_contigs.push_back({m_id + "_" + std::to_string(m_contigs.size()) + "C", s, std::string()});
+
+  remove_exact_dups(m_contigs);
+
+#ifdef DEBUG_ENGINE
+  std::cerr << " FERMI " << std::endl;
+  print_results(m_contigs);
+#endif
+}
+
 // call the assembler
 void svabaAssemblerEngine::doAssembly(ReadTable *pRT, SeqLib::UnalignedSequenceVector &contigs, int pass) {
   
@@ -167,14 +281,17 @@ void svabaAssemblerEngine::doAssembly(ReadTable *pRT, SeqLib::UnalignedSequenceV
   // remove duplicates if running in exact mode
   ReadTable * pRT_nd = exact ? removeDuplicates(pRT) : pRT;    
 
+  // forward and reverse suffix arrays, sorted together
+  SuffixArray* pSAf_nd = new SuffixArray();
+  SuffixArray* pSAr_nd = new SuffixArray();
+  saca_small_reads(pSAf_nd, pSAr_nd, pRT_nd);
+
   // forward
-  SuffixArray* pSAf_nd = new SuffixArray(pRT_nd, 1, false); //1 is num threads. false is silent/no
-  RLBWT *pBWT_nd = new RLBWT(pSAf_nd, pRT_nd);
+  BWT *pBWT_nd = new BWT(pSAf_nd, pRT_nd);
 
   // reverse
   pRT_nd->reverseAll();
-  SuffixArray * pSAr_nd = new SuffixArray(pRT_nd, 1, false);
-  RLBWT *pRBWT_nd = new RLBWT(pSAr_nd, pRT_nd);
+  BWT *pRBWT_nd = new BWT(pSAr_nd, pRT_nd);
   pRT_nd->reverseAll();
 
   pSAf_nd->writeIndex();
@@ -203,26 +320,36 @@ void svabaAssemblerEngine::doAssembly(ReadTable *pRT, SeqLib::UnalignedSequenceV
 
   pRT_nd->setZero();
 
-  size_t workid = 0;
   SeqItem si;
 
+  std::vector<SeqRecord> reads;
   size_t ocount = 0;
   while (pRT_nd->getRead(si) && (++ocount < MAX_OVERLAPS_PER_ASSEMBLY)) {
-    
     SeqRecord read;
     read.id = si.id;
     read.seq = si.seq;
-    OverlapBlockList obl;
-    
-    OverlapResult rr = pOverlapper->overlapRead(read, min_overlap, &obl);
-    pOverlapper->writeOverlapBlocks(hits_stream, workid, rr.isSubstring, &obl);
+    reads.push_back(read);
+  }
 
-    svabaASQG::VertexRecord record(read.id, read.seq.toString());
-    record.setSubstringTag(rr.isSubstring);
+  // the overlapper is read-only, so the reads can be overlapped in any order
+  // and on any thread. The hits and vertices are written in read order after
+  std::vector<OverlapResult> results(reads.size());
+  std::vector<OverlapBlockList> blocks(reads.size());
+  std::function<void(size_t)> overlap = [&](size_t k) {
+    results[k] = pOverlapper->overlapRead(reads[k], min_overlap, &blocks[k]);
+  };
+  if (m_pool)
+    m_pool->ParallelFor(reads.size(), HOT_WINDOW_CHUNK, overlap);
+  else
+    for (size_t k = 0; k < reads.size(); ++k)
+      overlap(k);
+
+  for (size_t workid = 0; workid < reads.size(); ++workid) {
+    pOverlapper->writeOverlapBlocks(hits_stream, workid, results[workid].isSubstring, &blocks[workid]);
+
+    svabaASQG::VertexRecord record(reads[workid].id, reads[workid].seq.toString());
+    record.setSubstringTag(results[workid].isSubstring);
     record.write(asqg_stream);
-
-    ++workid;
-
   }
 
   std::string line;
@@ -287,14 +414,17 @@ void svabaAssemblerEngine::doAssembly(ReadTable *pRT, SeqLib::UnalignedSequenceV
 // not totally sure this works...
 ReadTable* svabaAssemblerEngine::removeDuplicates(ReadTable* pRT) {
 
+  // forward and reverse suffix arrays, sorted together
+  SuffixArray* pSAf = new SuffixArray();
+  SuffixArray* pSAr = new SuffixArray();
+  saca_small_reads(pSAf, pSAr, pRT);
+
   // forward
-  SuffixArray* pSAf = new SuffixArray(pRT, 1, false); //1 is num threads. false is silent/no
-  RLBWT *pBWT= new RLBWT(pSAf, pRT);
+  BWT *pBWT = new BWT(pSAf, pRT);
 
   // reverse
   pRT->reverseAll();
-  SuffixArray * pSAr = new SuffixArray(pRT, 1, false);
-  RLBWT *pRBWT = new RLBWT(pSAr, pRT);
+  BWT *pRBWT = new BWT(pSAr, pRT);
   pRT->reverseAll();
 
   svabaOverlapAlgorithm* pRmDupOverlapper = new svabaOverlapAlgorithm(pBWT, pRBWT, 
@@ -10,6 +10,8 @@
 #include "svabaRead.h"
 #include "svaba_params.h"
 
+class SubtaskPool;
+
 class svabaAssemblerEngine
 {
  public:
@@ -24,12 +26,22 @@ class svabaAssemblerEngine
   
   void fillReadTable(const std::vector<std::string>& r);
   
+  /** Assemble the read table. Reads that share no k-mer cannot overlap, so the
+   * table is split into connected components that are assembled on their own
+   * (in parallel on hot windows), skipping components too small to make a contig */
   bool performAssembly(int num_assembly_rounds);
   
   //void doAssembly(ReadTable *pRT, ContigVector &contigs, int pass);
   void doAssembly(ReadTable *pRT, SeqLib::UnalignedSequenceVector &contigs, int pass);
   
   void setToWriteASQG() { m_write_asqg = true; }
+
+  /** Assemble fermi-lite unitigs instead of the SGA string graph. Its time
+   * stays bounded on deep windows, where the number of overlaps explodes */
+  void setToUseFermi() { m_use_fermi = true; }
+
+  /** Share the overlap computation with idle threads (for hot windows) */
+  void setSubtaskPool(SubtaskPool * p) { m_pool = p; }
   
   SeqLib::UnalignedSequenceVector getContigs() const { return m_contigs; }
   //ContigVector getContigs() const { return m_contigs; }
@@ -44,6 +56,15 @@ class svabaAssemblerEngine
 
   void print_results(const SeqLib::UnalignedSequenceVector& cc) const;
 
+  // group the reads of the table by shared k-mers. Returns false if the table can't be split
+  bool find_components(std::vector<std::vector<size_t> >& comps) const;
+
+  // assemble the read table in rounds, without splitting it
+  void assemble_rounds(int num_assembly_rounds);
+
+  // assemble the read table with fermi-lite
+  void assemble_fermi();
+
   // void remove_exact_dups(ContigVector& cc) const;
   void remove_exact_dups(SeqLib::UnalignedSequenceVector& cc) const;
 
@@ -68,6 +89,10 @@ class svabaAssemblerEngine
   std::string outVariantsFile = ""; // dummy
   
   bool m_write_asqg = false;
+
+  bool m_use_fermi = false;
+
+  SubtaskPool * m_pool = nullptr;
   
   ReadTable m_pRT;
   
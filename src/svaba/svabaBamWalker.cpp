@@ -1,6 +1,11 @@
 #include "svabaBamWalker.h"
+
+#include <algorithm>
+#include <chrono>
+
 #include "svabaRead.h"
 #include "svaba_params.h"
+#include "svabaMemory.h"
 
 //#define QNAME "H01PEALXX140819:3:2218:11657:19504"
 //#define QFLAG -1
@@ -12,7 +17,6 @@
 #define DEBUG(msg, read)
 #endif
 
-static const std::string ILLUMINA_PE_PRIMER_2p0 = "CAAGCAGAAGACGGCAT";
 static const std::string FWD_ADAPTER_A = "AGATCGGAAGAGC";
 static const std::string FWD_ADAPTER_B = "AGATCGGAAAGCA";
 static const std::string REV_ADAPTER = "GCTCTTCCGATCT";
@@ -20,26 +24,25 @@ static const std::string REV_ADAPTER = "GCTCTTCCGATCT";
 void svabaBamWalker::addCigar(SeqLib::BamRecord &r) {
 
   // this is a 100% match
-  if (r.CigarSize() == 1)
+  const bam1_t * b = r.raw();
+  if (b->core.n_cigar == 1)
     return;
-  std::stringstream cigar_ss;
-  cigar_ss.str(std::string());
-  int pos = r.Position(); // position ON REFERENCE
-  
-  for (auto& i : r.GetCigar()) {
+  int pos = b->core.pos; // position ON REFERENCE
 
-       // if it's a D or I, add it to the list
-      if (i.Type() == 'D' || i.Type() == 'I') {	
+  // walk the packed CIGAR directly
+  const uint32_t * cig = bam_get_cigar(b);
+  for (uint32_t k = 0; k < b->core.n_cigar; ++k) {
 
-	cigar_ss << r.ChrID() << "_" << pos << "_" << i.Length() << i.Type();
-	++cigmap[cigar_ss.str()];
+      int op = bam_cigar_op(cig[k]);
+      uint32_t len = bam_cigar_oplen(cig[k]);
 
-	cigar_ss.str(std::string());
-      }
+       // if it's a D or I, add it to the list
+      if (op == BAM_CDEL || op == BAM_CINS)
+	cigmap.Add(PackedCigarMap::Key(b->core.tid, pos, len, op == BAM_CDEL));
       
       // move along the REFERENCE
-      if (!(i.Type() == 'I') && !(i.Type() == 'S') && !(i.Type() == 'H'))
-	pos += i.Length();
+      if (op != BAM_CINS && op != BAM_CSOFT_CLIP && op != BAM_CHARD_CLIP)
+	pos += len;
   }
   
 }
@@ -58,10 +61,56 @@ bool svabaBamWalker::isDuplicate(const SeqLib::BamRecord &r) {
   return true;
 }
 
+void svabaBamWalker::UseCramReference(CramReference * c) {
+  if (!c || !c->Enabled())
+    return;
+  for (auto& b : m_bams)
+    if (b.second.fp)
+      is_cram = c->Attach(b.second.fp.get()) || is_cram;
+}
+
+htsFile * svabaBamWalker::File() const {
+  return m_bams.empty() ? nullptr : m_bams.begin()->second.fp.get();
+}
+
+void svabaBamWalker::SetReader(const SeqLib::BamReader& r) {
+  static_cast<SeqLib::BamReader&>(*this) = r;
+  // the BAMs still point at the regions of the walker that opened them
+  for (auto& b : m_bams)
+    b.second.m_region = &m_region;
+}
+
+SeqLib::BamReader svabaBamWalker::TakeReader() {
+  SeqLib::BamReader r = *this;
+  static_cast<SeqLib::BamReader&>(*this) = SeqLib::BamReader();
+  return r;
+}
+
+void svabaBamWalker::SetFeed(const SeqLib::BamRecordVector * feed, const SeqLib::GenomicRegion& region) {
+  m_feed = feed;
+  m_feed_idx = 0;
+  // the window is the main region (e.g. for the mate regions), not
+  // whatever regions the last lookup of a borrowed reader left here
+  m_region.clear();
+  m_region.add(region);
+}
+
+bool svabaBamWalker::nextRecord(SeqLib::BamRecord& r) {
+  if (!m_feed)
+    return GetNextRecord(r);
+  if (m_feed_idx >= m_feed->size())
+    return false;
+  // a fed record can be in two overlapping windows running at once,
+  // so modify a private copy
+  r.assign(bam_dup1((*m_feed)[m_feed_idx++].raw()));
+  return true;
+}
+
 SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
 
-  // these are setup to only use one bam, so just shortcut it
-  SeqLib::_Bam * tb = &m_bams.begin()->second;
+  // these are setup to only use one bam, so just shortcut it.
+  // no file when fed from stdin
+  SeqLib::_Bam * tb = m_bams.empty() ? nullptr : &m_bams.begin()->second;
 
   SeqLib::BamRecord r;
 
@@ -72,33 +121,46 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
   // buffer to store reads from a region
   // if we don't hit the limit, then add them to be assembled
   svabaReadVector this_reads;
+  size_t this_bytes = 0;
 
   // if we have a LOT of reads (aka whole genome run), keep track for printing
   size_t countr = 0;
 
   // keep track of which region we are in 
-  int current_region = tb->m_region_idx;
+  int current_region = tb ? tb->m_region_idx : 0;
 
   // store qnames of reads have read into adapter
   std::unordered_set<uint32_t> adapter;
 
+  // reads come in sorted, so walk cursors forward along the filters
+  IntervalFilter::Cursor bl_cursor(blacklist), ss_cursor(simple_seq);
+
+  std::chrono::steady_clock::time_point read_start = std::chrono::steady_clock::now();
+
   // loop the reads
-  while (GetNextRecord(r)) {
+  while (nextRecord(r)) {
+
+    ++num_records;
 
     // when we more regions, save the reads from last region
-    if (tb->m_region_idx != current_region) {
+    if (!m_feed && tb->m_region_idx != current_region) {
       current_region = tb->m_region_idx;
       reads.insert(reads.end(), this_reads.begin(), this_reads.end());
       this_reads.clear();
+      this_bytes = 0;
     }
 
     // check if it passed blacklist
-    if (blacklist.size() && blacklist.CountOverlaps(r.AsGenomicRegion())) {
+    if (blacklist && bl_cursor.Overlaps(r.AsGenomicRegion())) {
       continue;
     }
 
+    // Ns, primer and quality trim bounds, from the packed record
+    ReadScan scan;
+    scan.Scan(r.raw(), 3);
+
     // dont even mess with them
-    if (r.CountNBases())
+    if (scan.n_count)
       continue;
 
     // set some things to check later
@@ -110,7 +172,7 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
     svabaRead s(r, prefix);
 
     // quality score trim read. Stores in GV tag
-    QualityTrimRead(s);
+    QualityTrimRead(s, scan);
     
     // if its less than 20, dont even mess with it
     //if (s.QualitySequence().length() < 20)
@@ -126,24 +188,35 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
 
     // if hit the limit of reads, log it and try next region
     //if (countr > m_limit && m_limit > 0) {
-    if (this_reads.size() > m_limit && m_limit > 0) {
+    if ((this_reads.size() > m_limit && m_limit > 0) || (this_bytes > m_byte_limit && m_byte_limit > 0)) {
 
       std::stringstream ss; 
       ss << "\tstopping read lookup at " << r.Brief() << " in window " 
-	       << (m_region.size() ? m_region[tb->m_region_idx].ToString() : " whole BAM")
+	       << (m_region.size() ? m_region[m_feed ? 0 : tb->m_region_idx].ToString() : " whole BAM")
 	       << " with " << SeqLib::AddCommas(this_reads.size()) 
-	       << " weird reads. Limit: " << SeqLib::AddCommas(m_limit) << std::endl;
+	       << " weird reads";
+      if (m_byte_limit)
+	ss << " (" << svabaMemory::toString(this_bytes) << ")";
+      ss << ". Limit: " << SeqLib::AddCommas(m_limit);
+      if (m_byte_limit)
+	ss << " reads / " << svabaMemory::toString(m_byte_limit);
+      ss << std::endl;
       if (log)
 	(*log) << ss.str();
       std::cerr << ss.str();
       
       if (m_region.size())  
-	bad_regions.add(m_region[tb->m_region_idx]);
+	bad_regions.add(m_region[m_feed ? 0 : tb->m_region_idx]);
 
       // clear these reads out
       //if ((int)reads.size() - countr > 0)
       this_reads.clear();
+      this_bytes = 0;
       //reads.erase(reads.begin(), reads.begin() + countr);
+
+      // a fed window has no next region
+      if (m_feed)
+	break;
       
       // force it to try the next region, or return if none left
       ++tb->m_region_idx; // increment to next region
@@ -162,17 +235,10 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
     }
     
     // check if in simple-seq
-    if (simple_seq->size()) {
+    if (simple_seq) {
       
       // check simple sequence overlaps
-      SeqLib::GRC ovl = simple_seq->FindOverlaps(r.AsGenomicRegion(), true);
-      
-      int msize = 0;
-      for (auto& j: ovl) {
-	int nsize = j.Width() - r.MaxDeletionBases() - 1;
-	if (nsize > msize && nsize > 0)
-	  msize = nsize;
-      }
+      int msize = ss_cursor.MaxOverlap(r.AsGenomicRegion()) - (int)r.MaxDeletionBases() - 1;
       
       if (msize > 30)
         qcpass = false;
@@ -182,7 +248,7 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
     
     // check if has adapter
     uint32_t hashed  = __ac_Wang_hash(__ac_X31_hash_string(r.Qname().c_str()));
-    if (hasAdapter(r)) 
+    if (hasAdapter(r, scan.primer)) 
       adapter.insert(hashed);
     pass_all = pass_all && !adapter.count(hashed);
 
@@ -228,7 +294,7 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
       continue;
     
     ++countr;
-    if (countr % 10000 == 0 && m_region.size() == 0 && log)
+    if (countr % 10000 == 0 && m_region.size() == 0 && !m_feed && log)
       (*log) << "...read in " << SeqLib::AddCommas<size_t>(countr) << " weird reads for whole genome read-in. At pos " << r.Brief() << std::endl;
     
     // for memory conservation
@@ -248,9 +314,16 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log) {
     s.RemoveTag("GV");
    
     this_reads.push_back(s); // adding later because of kmer correctiona 
+    if (m_byte_limit)
+      this_bytes += s.NumBytes();
     
   } // end the read loop
 
+  // a feed is for one read-in
+  m_feed = nullptr;
+
+  read_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - read_start).count();
+
   // remove the adapter reads
   svabaReadVector new_reads;
   for (auto& r : this_reads)
@@ -332,12 +405,18 @@ void svabaBamWalker::calculateMateRegions() {
 
   SeqLib::GenomicRegion main_region = m_region.at(0);
 
-  // hold candidate regions. Later trim based on count
-  MateRegionVector tmp_mate_regions;
+  // mate positions that make regions, and ones that count toward them
+  std::vector<std::pair<int32_t, int32_t> > region_mates, count_mates;
 
-  // loop the reads and add mate reads to MateRegionVector
+  // loop the reads and collect the mate positions
   for (auto& r : reads) {
 
+    SeqLib::GenomicRegion m(r.MateChrID(), r.MatePosition(), r.MatePosition());
+
+    // if mate not in main interval, it counts toward the region it's in
+    if (!main_region.GetOverlap(m) && r.MapQuality() > 0)
+      count_mates.push_back(std::pair<int32_t, int32_t>(r.MateChrID(), r.MatePosition()));
+
     //int dd = r.GetIntTag("DD");
     int dd = r.GetDD(); 
     
@@ -349,31 +428,39 @@ void svabaBamWalker::calculateMateRegions() {
 
     MateRegion mate(r.MateChrID(), r.MatePosition(), r.MatePosition());
     mate.Pad(MATE_REGION_PAD);
-    mate.partner = main_region;
     
-    // if mate not in main interval, add a padded version
-    if (!main_region.GetOverlap(mate) && r.MapQuality() >= MIN_MAPQ_FOR_MATE_LOOKUP) {
-      tmp_mate_regions.add(mate);
-    }
+    // if mate not in main interval, it makes a padded region
+    if (!main_region.GetOverlap(mate) && r.MapQuality() >= MIN_MAPQ_FOR_MATE_LOOKUP)
+      region_mates.push_back(std::pair<int32_t, int32_t>(r.MateChrID(), r.MatePosition()));
     
   }
 
-  // merge it down to get the mate regions
-  tmp_mate_regions.MergeOverlappingIntervals();
-
-  // get the counts by overlapping mate-reads with the newly defined mate regions
-  for (auto& r : reads) {
-    
-    SeqLib::GenomicRegion mate(r.MateChrID(), r.MatePosition(), r.MatePosition());
+  std::sort(region_mates.begin(), region_mates.end());
+  std::sort(count_mates.begin(), count_mates.end());
 
-    // if mate not in main interval, check which mate regions it's in
-    if (!main_region.GetOverlap(mate) && r.MapQuality() > 0) {
+  // the pads are all the same width, so sorted mates give sorted regions:
+  // merge each into the last one if they overlap
+  std::vector<MateRegion> tmp_mate_regions;
+  for (const auto& m : region_mates) {
+    MateRegion mate(m.first, m.second, m.second);
+    mate.Pad(MATE_REGION_PAD);
+    if (tmp_mate_regions.size() && tmp_mate_regions.back().chr == mate.chr
+	&& tmp_mate_regions.back().pos2 >= mate.pos1) {
+      tmp_mate_regions.back().pos2 = std::max(tmp_mate_regions.back().pos2, mate.pos2);
+    } else {
+      mate.partner = main_region;
+      tmp_mate_regions.push_back(mate);
+    }
+  }
 
-      for (auto& k : tmp_mate_regions)
-	if (k.GetOverlap(mate)) {
-	  ++k.count;
-	  continue;
-	}
+  // get the counts by sweeping the sorted mates along the (disjoint) regions
+  size_t j = 0;
+  for (auto& k : tmp_mate_regions) {
+    while (j < count_mates.size() && count_mates[j] < std::pair<int32_t, int32_t>(k.chr, k.pos1))
+      ++j;
+    while (j < count_mates.size() && count_mates[j] <= std::pair<int32_t, int32_t>(k.chr, k.pos2)) {
+      ++k.count;
+      ++j;
     }
   }
 
@@ -397,7 +484,38 @@ void svabaBamWalker::calculateMateRegions() {
   
 }
 
-bool svabaBamWalker::hasAdapter(const SeqLib::BamRecord& r) const {
+MateRegionVector mergeMateRegions(std::vector<MateRegion>& regions) {
+
+  // stable, so ties keep their order and the same region's count survives
+  std::stable_sort(regions.begin(), regions.end(), [](const MateRegion& a, const MateRegion& b) {
+      if (a.chr != b.chr)
+	return a.chr < b.chr;
+      if (a.pos1 != b.pos1)
+	return a.pos1 < b.pos1;
+      return a.pos2 < b.pos2;
+    });
+
+  MateRegionVector merged;
+  if (!regions.size())
+    return merged;
+
+  MateRegion cur = regions[0];
+  for (size_t i = 1; i < regions.size(); ++i) {
+    const MateRegion& r = regions[i];
+    if (r.chr == cur.chr && cur.pos2 >= r.pos1) {
+      // the merged region keeps the count of its first region, not the sum
+      cur.pos2 = std::max(cur.pos2, r.pos2);
+    } else {
+      merged.add(cur);
+      cur = r;
+    }
+  }
+  merged.add(cur);
+
+  return merged;
+}
+
+bool svabaBamWalker::hasAdapter(const SeqLib::BamRecord& r, bool primer) const {
 
   // keep it if it has indel or unmapped read
   if (r.MaxDeletionBases() || r.MaxInsertionBases() || !r.InsertSize()) // || !r.NumClip())
@@ -416,11 +534,8 @@ bool svabaBamWalker::hasAdapter(const SeqLib::BamRecord& r) const {
   if ((exp_ins_size - 6) < std::abs(r.InsertSize()) && (exp_ins_size + 6) > std::abs(r.InsertSize()))
     return true;
 
-  std::string seq = r.Sequence();
-  if (seq.find(ILLUMINA_PE_PRIMER_2p0) != std::string::npos)
-    return true;
-
-  return false;
+  // has the Illumina PE primer (found by ReadScan)
+  return primer;
 
 }
 
@@ -447,27 +562,22 @@ void svabaBamWalker::realignDiscordants(svabaReadVector& reads) {
 
 }
 
-void svabaBamWalker::QualityTrimRead(svabaRead& r) const {
+void svabaBamWalker::QualityTrimRead(svabaRead& r, const ReadScan& scan) const {
 
-  int32_t startpoint = 0, endpoint = 0;
-  r.QualityTrimmedSequence(3, startpoint, endpoint);
+  int32_t startpoint = scan.trim_start, endpoint = scan.trim_end;
   int32_t new_len = endpoint - startpoint;
-  if (endpoint != -1 && new_len < r.Length() && new_len > 0 && new_len - startpoint >= 0 && startpoint + new_len <= r.Length()) { 
-    try { 
-      //r.AddZTag("GV", r.Sequence().substr(startpoint, new_len));
-      r.SetSeq(r.Sequence().substr(startpoint, new_len));
-      //assert(r.GetZTag("GV").length());
-    } catch (...) {
-      std::cerr << "Subsequence failure with sequence of length "  
-		<< r.Sequence().length() << " and startpoint "
-		<< startpoint << " endpoint " << endpoint 
-		<< " newlen " << new_len << std::endl;
-    }
-    // read is fine
-  } else {
-    //r.AddZTag("GV", r.Sequence());
-    r.SetSeq(r.Sequence()); // copies the sequence
+
+  // keep the whole read unless the trim is sane
+  if (!(endpoint != -1 && new_len < r.Length() && new_len > 0 && new_len - startpoint >= 0 && startpoint + new_len <= r.Length())) { 
+    startpoint = 0;
+    new_len = r.Length();
   }
-  
+
+  // decode just the kept bases
+  const uint8_t * p = bam_get_seq(r.raw());
+  std::string seq(new_len, 'N');
+  for (int32_t i = 0; i < new_len; ++i)
+    seq[i] = seq_nt16_str[bam_seqi(p, startpoint + i)];
+  r.SetSeq(seq);
 
 }
@@ -11,6 +11,10 @@
 #include "STCoverage.h"
 #include "SeqLib/BWAWrapper.h"
 #include "DiscordantRealigner.h"
+#include "IntervalFilter.h"
+#include "CramReference.h"
+#include "PackedCigarMap.h"
+#include "ReadScan.h"
 
 #include "SeqLib/BFC.h"
 
@@ -27,6 +31,11 @@ class MateRegion: public SeqLib::GenomicRegion
 
 typedef SeqLib::GenomicRegionCollection<MateRegion> MateRegionVector;
 
+/** Sort mate regions and merge the overlapping ones in one sweep. As with
+ * MergeOverlappingIntervals, a merged region keeps the read count of the
+ * first region in it. The result is sorted and disjoint */
+MateRegionVector mergeMateRegions(std::vector<MateRegion>& regions);
+
 class svabaBamWalker: public SeqLib::BamReader {
   
  public:
@@ -39,12 +48,36 @@ class svabaBamWalker: public SeqLib::BamReader {
   // for setting the SR tag
   std::string prefix; // eg. tumor, normal
 
-  // regions to blacklist
-  SeqLib::GRC blacklist;
+  // regions to blacklist (shared, owned by caller)
+  const IntervalFilter * blacklist = nullptr;
 
   // read in the reads
   SeqLib::GRC readBam(std::ofstream* log = nullptr);
 
+  // take the reads for the next readBam from these (sorted) records of one
+  // window, instead of from the file, with the window as the region.
+  // Used when windows are cut from a stream
+  void SetFeed(const SeqLib::BamRecordVector * feed, const SeqLib::GenomicRegion& region);
+
+  // decode CRAMs with the shared reference and thread pool (call after Open)
+  void UseCramReference(CramReference * c);
+
+  // open file of the (first) input, e.g. to check its format. Null if not open
+  htsFile * File() const;
+
+  // read from a reader opened elsewhere (e.g. by another walker)
+  void SetReader(const SeqLib::BamReader& r);
+
+  // hand the open reader over, leaving this walker without one
+  SeqLib::BamReader TakeReader();
+
+  // is the input a CRAM (set by UseCramReference)
+  bool is_cram = false;
+
+  // records decoded and seconds spent decoding them, for throughput
+  size_t num_records = 0;
+  double read_seconds = 0;
+
   // clear it out
   void clear() { 
     cov.clear();
@@ -61,7 +94,7 @@ class svabaBamWalker: public SeqLib::BamReader {
 
   void realignDiscordants(svabaReadVector& reads);
   
-  bool hasAdapter(const SeqLib::BamRecord& r) const;
+  bool hasAdapter(const SeqLib::BamRecord& r, bool primer) const;
   
   void addCigar(SeqLib::BamRecord &r);
   
@@ -89,14 +122,14 @@ class svabaBamWalker: public SeqLib::BamReader {
   //    coverage to compare against this buffered alt cov.
   STCoverage cov, weird_cov; //c
 
-  // hash of cigars for indels
-  SeqLib::CigarMap cigmap; //c
+  // counts of the indels in read cigars
+  PackedCigarMap cigmap; //c
 
   // mate regions to lookup
   MateRegionVector mate_regions; //c
 
-  // filter out reads at simple repeats?
-  SeqLib::GRC * simple_seq;
+  // filter out reads at simple repeats? (shared, owned by caller)
+  const IntervalFilter * simple_seq = nullptr;
   
   // object for realigning discordant reads
   DiscordantRealigner dr; //c
@@ -115,6 +148,9 @@ class svabaBamWalker: public SeqLib::BamReader {
   // set a hard limit on how many reads to accept
   size_t m_limit = 0;
 
+  // set a limit on how many bytes of reads to accept (0 for no limit)
+  size_t m_byte_limit = 0;
+
   // set a read filter
   SeqLib::Filter::ReadFilterCollection * m_mr;
 
@@ -133,8 +169,15 @@ class svabaBamWalker: public SeqLib::BamReader {
   // seed for the kmer-learning subsampling
   uint32_t m_seed = 1337;
 
+  // records for the next readBam, if fed from a stream. Their window is m_region
+  const SeqLib::BamRecordVector * m_feed = nullptr;
+  size_t m_feed_idx = 0;
+
+  // next record from the feed or the file
+  bool nextRecord(SeqLib::BamRecord& r);
+
   // quality trim the readd
-  void QualityTrimRead(svabaRead& r) const;
+  void QualityTrimRead(svabaRead& r, const ReadScan& scan) const;
   
 };
 
@@ -0,0 +1,217 @@
+#include "svabaMemory.h"
+
+#include <stdexcept>
+#include <sstream>
+#include <iomanip>
+#include <cctype>
+#include <fstream>
+
+#include "BreakPoint.h"
+#include "DiscordantCluster.h"
+#include "svaba_params.h"
+
+namespace svabaMemory {
+
+  size_t bytes(const SeqLib::BamRecord& r) {
+    const bam1_t * b = r.raw();
+    if (!b)
+      return sizeof(SeqLib::BamRecord);
+    return sizeof(SeqLib::BamRecord) + sizeof(bam1_t) + b->m_data;
+  }
+
+  size_t bytes(const svabaRead& r) {
+    return r.NumBytes();
+  }
+
+  size_t bytes(const svabaReadVector& v) {
+    size_t n = v.capacity() * sizeof(svabaRead);
+    for (const auto& r : v)
+      n += r.NumBytes() - sizeof(svabaRead);
+    return n;
+  }
+
+  size_t bytes(const SeqLib::BamRecordVector& v) {
+    size_t n = 0;
+    for (const auto& r : v)
+      n += bytes(r);
+    return n;
+  }
+
+  size_t bytes(const BreakPoint& b) {
+
+    size_t n = sizeof(BreakPoint);
+
+    // the strings that can get long (contig seqs, qnames)
+    n += b.seq.capacity() + b.read_names.capacity() + b.bxtable.capacity() +
+      b.ref.capacity() + b.alt.capacity() + b.insertion.capacity() + b.homology.capacity();
+
+    // per-sample support, with the qnames held for read tracking
+    for (const auto& a : b.allele) {
+      n += sizeof(SampleInfo);
+      for (const auto& s : a.supporting_reads)
+	n += s.capacity() + 32; // 32 for rb-tree node overhead
+    }
+
+    n += bytes(b.reads) - sizeof(svabaReadVector);
+    n += bytes(b.dc) - sizeof(DiscordantCluster);
+
+    return n;
+  }
+
+  size_t bytes(const DiscordantCluster& d) {
+    size_t n = sizeof(DiscordantCluster);
+    for (const auto& r : d.reads)
+      n += r.first.capacity() + r.second.NumBytes();
+    for (const auto& r : d.mates)
+      n += r.first.capacity() + r.second.NumBytes();
+    return n;
+  }
+
+  size_t assemblyBytes(const svabaReadVector& v) {
+
+    // total string length going into the read table (plus terminators)
+    size_t nbases = 0;
+    for (const auto& r : v)
+      nbases += r.SeqLength() + 1;
+
+    // read table itself, then a suffix array (one 64-bit SAElem per symbol)
+    // and a BWT (packed at half a byte per symbol, or run-length at about one),
+    // each built forward and reverse
+    return nbases + 2 * nbases * (sizeof(uint64_t) + 1);
+  }
+
+  size_t parseBytes(const std::string& s) {
+
+    if (s.empty())
+      throw std::invalid_argument("empty memory string");
+
+    size_t i = 0;
+    while (i < s.length() && (isdigit(s[i]) || s[i] == '.'))
+      ++i;
+    if (i == 0)
+      throw std::invalid_argument("memory string must start with a number: " + s);
+
+    double val = std::stod(s.substr(0, i));
+    std::string suffix = s.substr(i);
+
+    double mult = 1;
+    if (suffix.empty() || suffix == "B" || suffix == "b")
+      mult = 1;
+    else if (toupper(suffix[0]) == 'K')
+      mult = 1024.0;
+    else if (toupper(suffix[0]) == 'M')
+      mult = 1024.0 * 1024.0;
+    else if (toupper(suffix[0]) == 'G')
+      mult = 1024.0 * 1024.0 * 1024.0;
+    else if (toupper(suffix[0]) == 'T')
+      mult = 1024.0 * 1024.0 * 1024.0 * 1024.0;
+    else
+      throw std::invalid_argument("unknown memory unit in " + s + ". Use K, M, G or T");
+
+    return (size_t)(val * mult);
+  }
+
+  std::string toString(size_t b) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    double v = b;
+    int u = 0;
+    while (v >= 1024 && u < 4) {
+      v /= 1024;
+      ++u;
+    }
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(u ? 1 : 0) << v << " " << units[u];
+    return ss.str();
+  }
+
+  size_t procStatus(const std::string& field) {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line)) {
+      // e.g. "VmRSS:\t  123456 kB"
+      if (line.compare(0, field.length(), field) != 0 || line.length() <= field.length() || line[field.length()] != ':')
+	continue;
+      std::istringstream iss(line.substr(field.length() + 1));
+      size_t kb = 0;
+      iss >> kb;
+      return kb * 1024;
+    }
+    return 0;
+  }
+
+}
+
+svabaMemoryGovernor::svabaMemoryGovernor() {
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_condv, NULL);
+}
+
+svabaMemoryGovernor::~svabaMemoryGovernor() {
+  pthread_mutex_destroy(&m_mutex);
+  pthread_cond_destroy(&m_condv);
+}
+
+void svabaMemoryGovernor::Add(size_t b) {
+  pthread_mutex_lock(&m_mutex);
+  m_in_use += b;
+  if (m_in_use > m_peak)
+    m_peak = m_in_use;
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void svabaMemoryGovernor::Release(size_t b) {
+  pthread_mutex_lock(&m_mutex);
+  m_in_use = b > m_in_use ? 0 : m_in_use - b;
+  pthread_cond_broadcast(&m_condv);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+bool svabaMemoryGovernor::NearBudget() const {
+  if (!m_budget)
+    return false;
+  pthread_mutex_lock(&m_mutex);
+  bool near = m_in_use > m_budget * MEMORY_HIGH_WATER;
+  pthread_mutex_unlock(&m_mutex);
+  return near;
+}
+
+void svabaMemoryGovernor::WaitForRoom() {
+  pthread_mutex_lock(&m_mutex);
+  // only wait if someone else is running a window, otherwise
+  // nothing would ever release memory and we would deadlock
+  if (m_budget && m_in_use > m_budget * MEMORY_HIGH_WATER && m_active > 0) {
+    ++m_waits;
+    while (m_in_use > m_budget * MEMORY_HIGH_WATER && m_active > 0)
+      pthread_cond_wait(&m_condv, &m_mutex);
+  }
+  ++m_active;
+  pthread_mutex_unlock(&m_mutex);
+}
+
+size_t svabaMemoryGovernor::InUse() const {
+  pthread_mutex_lock(&m_mutex);
+  size_t b = m_in_use;
+  pthread_mutex_unlock(&m_mutex);
+  return b;
+}
+
+size_t svabaMemoryGovernor::Peak() const {
+  pthread_mutex_lock(&m_mutex);
+  size_t b = m_peak;
+  pthread_mutex_unlock(&m_mutex);
+  return b;
+}
+
+size_t svabaMemoryGovernor::NumWaits() const {
+  pthread_mutex_lock(&m_mutex);
+  size_t n = m_waits;
+  pthread_mutex_unlock(&m_mutex);
+  return n;
+}
+
+void svabaMemoryGovernor::WindowDone() {
+  pthread_mutex_lock(&m_mutex);
+  --m_active;
+  pthread_cond_broadcast(&m_condv);
+  pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,118 @@
+#ifndef SVABA_MEMORY_H__
+#define SVABA_MEMORY_H__
+
+// byte accounting for the structures svaba holds on the heap, and a
+// process-wide governor that keeps their sum under a --max-memory budget
+
+#include <pthread.h>
+#include <string>
+
+#include "SeqLib/BamRecord.h"
+#include "svabaRead.h"
+
+struct BreakPoint;
+class DiscordantCluster;
+
+namespace svabaMemory {
+
+  /** Estimate the heap footprint of a BAM record (struct plus the
+   * variable-length data block: qname, cigar, seq, qual and tags) */
+  size_t bytes(const SeqLib::BamRecord& r);
+
+  /** Estimate the footprint of a svabaRead, including its corrected
+   * sequence and any read-to-contig alignments */
+  size_t bytes(const svabaRead& r);
+
+  size_t bytes(const svabaReadVector& v);
+
+  size_t bytes(const SeqLib::BamRecordVector& v);
+
+  size_t bytes(const BreakPoint& b);
+
+  size_t bytes(const DiscordantCluster& d);
+
+  /** Estimate the size of the forward and reverse suffix arrays and
+   * BWTs that the assembler will build for a set of reads */
+  size_t assemblyBytes(const svabaReadVector& v);
+
+  /** Parse a human readable size (e.g. 16G, 500M, 2000000) into bytes.
+   * @exception Throws an invalid_argument on an unparseable string
+   */
+  size_t parseBytes(const std::string& s);
+
+  /** Format bytes as a human readable string (e.g. 1.2 GB) */
+  std::string toString(size_t b);
+
+  /** Read a size field (e.g. VmRSS, RssAnon, RssFile) of /proc/self/status in bytes.
+   * @return 0 if the field is not there (e.g. not Linux)
+   */
+  size_t procStatus(const std::string& field);
+
+}
+
+/** Global accounting of the bytes held by all threads.
+ *
+ * Threads report the bytes of reads, contigs and breakpoints they
+ * are holding (both in-flight windows and buffered output), and release them
+ * when the window is done or the buffer is flushed to disk. A thread
+ * about to start a new window calls WaitForRoom, which blocks while the
+ * governor is over its high-water mark and another window is still
+ * running (and so will eventually release memory).
+ *
+ * A budget of zero turns the governor off. Everything is still tallied
+ * (so peak usage can be reported) but nothing ever blocks.
+ */
+class svabaMemoryGovernor {
+
+ public:
+
+  svabaMemoryGovernor();
+
+  ~svabaMemoryGovernor();
+
+  /** Set the total budget in bytes. 0 for unlimited */
+  void SetBudget(size_t b) { m_budget = b; }
+
+  size_t Budget() const { return m_budget; }
+
+  bool Enabled() const { return m_budget > 0; }
+
+  /** Tally bytes that have been allocated */
+  void Add(size_t b);
+
+  /** Release bytes that have been freed, waking any blocked threads */
+  void Release(size_t b);
+
+  /** Is the tally above the high-water mark of the budget? */
+  bool NearBudget() const;
+
+  /** Mark the start of a window. Blocks if over budget and another
+   * window is running, until that window releases memory */
+  void WaitForRoom();
+
+  /** Mark the end of a window started with WaitForRoom */
+  void WindowDone();
+
+  // the tallies are read under the lock, since worker threads
+  // update them while the main thread reports them
+  size_t InUse() const;
+
+  size_t Peak() const;
+
+  /** Number of times a window had to wait for memory */
+  size_t NumWaits() const;
+
+ private:
+
+  size_t m_budget = 0;
+  size_t m_in_use = 0;
+  size_t m_peak = 0;
+  size_t m_waits = 0;
+  int m_active = 0; // windows currently running
+
+  mutable pthread_mutex_t m_mutex;
+  pthread_cond_t  m_condv;
+
+};
+
+#endif
@@ -36,6 +36,26 @@ void svabaRead::SetSeq(const std::string& nseq) {
   seq = SeqPointer<char>(strdup(nseq.c_str()));
 }
 
+size_t svabaRead::NumBytes() const {
+
+  size_t n = sizeof(svabaRead);
+  if (raw())
+    n += sizeof(bam1_t) + raw()->m_data;
+  if (seq)
+    n += strlen(seq.get()) + 1;
+  if (m_r2c)
+    for (const auto& i : *m_r2c) 
+      n += sizeof(R2CMap::value_type) + i.first.capacity() + i.second.cig.size() * sizeof(SeqLib::CigarField);
+  return n;
+}
+
+svabaRead svabaRead::DeepCopy() const {
+  svabaRead c = *this;
+  if (b)
+    c.assign(bam_dup1(b.get()));
+  return c;
+}
+
 std::string svabaRead::SR() const {
   return(std::string(p, 4) + "_" + std::to_string(AlignmentFlag()) + "_" + Qname());
 }
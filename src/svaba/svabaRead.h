@@ -54,6 +54,13 @@ class svabaRead : public SeqLib::BamRecord {
 
   int SeqLength() const { return strlen(seq.get()); }
 
+  /** Estimate of the heap bytes held by this read (bam1_t, corrected seq, r2c) */
+  size_t NumBytes() const;
+
+  /** Copy of this read with its own bam1_t, so tags can be changed
+   * on the copy without touching reads that share the original */
+  svabaRead DeepCopy() const;
+
   void AddR2C(const std::string& contig_name, const r2c& r) {
     if (!m_r2c) 
       m_r2c = SeqPointer<R2CMap>(new R2CMap());
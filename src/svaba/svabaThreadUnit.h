@@ -28,7 +28,7 @@ struct svabaThreadUnit {
   DiscordantClusterMap m_disc;
   size_t m_bamreads_count = 0;
   size_t m_disc_reads = 0;
-  SeqLib::GRC badd;
+  size_t m_bytes = 0; // estimated bytes held in the output buffers above
 
   void clear() {
     m_alc.clear();
@@ -37,6 +37,7 @@ struct svabaThreadUnit {
     m_bps.clear();
     m_disc.clear();
     m_bamreads_count = 0;
+    m_bytes = 0;
   }
   
   bool MemoryLimit(size_t read, size_t cont) const {
@@ -44,6 +45,11 @@ struct svabaThreadUnit {
     const size_t contlim = cont;
     return m_bamreads_count > readlim || m_contigs.size() > contlim || m_vir_contigs.size() > contlim || m_disc_reads > readlim;
   }
+
+  // byte-based version, used when running under a memory budget
+  bool MemoryLimit(size_t bytelim) const {
+    return m_bytes > bytelim;
+  }
   
   ~svabaThreadUnit() {
     clear();
@@ -1,19 +1,14 @@
 #include "svabaUtils.h"
 
 #include <iomanip>
+#include <numeric>
+
+#include "htslib/sam.h"
+
+#include "BwaImage.h"
 
 namespace svabaUtils {
 
-static std::string POLYA = "AAAAAAAAAAAAAAAAAAA";
-static std::string POLYT = "TTTTTTTTTTTTTTTTTTT";
-static std::string POLYC = "CCCCCCCCCCCCCCCCCCC";
-static std::string POLYG = "GGGGGGGGGGGGGGGGGGG";
-static std::string POLYAT = "ATATATATATATATATATATATAT";
-static std::string POLYCG = "CGCGCGCGCGCGCGCGCGCGCGCG";
-static std::string POLYTG = "TGTGTGTGTGTGTGTGTGTGTGTG";
-static std::string POLYCA = "CACACACACACACACACACACACA";
-static std::string POLYAG = "AGAGAGAGAGAGAGAGAGAGAGAG";
-static std::string POLYTC = "TCTCTCTCTCTCTCTCTCTCTCTC";
 
   std::string fileDateString() {
     // set the time string
@@ -79,20 +74,67 @@ static std::string POLYTC = "TCTCTCTCTCTCTCTCTCTCTCTC";
 
 
 bool hasRepeat(const std::string& seq) {
-  
-  if ((seq.find(POLYT) == std::string::npos) && 
-      (seq.find(POLYA) == std::string::npos) && 
-      (seq.find(POLYC) == std::string::npos) && 
-      (seq.find(POLYG) == std::string::npos) && 
-      (seq.find(POLYCG) == std::string::npos) && 
-      (seq.find(POLYAT) == std::string::npos) && 
-      (seq.find(POLYTC) == std::string::npos) && 
-      (seq.find(POLYAG) == std::string::npos) && 
-      (seq.find(POLYCA) == std::string::npos) && 
-      (seq.find(POLYTG) == std::string::npos))
-    return false;
-  return true;
-  
+  return hasRepeatRun(seq, 19, 24, false);
+}
+
+// the two-base repeats looked for, in the phase they start with
+// (AT, TC, AG, CG, TG and CA). Index is 4 * first + second base
+static const bool DINUC_PHASE[16] = {
+  // A      C      G      T    (second base)
+  false, false, true,  true,  // A
+  true,  false, true,  false, // C
+  false, false, false, false, // G
+  false, true,  true,  false  // T
+};
+
+static inline int base2(char c) {
+  switch (c) {
+  case 'A': return 0;
+  case 'C': return 1;
+  case 'G': return 2;
+  case 'T': return 3;
+  default: return -1;
+  }
+}
+
+bool hasRepeatRun(const std::string& seq, int homo_len, int dinuc_len, bool n_is_repeat) {
+
+  int hrun = 0; // length of the homopolymer ending here
+  int drun = 0; // length of the alternating two-base run ending here
+  size_t dstart = 0;
+
+  for (size_t i = 0; i < seq.length(); ++i) {
+
+    char c = seq[i];
+    if (base2(c) < 0) {
+      if (n_is_repeat && c == 'N')
+	return true;
+      hrun = drun = 0;
+      continue;
+    }
+
+    hrun = (hrun && seq[i-1] == c) ? hrun + 1 : 1;
+    if (hrun >= homo_len)
+      return true;
+
+    if (drun && seq[i-1] != c) {
+      if (drun >= 2 && seq[i-2] == c) {
+	++drun;
+      } else {
+	drun = 2;
+	dstart = i - 1;
+      }
+    } else {
+      drun = 1;
+      dstart = i;
+    }
+
+    // a run one longer than the repeat holds it in either phase
+    if (drun > dinuc_len || (drun == dinuc_len && DINUC_PHASE[4 * base2(seq[dstart]) + base2(seq[dstart+1])]))
+      return true;
+  }
+
+  return false;
 }
 
 int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& subject) {
@@ -242,18 +284,6 @@ int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& s
     return bam;
   }
 
-  bool __openWriterBam(const SeqLib::BamHeader& h, const std::string& name, SeqLib::BamWriter& wbam) {
-    
-    if (!wbam.Open(name))
-      return false;
-
-    wbam.SetHeader(h);;
-    if (!wbam.WriteHeader())
-      return false;
-    
-    return true;
-  }
-
   /*  bool __header_has_chr_prefix(bam_hdr_t * h) {
     for (int i = 0; i < h.NumSequences()) //->n_targets; ++i) 
       if (h->target_name[i] && std::string(h->target_name[i]).find("chr") != std::string::npos) 
@@ -269,10 +299,10 @@ int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& s
     b.CreateTreeMap();
   }
   
-  bool __open_index_and_writer(const std::string& index, SeqLib::BWAWrapper * b, const std::string& wname, SeqLib::BamWriter& writer, SeqLib::RefGenome *& r, SeqLib::BamHeader& bwa_header) {
+  bool __open_index(const std::string& index, SeqLib::BWAWrapper * b, SeqLib::RefGenome *& r, SeqLib::BamHeader& bwa_header) {
     
-    // load the BWA index
-    if (!b->LoadIndex(index))
+    // load the BWA index, from its image if there is one
+    if (!BwaImage::Load(index, b))
       return false;
 
     // load the same index, but for querying seq from ref
@@ -281,16 +311,15 @@ int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& s
 
     // get the dictionary from reference
     bwa_header = b->HeaderFromIndex();
-    
-    // open the bam for writing  
-    writer.SetHeader(bwa_header);
-    if (!writer.Open(wname)) // open and write header
-      return false;
-    writer.WriteHeader();
 
     return true;
   }
 
+  tbx_conf_t tabixConf() {
+    tbx_conf_t conf = { TBX_GENERIC, 1, 2, 2, '#', 1 };
+    return conf;
+  }
+
 //http://stackoverflow.com/questions/2114797/compute-median-of-values-stored-in-vector-c
 double CalcMHWScore(std::vector<int>& scores)
 {
@@ -324,4 +353,79 @@ double CalcMHWScore(std::vector<int>& scores)
     return al;
   }
 
+  std::vector<double> windowCosts(const std::vector<std::string>& bams, const SeqLib::GRC& windows) {
+
+    std::vector<double> costs(windows.size(), 0);
+
+    for (const auto& b : bams) {
+
+      htsFile * fp = hts_open(b.c_str(), "r");
+      if (!fp)
+	continue;
+      hts_idx_t * idx = sam_index_load(fp, b.c_str());
+      if (!idx) {
+	hts_close(fp);
+	continue;
+      }
+
+      // compressed bytes spanned by the index chunks for each window
+      for (size_t i = 0; i < windows.size(); ++i) {
+	const SeqLib::GenomicRegion& w = windows[i];
+	hts_itr_t * itr = sam_itr_queryi(idx, w.chr, w.pos1, w.pos2);
+	if (!itr)
+	  continue;
+	for (int j = 0; j < itr->n_off; ++j) 
+	  costs[i] += (double)((itr->off[j].v >> 16) - (itr->off[j].u >> 16));
+	hts_itr_destroy(itr);
+      }
+
+      hts_idx_destroy(idx);
+      hts_close(fp);
+    }
+
+    // no offsets to go on, so just use the width
+    double total = std::accumulate(costs.begin(), costs.end(), 0.0);
+    if (total <= 0) {
+      for (size_t i = 0; i < windows.size(); ++i)
+	costs[i] = windows[i].Width();
+      return costs;
+    }
+
+    // every window has a fixed cost too (setup, contig alignment), even if empty
+    double floor = total / windows.size() * 0.01;
+    for (auto& c : costs)
+      c += floor;
+
+    return costs;
+  }
+
+  std::vector<size_t> shardWindows(const std::vector<double>& costs, int shard, int num_shards) {
+
+    assert(shard >= 0 && shard < num_shards);
+
+    // largest first, ties broken by position so every shard agrees on the order
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    std::vector<double> load(num_shards, 0);
+    std::vector<bool> keep(costs.size(), false);
+    for (const auto& i : order) {
+      int s = std::min_element(load.begin(), load.end()) - load.begin();
+      load[s] += costs[i];
+      if (s == shard)
+	keep[i] = true;
+    }
+
+    std::vector<size_t> out;
+    for (size_t i = 0; i < keep.size(); ++i)
+      if (keep[i])
+	out.push_back(i);
+    return out;
+  }
+
+  std::string shardPrefix(const std::string& id, int shard, int num_shards) {
+    return id + ".shard" + std::to_string(shard) + "of" + std::to_string(num_shards);
+  }
+
 }
@@ -10,6 +10,7 @@
 #include "SeqLib/BamWriter.h"
 #include "SeqLib/BWAWrapper.h"
 #include "SeqLib/RefGenome.h"
+#include "htslib/tbx.h"
 
 #define SRTAG(r) ((r).GetZTag("SR") + "_" + std::to_string((r).AlignmentFlag()) + "_" + (r).Qname())
 
@@ -37,6 +38,11 @@ struct svabaTimer {
  
  int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& subject);
  bool hasRepeat(const std::string& seq);
+
+ /** Does a sequence have a homopolymer of homo_len, or a two-base repeat
+  * (AT, TC, AG, CG, TG or CA, in that phase) of dinuc_len, found in one
+  * pass over it. N counts as a repeat if n_is_repeat */
+ bool hasRepeatRun(const std::string& seq, int homo_len, int dinuc_len, bool n_is_repeat);
  std::string runTimeString(int num_t_reads, int num_n_reads, int contig_counter, 
 			   const SeqLib::GenomicRegion& region, const SeqLib::BamHeader& h, const svabaTimer& st, 
 			   const timespec& start);
@@ -54,19 +60,43 @@ struct svabaTimer {
 
   std::string __bamOptParse(std::map<std::string, std::string>& obam, std::istringstream& arg, int sample_number, const std::string& prefix);
 
-  bool __openWriterBam(const SeqLib::BamHeader& h, const std::string& name, SeqLib::BamWriter& wbam);
-
   void __open_bed(const std::string& f, SeqLib::GRC& b, const SeqLib::BamHeader& h);
 
   bool __header_has_chr_prefix(bam_hdr_t * h);
 
-  bool __open_index_and_writer(const std::string& index, SeqLib::BWAWrapper * b, const std::string& wname, SeqLib::BamWriter& writer, SeqLib::RefGenome *& r, SeqLib::BamHeader& bwa_header);
+  bool __open_index(const std::string& index, SeqLib::BWAWrapper * b, SeqLib::RefGenome *& r, SeqLib::BamHeader& bwa_header);
+
+  /** Tabix settings for the breakpoint and discordant files, which are indexed
+   * on the chromosome and position of the first break-end (columns 1 and 2)
+   * after one header line */
+  tbx_conf_t tabixConf();
 
   /** Generate a weighed random integer 
    * @param cs Weighting for each integer (values must sum to one) 
    * @return Random integer bounded on [0,cs.size())
    */
   int weightedRandom(const std::vector<double>& cs);
+
+  /** Estimate the relative cost of running each window, from the compressed
+   * bytes that the BAM indices say fall in it (summed over the BAMs)
+   * @param bams BAM files to look up. Windows are assumed to use the same chr IDs
+   * @param windows Windows to estimate, eg from countJobs
+   * @return Cost of each window. Falls back to window width if no index has offsets (eg CRAM)
+   */
+  std::vector<double> windowCosts(const std::vector<std::string>& bams, const SeqLib::GRC& windows);
+
+  /** Deterministically pick the windows for one shard, balancing the estimated cost.
+   * Windows are dealt largest-first to the shard with the least cost so far.
+   * @param costs Estimated cost of each window
+   * @param shard Zero-based shard index, in [0, num_shards)
+   * @return Indices of the windows for this shard, in their original order
+   */
+  std::vector<size_t> shardWindows(const std::vector<double>& costs, int shard, int num_shards);
+
+  /** Output prefix for one shard of a sharded run (eg. id.shard2of8)
+   * @param shard One-based shard index
+   */
+  std::string shardPrefix(const std::string& id, int shard, int num_shards);
   
 }
 
@@ -34,6 +34,16 @@
 #define THREAD_READ_LIMIT 20000
 #define THREAD_CONTIG_LIMIT 250
 
+// with --max-memory, fraction of the budget at which threads flush
+// their output buffers and new windows wait for running ones to finish
+#define MEMORY_HIGH_WATER 0.85
+// with --max-memory, fraction of the budget (split across threads) that 
+// a single thread may hold as buffered output before writing it out
+#define MEMORY_THREAD_BUFFER_FRAC 0.25
+// with --max-memory, fraction of a thread's share of the budget that reads
+// from one window can take up. The rest is left for the assembly indices
+#define MEMORY_WINDOW_READ_FRAC 0.25
+
 // minimum number of reads to support even reporting dscrd cluster 
 // (if not assocaited with assembly contig)
 #define MIN_DSCRD_READS_DSCRD_ONLY 3 
@@ -42,6 +52,17 @@
 //////////////////////////////////
 #define MAX_OVERLAPS_PER_ASSEMBLY 20000
 
+// reads are assembled separately in components linked by shared k-mers,
+// as long as the k-mer that guarantees every overlap is shared is at least
+// this long. Components with fewer reads than this are not assembled
+#define COMPONENT_MIN_KMER 11
+#define COMPONENT_MIN_READS 2
+
+// in auto assembler mode, windows with this many reads (where overlaps
+// start being capped) or this mean depth are assembled with fermi-lite
+#define FERMI_WINDOW_READS MAX_OVERLAPS_PER_ASSEMBLY
+#define FERMI_WINDOW_DEPTH 500
+
 #define MIN_CONTIG_MATCH 35
 #define MATE_LOOKUP_MIN 3
 #define SECONDARY_CAP 10
@@ -49,8 +70,52 @@
 #define MATE_REGION_LOOKUP_LIMIT 400
 #define MAX_NUM_MATE_WINDOWS 50000000
 
+// mate regions are cached in tiles of this size, so that
+// lookups from different windows land on the same keys.
+// Off by default, since the cache changes which mate reads a window sees
+#define MATE_CACHE_TILE 2000
+#define MATE_CACHE_SIZE_MB 0
+
+// genome / microbe alignments of contigs are cached across windows
+#define CONTIG_CACHE_SIZE_MB 64
+
+// BAM params are learned from batches of this many reads, taken at
+// random sites (on sequences at least LEARN_MIN_CHR_LEN long) in rounds
+// of LEARN_SITES_PER_ROUND. Sampling stops when the 2.5/50/97.5% insert
+// sizes of each read group (with at least LEARN_MIN_ISIZE of them) move
+// less than LEARN_CONVERGE_FRAC in a round
+#define LEARN_SITE_READS 2000
+#define LEARN_SITES_PER_ROUND 64
+#define LEARN_MIN_CHR_LEN 1000000
+#define LEARN_MIN_ISIZE 20000
+#define LEARN_CONVERGE_FRAC 0.01
+
+// sorted outputs hold this much before spilling a sorted run to disk
+#define OUTPUT_RUN_MB 64
+
 #define GERMLINE_CNV_PAD 10
 #define WINDOW_PAD 500
+
+// streamed (stdin / whole-BAM) runs cut windows of this size when chunk is 0,
+// and hold at most this many windows per thread waiting in the queue
+#define STREAM_WINDOW 25000
+#define STREAM_QUEUE_PER_THREAD 2
+
+// joint runs of this many samples over the whole genome are streamed too,
+// one merged sweep of the inputs instead of a seek per sample per window
+#define JOINT_STREAM_SAMPLES 8
+
+// each input of a streamed run is decoded on its own thread, handing the
+// sweep batches of this many reads, at most this many batches ahead
+// (about 9 MB an input, for 150 bp reads)
+#define STREAM_BATCH_READS 4096
+#define STREAM_BATCHES_PER_INPUT 4
+
+// windows with this many reads to assemble share their loops with
+// idle threads, in chunks of this many reads
+#define HOT_WINDOW_READS 5000
+#define HOT_WINDOW_CHUNK 64
+
 #define MICROBE_MATCH_MIN 50
 #define GET_MATES 1
 #define MICROBE 1
@@ -67,6 +132,10 @@
 #define MAX_SECONDARY_HIT_DISC 10
 #define MATE_REGION_PAD 250
 
+// pad a window when pulling the blacklist / simple-seq intervals
+// for it, so reads hanging off the edge are still checked locally
+#define INTERVAL_FILTER_PAD 1000
+
 // trim this many bases from front and back of read when determining coverage
 // this should be synced with the split-read buffer in BreakPoint2 for more accurate 
 // representation of covearge of INFORMATIVE reads (eg ones that could be split)
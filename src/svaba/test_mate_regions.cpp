@@ -0,0 +1,140 @@
+// mate regions of a window read from a stream (records fed to the walker)
+// match those of the same window read from an indexed BAM
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "SeqLib/BamReader.h"
+#include "SeqLib/BamWriter.h"
+#include "SeqLib/ReadFilter.h"
+#include "svabaBamWalker.h"
+
+static int failures = 0;
+
+// reads that pass: discordant across chromosomes
+static const std::string rules = "{\"global\" : {\"qcfail\" : false}, \"\" : { \"rules\" : [{\"ic\" : true}]}}";
+
+static std::string read_seq(int n) {
+  std::string s;
+  uint32_t x = 2463534242U + n * 7919;
+  for (int i = 0; i < 50; ++i) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    s += "ACGT"[x & 3];
+  }
+  return s;
+}
+
+// one read of a pair, with its mate on another chromosome
+static void sam_read(std::ofstream& out, int& n, const std::string& chr, int pos, const std::string& mchr, int mpos) {
+  out << "r" << ++n << "\t97\t" << chr << "\t" << pos << "\t60\t50M\t" << mchr << "\t" << mpos
+      << "\t0\t" << read_seq(n) << "\t" << std::string(50, 'I') << "\n";
+}
+
+static void mate_regions(svabaBamWalker& w, SeqLib::Filter::ReadFilterCollection& mr, MateRegionVector& out) {
+  w.prefix = "t000";
+  w.m_mr = &mr;
+  w.readBam();
+  out = w.mate_regions;
+}
+
+static void expect_same(const std::string& what, const MateRegionVector& a, const MateRegionVector& b) {
+  bool same = a.size() == b.size();
+  for (size_t i = 0; same && i < a.size(); ++i)
+    same = a[i] == b[i] && a[i].count == b[i].count && a[i].partner == b[i].partner;
+  if (!same) {
+    std::cerr << "FAIL " << what << ": " << a.size() << " mate regions, expected " << b.size() << std::endl;
+    for (auto& m : a)
+      std::cerr << "  got " << m.ToString() << " count " << m.count << " partner " << m.partner.ToString() << std::endl;
+    for (auto& m : b)
+      std::cerr << "  expected " << m.ToString() << " count " << m.count << " partner " << m.partner.ToString() << std::endl;
+    ++failures;
+  }
+}
+
+int main() {
+
+  std::string sam = "test_mate_regions.sam", bam = "test_mate_regions.bam";
+
+  {
+    std::ofstream out(sam.c_str());
+    out << "@HD\tVN:1.6\tSO:coordinate\n@SQ\tSN:1\tLN:100000\n@SQ\tSN:2\tLN:100000\n";
+    int n = 0;
+    sam_read(out, n, "1", 5000, "2", 70000);  // before the window
+    for (int i = 0; i < 4; ++i)               // a mate region of 4 reads
+      sam_read(out, n, "1", 12000 + i * 10, "2", 50000 + i * 20);
+    sam_read(out, n, "1", 13000, "2", 30000); // a lone mate, too few for a region
+    for (int i = 0; i < 3; ++i)               // and one of 3
+      sam_read(out, n, "1", 15000 + i * 10, "2", 80000 + i * 20);
+    sam_read(out, n, "1", 30000, "2", 90000); // after the window
+    sam_read(out, n, "2", 60000, "1", 60000);
+  }
+
+  // sorted and indexed, for the reads by region
+  SeqLib::BamReader in;
+  SeqLib::BamRecordVector records;
+  if (!in.Open(sam)) {
+    std::cerr << "FAIL reading " << sam << std::endl;
+    return EXIT_FAILURE;
+  }
+  SeqLib::BamWriter wr;
+  wr.SetHeader(in.Header());
+  wr.Open(bam);
+  wr.WriteHeader();
+  SeqLib::BamRecord r;
+  while (in.GetNextRecord(r)) {
+    wr.WriteRecord(r);
+    records.push_back(r);
+  }
+  wr.Close();
+  wr.BuildIndex();
+
+  SeqLib::Filter::ReadFilterCollection mr(rules, in.Header());
+  SeqLib::GenomicRegion window(0, 10000, 20000);
+
+  // the stream hands a window the reads that overlap it
+  SeqLib::BamRecordVector fed;
+  for (auto& i : records)
+    if (window.GetOverlap(i.AsGenomicRegion()))
+      fed.push_back(i);
+
+  // from the file, by region
+  MateRegionVector from_file;
+  svabaBamWalker f;
+  f.Open(bam);
+  f.SetRegion(window);
+  mate_regions(f, mr, from_file);
+  if (from_file.size() != 2) {
+    std::cerr << "FAIL " << from_file.size() << " mate regions read from the BAM, expected 2" << std::endl;
+    ++failures;
+  }
+
+  // fed, by a walker with no reader (as after handing it back to the pool)
+  MateRegionVector from_feed;
+  svabaBamWalker s;
+  s.SetFeed(&fed, window);
+  mate_regions(s, mr, from_feed);
+  expect_same("fed window", from_feed, from_file);
+
+  // fed, by a walker whose reader still has the regions of a mate lookup
+  MateRegionVector from_stale;
+  svabaBamWalker m;
+  m.Open(bam);
+  SeqLib::GRC lookup;
+  lookup.add(SeqLib::GenomicRegion(1, 60000, 61000));
+  m.SetMultipleRegions(lookup);
+  m.SetFeed(&fed, window);
+  mate_regions(m, mr, from_stale);
+  expect_same("fed window after a mate lookup", from_stale, from_file);
+
+  remove(sam.c_str());
+  remove(bam.c_str());
+  remove((bam + ".bai").c_str());
+
+  if (failures)
+    return EXIT_FAILURE;
+  std::cerr << "Streamed mate regions match" << std::endl;
+  return EXIT_SUCCESS;
+}
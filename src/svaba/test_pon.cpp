@@ -0,0 +1,81 @@
+// round trip of a text panel of normals, through the text reader
+// and through a binary panel written by svaba pon-build
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gzstream.h"
+#include "PONFilter.h"
+
+static int failures = 0;
+
+static void expect(const PONFilter& p, const std::string& what, int32_t chr, int32_t pos, int type, int32_t len, int want) {
+  int got = p.NSamps(chr, pos, type, len);
+  if (got != want) {
+    std::cerr << "FAIL " << what << ": " << chr << "_" << pos << " type " << type << " len " << len
+	      << " has " << got << " normals, expected " << want << std::endl;
+    ++failures;
+  }
+}
+
+// sites of the text panel below, as a panel of that many normals sees them
+static void check_panel(const PONFilter& p, const std::string& what, int x) {
+  expect(p, what, 1, 100, PONFilter::TYPE_DEL, 5, 2 * x);
+  expect(p, what, 1, 100, PONFilter::TYPE_ANY, 0, 2 * x);
+  expect(p, what, 1, 100, PONFilter::TYPE_INS, 5, 0);     // other type at the site
+  expect(p, what, 1, 100, PONFilter::TYPE_DEL, 6, 0);     // other length
+  expect(p, what, 1, 200, PONFilter::TYPE_ANY, 0, 0);     // tumor line
+  expect(p, what, 1, 300, PONFilter::TYPE_INS, 2, x > 1 ? 2 : 0); // one normal, below PON_MIN_SAMPLES
+  expect(p, what, 2, 400, PONFilter::TYPE_DEL, 7, 3 * x); // untyped site matches any indel
+  expect(p, what, 1, 101, PONFilter::TYPE_ANY, 0, 0);
+  expect(p, what, 70000, 500, PONFilter::TYPE_INS, 1, 2 * x); // contig ID past 16 bits
+  expect(p, what, 70000 & 0xFFFF, 500, PONFilter::TYPE_ANY, 0, 0); // and not its low 16 bits
+  if (p.NSamps("1_100") != 2 * x) {
+    std::cerr << "FAIL " << what << ": 1_100 lookup by string" << std::endl;
+    ++failures;
+  }
+}
+
+int main() {
+
+  std::string text = "test_pon.txt.gz", bin = "test_pon.bin", merged = "test_pon.merged.bin";
+
+  {
+    ogzstream oz(text.c_str());
+    oz << "xN1_100_5D\t3\t2\t0\n"
+       << "xT1_200_3I\t5\t5\t5\n"
+       << "xN1_300_2I\t1\t0\t0\n"
+       << "xN2_400\t1\t1\t1\n"
+       << "xN70000_500_1I\t0\t4\t4\n";
+  }
+
+  PONFilter t(text);
+  check_panel(t, "text", 1);
+
+  if (PONFilter::Build(std::vector<std::string>(1, text), bin) != 4) {
+    std::cerr << "FAIL pon-build of " << text << std::endl;
+    ++failures;
+  }
+  PONFilter b(bin);
+  check_panel(b, "binary", 1);
+
+  // the text panel again plus the binary one sums the counts
+  std::vector<std::string> inputs;
+  inputs.push_back(text);
+  inputs.push_back(bin);
+  PONFilter::Build(inputs, merged);
+  PONFilter m(merged);
+  check_panel(m, "merged", 2);
+
+  remove(text.c_str());
+  remove(bin.c_str());
+  remove(merged.c_str());
+
+  if (failures)
+    return EXIT_FAILURE;
+  std::cerr << "PON round trip passed" << std::endl;
+  return EXIT_SUCCESS;
+}
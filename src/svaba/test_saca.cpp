@@ -0,0 +1,92 @@
+// suffix arrays of the small read tables of an assembly (saca_small_reads)
+// match those of SGA's induced copying, forward and reverse, element
+// for element, over random tables
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "ReadTable.h"
+#include "SuffixArray.h"
+#include "SACAInducedCopying.h"
+#include "SACASmallReads.h"
+
+static int failures = 0;
+
+static uint32_t rng = 12345;
+
+static uint32_t next_rand() {
+  rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+  return rng;
+}
+
+static void expect_same(const std::string& what, const SuffixArray& got, const SuffixArray& want) {
+  if (got.getSize() != want.getSize()) {
+    std::cerr << "FAIL " << what << ": " << got.getSize() << " suffixes, expected " << want.getSize() << std::endl;
+    ++failures;
+    return;
+  }
+  for (size_t i = 0; i < want.getSize(); ++i)
+    if (got.get(i).getID() != want.get(i).getID() || got.get(i).getPos() != want.get(i).getPos()) {
+      std::cerr << "FAIL " << what << ": suffix " << i << " is " << got.get(i).getID() << "," << got.get(i).getPos()
+		<< ", expected " << want.get(i).getID() << "," << want.get(i).getPos() << std::endl;
+      ++failures;
+      return;
+    }
+}
+
+// reads cut from a random sequence over the first alphabet_size bases,
+// so that small genomes and alphabets give many repeated suffixes
+static void check_table(int t, size_t num_reads, size_t genome_len, int alphabet_size) {
+
+  std::string genome;
+  for (size_t i = 0; i < genome_len; ++i)
+    genome += "ACGT"[next_rand() % alphabet_size];
+
+  ReadTable rt;
+  for (size_t i = 0; i < num_reads; ++i) {
+    size_t len = 30 + next_rand() % 121;
+    if (len > genome_len)
+      len = genome_len;
+    SeqItem si;
+    si.id = "read_" + std::to_string(i);
+    si.seq = genome.substr(next_rand() % (genome_len - len + 1), len);
+    rt.addRead(si);
+  }
+
+  SuffixArray fwd, rev;
+  saca_small_reads(&fwd, &rev, &rt);
+
+  SuffixArray fwd_only;
+  saca_small_reads(&fwd_only, &rt);
+
+  SuffixArray want_fwd, want_rev;
+  saca_induced_copying(&want_fwd, &rt, 1, true);
+  rt.reverseAll();
+  saca_induced_copying(&want_rev, &rt, 1, true);
+
+  std::string what = "table " + std::to_string(t) + " (" + std::to_string(num_reads) + " reads, " +
+    std::to_string(genome_len) + " bp, " + std::to_string(alphabet_size) + " bases)";
+  expect_same(what + " forward", fwd, want_fwd);
+  expect_same(what + " forward only", fwd_only, want_fwd);
+  expect_same(what + " reverse", rev, want_rev);
+}
+
+int main() {
+
+  for (int t = 0; t < 200; ++t) {
+    size_t num_reads = 1 + next_rand() % 300;
+    size_t genome_len = 50 + next_rand() % 3000;
+    int alphabet_size = t % 5 == 0 ? 2 : 4; // some low-complexity tables
+    check_table(t, num_reads, genome_len, alphabet_size);
+  }
+
+  // mostly repeated reads, and a single read
+  check_table(200, 50, 60, 4);
+  check_table(201, 1, 200, 4);
+
+  if (failures)
+    return EXIT_FAILURE;
+  std::cerr << "Suffix arrays match induced copying" << std::endl;
+  return EXIT_SUCCESS;
+}
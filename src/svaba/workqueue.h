@@ -5,6 +5,7 @@
 #include <list>
 
 #include "svabaThreadUnit.h"
+#include "SubtaskPool.h"
 #include "SeqLib/RefGenome.h"
 
 typedef std::map<std::string, svabaBamWalker> WalkerMap;
@@ -16,27 +17,49 @@ template <typename T> class wqueue
   wqueue() {
     pthread_mutex_init(&m_mutex, NULL);
     pthread_cond_init(&m_condv, NULL);
+    pthread_cond_init(&m_room, NULL);
   }
 
   ~wqueue() {
     pthread_mutex_destroy(&m_mutex);
     pthread_cond_destroy(&m_condv);
+    pthread_cond_destroy(&m_room);
   }
 
+  // block in add while this many items are waiting (0 for no limit)
+  void setCapacity(size_t c) { m_capacity = c; }
+
   void add(T item) {
     pthread_mutex_lock(&m_mutex);
+    while (m_capacity && m_queue.size() >= m_capacity) {
+      pthread_cond_wait(&m_room, &m_mutex);
+    }
     m_queue.push_back(item);
     pthread_cond_signal(&m_condv);
     pthread_mutex_unlock(&m_mutex);
   }
 
+  // no more items are coming. Wakes the threads waiting in remove
+  void close() {
+    pthread_mutex_lock(&m_mutex);
+    m_closed = true;
+    pthread_cond_broadcast(&m_condv);
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+  // next item, or NULL once the queue is closed and empty
   T remove() {
     pthread_mutex_lock(&m_mutex);
-    while (m_queue.size() == 0) {
+    while (m_queue.size() == 0 && !m_closed) {
       pthread_cond_wait(&m_condv, &m_mutex);
     }
+    if (m_queue.size() == 0) {
+      pthread_mutex_unlock(&m_mutex);
+      return NULL;
+    }
     T item = m_queue.front();
     m_queue.pop_front();
+    pthread_cond_signal(&m_room);
     pthread_mutex_unlock(&m_mutex);
     return item;
   }
@@ -51,6 +74,9 @@ template <typename T> class wqueue
   std::list<T>   m_queue;
   pthread_mutex_t m_mutex;
   pthread_cond_t  m_condv;
+  pthread_cond_t  m_room;
+  size_t m_capacity = 0;
+  bool m_closed = false;
 
 };
 
@@ -126,7 +152,8 @@ public:
 
  ConsumerThread(wqueue<T*>& queue, bool verbose, 
 		const std::string& ref, const std::string& vir,
-		const std::map<std::string, std::string>& bams) : m_queue(queue), m_verbose(verbose) {
+		const std::map<std::string, std::string>& bams,
+		SubtaskPool * helpers = nullptr) : m_queue(queue), m_verbose(verbose), m_helpers(helpers) {
 
     // load the reference genomce
     if (m_verbose)
@@ -142,30 +169,32 @@ public:
       wu.vir_genome->LoadIndex(vir);
     } 
 
-    // open the bams for this thread
-    if (m_verbose)
-      std::cerr << "\tOpening BAMs for thread " << self() << std::endl;
+    // a walker per BAM. The files themselves are opened by the shared
+    // reader pool, and lent to a walker only while it reads
     for (auto& b : bams) {
       wu.walkers[b.first] = svabaBamWalker();
-      wu.walkers[b.first].Open(b.second);
       wu.walkers[b.first].prefix = b.first;
     }
-    
+
 
   }
  
   void* run() {
     // Remove 1 item at a time and process it. Blocks if no items are 
-    // available to process.
+    // available to process. Once the queue is closed and empty, helps
+    // with the windows still running, then returns
     for (int i = 0;; i++) {
       //if (m_verbose)
 	//printf("thread %lu, loop %d - waiting for item...\n", 
 	//     (long unsigned int)self(), i);
       T* item = (T*)m_queue.remove();
+      if (!item) {
+	if (m_helpers)
+	  m_helpers->Help();
+	return NULL;
+      }
       item->run(wu, (long unsigned)self()); 
       delete item;
-      if (m_queue.size() == 0)
-        return NULL;
     }
     return NULL;
   }
@@ -175,6 +204,7 @@ public:
  private: 
   wqueue<T*>& m_queue;
   bool m_verbose;
+  SubtaskPool * m_helpers;
 
 };
 